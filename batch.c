@@ -0,0 +1,451 @@
+#include "batch.h"
+
+#include <time.h>
+
+struct batch_session *batch_session_create(struct batch_session *at,
+                                           struct books *books,
+                                           struct students *students,
+                                           struct users *users) {
+  // Allocating a buffer for structure or use existing if session was provided as the first argument
+  struct batch_session *session = at == NULL ? malloc(sizeof(*session)) : at;
+  session->books = books;
+  session->students = students;
+  session->users = users;
+  session->user_name[0] = '\0';
+  session->logged_in = false;
+  session->can_view_edit_books = false;
+  session->can_view_edit_students = false;
+  session->books_journal = NULL;
+  session->students_journal = NULL;
+  session->books_changed = NULL;
+  session->students_changed = NULL;
+  session->save_books = NULL;
+  session->save_students = NULL;
+  session->books_unsaved = false;
+  session->students_unsaved = false;
+  session->self_created = session != at;
+  return session;
+}
+
+void batch_session_destroy(struct batch_session *session) {
+  if (session == NULL)
+    return;
+  // Tables belong to the caller
+  if (session->self_created)
+    free(session);
+}
+
+static size_t batch_split(char *line, char **fields) {
+  // Fields are unquoted in place, more fields than allowed give BATCH_MAX_FIELDS + 1
+  size_t count = 0;
+  char *read = line;
+  while (true) {
+    if (count == BATCH_MAX_FIELDS)
+      return BATCH_MAX_FIELDS + 1;
+    char *write = read;
+    fields[count++] = write;
+    if (*read == '"') {
+      // Quoted part ends with a single quote, doubled ones are the quotes of value
+      for (++read; *read != '\0'; *write++ = *read++) {
+        if (*read == '"' && *++read != '"')
+          break;
+      }
+    }
+    while (*read != '\0' && *read != CSV_READER_DELIMITER)
+      *write++ = *read++;
+    bool last = *read == '\0';
+    *write = '\0';
+    if (last)
+      return count;
+    ++read;
+  }
+}
+
+static bool batch_ok(char *response, size_t response_size) {
+  sprintf_s(response, response_size, "OK");
+  return true;
+}
+
+static bool batch_error(char *response, size_t response_size, const char *reason) {
+  sprintf_s(response, response_size, "ERR;%s", reason);
+  return false;
+}
+
+static void batch_append(char *response, size_t response_size, const char *value) {
+  // Field is quoted like in CSV, the one which doesn't fit is cut
+  size_t length = strlen(response);
+  bool quoted = value[strcspn(value, ";\"\r\n")] != '\0';
+  if (length + 2 >= response_size)
+    return;
+  response[length++] = ';';
+  if (quoted)
+    response[length++] = '"';
+  for (const char *c = value; *c != '\0' && length + 3 < response_size; ++c) {
+    if (*c == '"')
+      response[length++] = '"';
+    response[length++] = *c;
+  }
+  if (quoted)
+    response[length++] = '"';
+  response[length] = '\0';
+}
+
+static void batch_append_uint(char *response, size_t response_size, unsigned long long value) {
+  char buffer[32];
+  sprintf_s(buffer, sizeof(buffer), "%llu", value);
+  batch_append(response, response_size, buffer);
+}
+
+static bool batch_parse_uint(const char *value, uint64_t *parsed) {
+  char *end;
+  *parsed = strtoull(value, &end, 10);
+  return *value >= '0' && *value <= '9' && *end == '\0';
+}
+
+static bool batch_can_edit_books(struct batch_session *session) {
+  return session->can_view_edit_books && session->books != NULL;
+}
+
+static bool batch_can_edit_students(struct batch_session *session) {
+  return session->can_view_edit_students && session->students != NULL;
+}
+
+static void batch_books_changed(struct batch_session *session) {
+  session->books_unsaved = true;
+  if (session->books_changed != NULL)
+    session->books_changed();
+}
+
+static void batch_students_changed(struct batch_session *session) {
+  session->students_unsaved = true;
+  if (session->students_changed != NULL)
+    session->students_changed();
+}
+
+static bool batch_login(struct batch_session *session, char **fields, char *response, size_t response_size) {
+  struct user *user = session->users == NULL ? NULL : users_find_by_name(session->users, fields[1]);
+  // Failed login logs out, so the commands of previous user can't go on
+  session->logged_in = user != NULL && strcmp(user->password, fields[2]) == 0;
+  session->can_view_edit_books = session->logged_in && user->can_view_edit_books;
+  session->can_view_edit_students = session->logged_in && user->can_view_edit_students;
+  // Item is read under the lock of the users table, the session keeps only the copy
+  snprintf(session->user_name, sizeof(session->user_name), "%s", session->logged_in ? user->name : "");
+  if (!session->logged_in)
+    return batch_error(response, response_size, "wrong user or password");
+  return batch_ok(response, response_size);
+}
+
+static bool batch_book_get(struct batch_session *session, char **fields, char *response, size_t response_size) {
+  uint64_t uid;
+  struct book *item;
+  if (!batch_parse_uint(fields[1], &uid) || (item = books_find_by_uid(session->books, uid)) == NULL)
+    return batch_error(response, response_size, "book not found");
+  // Columns go in the same order as in books.csv
+  batch_ok(response, response_size);
+  batch_append_uint(response, response_size, item->uid);
+  batch_append(response, response_size, item->authors);
+  batch_append(response, response_size, item->book_name);
+  batch_append_uint(response, response_size, item->total_amount);
+  batch_append_uint(response, response_size, item->available_amount);
+  return true;
+}
+
+static bool batch_book_add(struct batch_session *session, char **fields, char *response, size_t response_size) {
+  uint64_t uid;
+  uint64_t total;
+  uint64_t available;
+  if (!batch_parse_uint(fields[1], &uid) || uid == 0 || !batch_parse_uint(fields[4], &total)
+      || !batch_parse_uint(fields[5], &available))
+    return batch_error(response, response_size, "wrong number");
+  if (books_find_by_uid(session->books, uid) != NULL)
+    return batch_error(response, response_size, "book already exists");
+  book_insert_data data;
+  data.uid = uid;
+  data.authors = fields[2];
+  data.book_name = fields[3];
+  data.total_amount = (size_t)total;
+  data.available_amount = (size_t)available;
+  struct book *item = books_insert(session->books, data);
+  if (item == NULL)
+    return batch_error(response, response_size, "out of memory");
+  if (session->books_journal != NULL)
+    books_journal_insert(session->books_journal, item);
+  batch_books_changed(session);
+  return batch_ok(response, response_size);
+}
+
+static bool batch_book_remove(struct batch_session *session, char **fields, char *response, size_t response_size) {
+  uint64_t uid;
+  if (!batch_parse_uint(fields[1], &uid) || !books_remove_by_uid(session->books, uid))
+    return batch_error(response, response_size, "book not found");
+  if (session->books_journal != NULL)
+    books_journal_remove(session->books_journal, uid);
+  batch_books_changed(session);
+  return batch_ok(response, response_size);
+}
+
+static bool batch_book_edit(struct batch_session *session, char **fields, char *response, size_t response_size) {
+  uint64_t uid;
+  struct book *item;
+  if (!batch_parse_uint(fields[1], &uid) || (item = books_find_by_uid(session->books, uid)) == NULL)
+    return batch_error(response, response_size, "book not found");
+
+  // Names go in the same order as the fields after uid
+  static const char *const names[] = {"authors", "name", "available", "total"};
+  size_t name = 0;
+  while (name < sizeof(names) / sizeof(*names) && strcmp(names[name], fields[2]) != 0)
+    ++name;
+  if (name == sizeof(names) / sizeof(*names))
+    return batch_error(response, response_size, "unknown field");
+  enum books_field field = (enum books_field)(BOOKS_FIELD_AUTHORS + name);
+
+  // Item is changed in place, so it stays in the table if there is no memory for the new value
+  bool updated;
+  if (field == BOOKS_FIELD_AUTHORS || field == BOOKS_FIELD_BOOK_NAME) {
+    updated = books_update_field(session->books, item, field, fields[3]);
+  } else {
+    uint64_t amount;
+    if (!batch_parse_uint(fields[3], &amount))
+      return batch_error(response, response_size, "wrong number");
+    updated = books_update_amount(session->books, item, field, (size_t)amount);
+  }
+  if (!updated)
+    return batch_error(response, response_size, "out of memory");
+
+  // Journal has no update of books, replay gets the changed item instead of the old one
+  if (session->books_journal != NULL) {
+    books_journal_remove(session->books_journal, uid);
+    books_journal_insert(session->books_journal, item);
+  }
+  batch_books_changed(session);
+  return batch_ok(response, response_size);
+}
+
+static bool batch_student_get(struct batch_session *session, char **fields, char *response, size_t response_size) {
+  struct student *item = students_find_by_uid(session->students, fields[1]);
+  if (item == NULL)
+    return batch_error(response, response_size, "student not found");
+  // Columns go in the same order as in students.csv
+  batch_ok(response, response_size);
+  batch_append(response, response_size, item->record_book_uid);
+  batch_append(response, response_size, item->surname);
+  batch_append(response, response_size, item->name);
+  batch_append(response, response_size, item->patronymic);
+  batch_append(response, response_size, item->faculty);
+  batch_append(response, response_size, item->speciality);
+  return true;
+}
+
+static bool batch_student_add(struct batch_session *session, char **fields, char *response, size_t response_size) {
+  if (fields[1][0] == '\0')
+    return batch_error(response, response_size, "empty record book number");
+  if (students_find_by_uid(session->students, fields[1]) != NULL)
+    return batch_error(response, response_size, "student already exists");
+  student_insert_data data;
+  data.record_book_uid = fields[1];
+  data.surname = fields[2];
+  data.name = fields[3];
+  data.patronymic = fields[4];
+  data.faculty = fields[5];
+  data.speciality = fields[6];
+  struct student *item = students_insert(session->students, data);
+  if (item == NULL)
+    return batch_error(response, response_size, "out of memory");
+  if (session->students_journal != NULL)
+    students_journal_insert(session->students_journal, item);
+  batch_students_changed(session);
+  return batch_ok(response, response_size);
+}
+
+static bool batch_student_remove(struct batch_session *session, char **fields, char *response, size_t response_size) {
+  if (!students_remove_by_uid(session->students, fields[1]))
+    return batch_error(response, response_size, "student not found");
+  if (session->students_journal != NULL)
+    students_journal_remove(session->students_journal, fields[1]);
+  batch_students_changed(session);
+  return batch_ok(response, response_size);
+}
+
+static bool batch_student_edit(struct batch_session *session, char **fields, char *response, size_t response_size) {
+  // Record book number is the key, so it isn't editable
+  static const char *const names[] = {"surname", "name", "patronymic", "faculty", "speciality"};
+  struct student *item = students_find_by_uid(session->students, fields[1]);
+  if (item == NULL)
+    return batch_error(response, response_size, "student not found");
+  size_t name = 0;
+  while (name < sizeof(names) / sizeof(*names) && strcmp(names[name], fields[2]) != 0)
+    ++name;
+  if (name == sizeof(names) / sizeof(*names))
+    return batch_error(response, response_size, "unknown field");
+  enum students_field field = (enum students_field)(STUDENTS_FIELD_SURNAME + name);
+  if (!students_update_field(session->students, item, field, fields[3]))
+    return batch_error(response, response_size, "out of memory");
+  if (session->students_journal != NULL)
+    students_journal_update(session->students_journal, item->record_book_uid, field, fields[3]);
+  batch_students_changed(session);
+  return batch_ok(response, response_size);
+}
+
+static bool batch_save_command(struct batch_session *session, char **fields, char *response, size_t response_size) {
+  (void)fields; // Save has no arguments
+  return batch_save(session, response, response_size);
+}
+
+typedef bool (*batch_handler)(struct batch_session *session, char **fields, char *response, size_t response_size);
+
+enum batch_access {
+  BATCH_ACCESS_ANYONE,
+  BATCH_ACCESS_LOGGED_IN,
+  BATCH_ACCESS_BOOKS,
+  BATCH_ACCESS_STUDENTS,
+};
+
+// Lock of the table the command works with, the one of login is the users table
+enum batch_lock {
+  BATCH_LOCK_NONE,
+  BATCH_LOCK_SHARED,
+  BATCH_LOCK_EXCLUSIVE,
+};
+
+static struct dynamic_array *batch_table_of(struct batch_session *session, enum batch_access access) {
+  // Pools keep the dynamic array first, it has the lock of table
+  switch (access) {
+  case BATCH_ACCESS_ANYONE:return session->users == NULL ? NULL : &session->users->arr;
+  case BATCH_ACCESS_BOOKS:return &session->books->arr;
+  case BATCH_ACCESS_STUDENTS:return &session->students->arr;
+  default:return NULL;
+  }
+}
+
+struct batch_command {
+  const char *name;
+  size_t fields; // Including the name
+  enum batch_access access;
+  enum batch_lock lock;
+  batch_handler handler;
+};
+
+static const struct batch_command batch_commands[] = {
+    {"login", 3, BATCH_ACCESS_ANYONE, BATCH_LOCK_SHARED, batch_login},
+    {"book_get", 2, BATCH_ACCESS_BOOKS, BATCH_LOCK_SHARED, batch_book_get},
+    {"book_add", 6, BATCH_ACCESS_BOOKS, BATCH_LOCK_EXCLUSIVE, batch_book_add},
+    {"book_remove", 2, BATCH_ACCESS_BOOKS, BATCH_LOCK_EXCLUSIVE, batch_book_remove},
+    {"book_edit", 4, BATCH_ACCESS_BOOKS, BATCH_LOCK_EXCLUSIVE, batch_book_edit},
+    {"student_get", 2, BATCH_ACCESS_STUDENTS, BATCH_LOCK_SHARED, batch_student_get},
+    {"student_add", 7, BATCH_ACCESS_STUDENTS, BATCH_LOCK_EXCLUSIVE, batch_student_add},
+    {"student_remove", 2, BATCH_ACCESS_STUDENTS, BATCH_LOCK_EXCLUSIVE, batch_student_remove},
+    {"student_edit", 4, BATCH_ACCESS_STUDENTS, BATCH_LOCK_EXCLUSIVE, batch_student_edit},
+    {"save", 1, BATCH_ACCESS_LOGGED_IN, BATCH_LOCK_NONE, batch_save_command}, // Locks each table it saves
+};
+
+bool batch_execute(struct batch_session *session, char *line, char *response, size_t response_size) {
+  char *fields[BATCH_MAX_FIELDS];
+  size_t count = batch_split(line, fields);
+  const struct batch_command *command = NULL;
+  for (size_t i = 0; i < sizeof(batch_commands) / sizeof(*batch_commands) && command == NULL; ++i) {
+    if (strcmp(batch_commands[i].name, fields[0]) == 0)
+      command = batch_commands + i;
+  }
+  if (command == NULL)
+    return batch_error(response, response_size, "unknown command");
+  if (count != command->fields)
+    return batch_error(response, response_size, "wrong amount of fields");
+
+  bool allowed = true;
+  switch (command->access) {
+  case BATCH_ACCESS_ANYONE:break;
+  case BATCH_ACCESS_LOGGED_IN:allowed = session->logged_in;
+    break;
+  case BATCH_ACCESS_BOOKS:allowed = batch_can_edit_books(session);
+    break;
+  case BATCH_ACCESS_STUDENTS:allowed = batch_can_edit_students(session);
+    break;
+  }
+  if (!allowed)
+    return batch_error(response, response_size, !session->logged_in ? "not logged in" : "permission denied");
+
+  // Sessions of other threads may use the same tables, items are read and changed only under the lock
+  struct dynamic_array *table = batch_table_of(session, command->access);
+  if (table != NULL && command->lock == BATCH_LOCK_SHARED)
+    dynamic_array_lock_shared(table);
+  else if (table != NULL && command->lock == BATCH_LOCK_EXCLUSIVE)
+    dynamic_array_lock_exclusive(table);
+  bool succeeded = command->handler(session, fields, response, response_size);
+  if (table != NULL && command->lock == BATCH_LOCK_SHARED)
+    dynamic_array_unlock_shared(table);
+  else if (table != NULL && command->lock == BATCH_LOCK_EXCLUSIVE)
+    dynamic_array_unlock_exclusive(table);
+  return succeeded;
+}
+
+bool batch_save(struct batch_session *session, char *response, size_t response_size) {
+  // Each table is saved once however many changes it has, other sessions wait for it under the exclusive lock
+  bool saved = true;
+  if (session->books_unsaved && session->save_books != NULL) {
+    books_lock_exclusive(session->books);
+    if (session->save_books())
+      session->books_unsaved = false;
+    else
+      saved = false;
+    books_unlock_exclusive(session->books);
+  }
+  if (session->students_unsaved && session->save_students != NULL) {
+    students_lock_exclusive(session->students);
+    if (session->save_students())
+      session->students_unsaved = false;
+    else
+      saved = false;
+    students_unlock_exclusive(session->students);
+  }
+  if (!saved)
+    return batch_error(response, response_size, "failed to save");
+  return batch_ok(response, response_size);
+}
+
+static double batch_now() {
+  struct timespec now;
+  timespec_get(&now, TIME_UTC);
+  return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+bool batch_run(struct batch_session *session, FILE *input, FILE *output, FILE *errors, struct batch_report *report) {
+  static char line[BATCH_MAX_LINE + 2];
+  static char response[BATCH_MAX_RESPONSE];
+  report->commands = 0;
+  report->failed = 0;
+  double start = batch_now();
+  size_t line_number = 0;
+  while (fgets(line, sizeof(line), input) != NULL) {
+    ++line_number;
+    size_t length = strlen(line);
+    bool complete = length > 0 && line[length - 1] == '\n';
+    if (!complete && !feof(input)) {
+      // Skip the rest of the long line, it would be taken as the next command otherwise
+      int c;
+      while ((c = fgetc(input)) != EOF && c != '\n');
+      ++report->commands;
+      ++report->failed;
+      fprintf(errors, "%llu: ERR;line is too long\n", (unsigned long long)line_number);
+      continue;
+    }
+    while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r'))
+      line[--length] = '\0';
+    if (length == 0 || line[0] == '#')
+      continue; // Empty lines and comments
+
+    ++report->commands;
+    if (!batch_execute(session, line, response, sizeof(response))) {
+      ++report->failed;
+      fprintf(errors, "%llu: %s\n", (unsigned long long)line_number, response);
+    } else if (output != NULL && response[2] == ';') {
+      // Item of get command without the status
+      fprintf(output, "%s\n", response + 3);
+    }
+  }
+  if (!batch_save(session, response, sizeof(response))) {
+    ++report->failed;
+    fprintf(errors, "save: %s\n", response);
+  }
+  report->seconds = batch_now() - start;
+  return report->failed == 0;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "books.h"
+#include "students.h"
+#include "users.h"
+#include "journal.h"
+#include "common.h"
+
+// Longest command line, the longer ones are rejected
+#ifndef BATCH_MAX_LINE
+#define BATCH_MAX_LINE 4096
+#endif
+
+#ifndef BATCH_MAX_FIELDS
+#define BATCH_MAX_FIELDS 8
+#endif
+
+#ifndef BATCH_MAX_RESPONSE
+#define BATCH_MAX_RESPONSE 4096
+#endif
+
+// Longer names of the logged in user are cut in the session
+#ifndef BATCH_MAX_USER_NAME
+#define BATCH_MAX_USER_NAME 256
+#endif
+
+// Gets called after each change of the table, so the caller can make a checkpoint when the journal is long
+typedef void (*batch_changed_callback)();
+// Saves the table, returns false if it failed
+typedef bool (*batch_save_callback)();
+
+/* Commands of tables, one per line with fields separated by ';', fields with ';' or '"' are quoted like in CSV:
+ *   login;NAME;PASSWORD
+ *   book_get;ISBN
+ *   book_add;ISBN;AUTHORS;NAME;TOTAL;AVAILABLE
+ *   book_remove;ISBN
+ *   book_edit;ISBN;authors|name|total|available;VALUE
+ *   student_get;UID
+ *   student_add;UID;SURNAME;NAME;PATRONYMIC;FACULTY;SPECIALITY
+ *   student_remove;UID
+ *   student_edit;UID;surname|name|patronymic|faculty|speciality;VALUE
+ *   save
+ * Response is "OK", "OK;<fields of the item>" for get, or "ERR;<reason>".
+ * Commands of a table need the logged in user with the permission for it.
+ * Each command takes the lock of its table, so sessions on different threads may share the tables.
+ */
+struct batch_session {
+  struct books *books;
+  struct students *students;
+  struct users *users;
+  // Logged in user is copied, the item may be removed or moved by other sessions once the lock is released
+  char user_name[BATCH_MAX_USER_NAME];
+  bool logged_in;
+  bool can_view_edit_books;
+  bool can_view_edit_students;
+  struct journal *books_journal; // Changes are logged if the journal is set
+  struct journal *students_journal;
+  batch_changed_callback books_changed;
+  batch_changed_callback students_changed;
+  batch_save_callback save_books;
+  batch_save_callback save_students;
+  bool books_unsaved; // Changed since the last save
+  bool students_unsaved;
+  bool self_created;
+};
+
+struct batch_report {
+  size_t commands;
+  size_t failed;
+  double seconds;
+};
+
+struct batch_session *batch_session_create(struct batch_session *at,
+                                           struct books *books,
+                                           struct students *students,
+                                           struct users *users);
+void batch_session_destroy(struct batch_session *session);
+
+// Runs one command, line is split in place. Response has no line break
+bool batch_execute(struct batch_session *session, char *line, char *response, size_t response_size);
+// Saves the tables changed since the last save
+bool batch_save(struct batch_session *session, char *response, size_t response_size);
+
+/* Runs each line of input, responses of get commands go to output and failed ones go to errors with line number.
+ * Changed tables are saved once at the end.
+ */
+bool batch_run(struct batch_session *session, FILE *input, FILE *output, FILE *errors, struct batch_report *report);
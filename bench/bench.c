@@ -0,0 +1,536 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#include "books.h"
+#include "students.h"
+#include "users.h"
+#include "metrics.h"
+#include "csv/csv_reader.h"
+
+/* Benchmarks of loading, lookups, changes and saving of the tables made by datagen.
+ * Each benchmark prints one JSON object per line, so results of runs can be compared by scripts.
+ * Latency percentiles are taken from the time of each operation.
+ */
+
+struct bench_samples {
+  uint64_t *ns;
+  size_t size;
+  size_t capacity;
+};
+
+struct bench_options {
+  const char *dir;
+  size_t iterations; // Runs of each whole-table benchmark
+  size_t lookups; // Operations of each per-item benchmark
+};
+
+static uint64_t bench_now_ns() {
+  struct timespec now;
+  timespec_get(&now, TIME_UTC);
+  return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+static uint64_t bench_random_state = 0x9E3779B97F4A7C15ULL;
+
+static size_t bench_random_below(size_t bound) {
+  // xorshift64*
+  bench_random_state ^= bench_random_state >> 12;
+  bench_random_state ^= bench_random_state << 25;
+  bench_random_state ^= bench_random_state >> 27;
+  return (size_t)(bench_random_state * 2685821657736338717ULL % bound);
+}
+
+static void bench_samples_reset(struct bench_samples *samples) {
+  samples->size = 0;
+}
+
+static void bench_samples_add(struct bench_samples *samples, uint64_t ns) {
+  if (samples->size == samples->capacity) {
+    size_t capacity = samples->capacity == 0 ? 1024 : samples->capacity * 2;
+    uint64_t *data = realloc(samples->ns, capacity * sizeof(*data));
+    if (data == NULL)
+      return;
+    samples->ns = data;
+    samples->capacity = capacity;
+  }
+  samples->ns[samples->size++] = ns;
+}
+
+static int bench_ns_compare(const void *left, const void *right) {
+  uint64_t left_ns = *(const uint64_t *)left;
+  uint64_t right_ns = *(const uint64_t *)right;
+  return left_ns < right_ns ? -1 : left_ns > right_ns;
+}
+
+static uint64_t bench_percentile(const struct bench_samples *samples, double percentile) {
+  // Nearest rank of the sorted samples
+  size_t rank = (size_t)(percentile / 100.0 * (double)samples->size + 0.5);
+  if (rank == 0)
+    rank = 1;
+  if (rank > samples->size)
+    rank = samples->size;
+  return samples->ns[rank - 1];
+}
+
+// Whole-table benchmarks also report rows per second, each of their operations handles all of rows
+static void bench_report(const char *name, size_t rows, bool whole_table, struct bench_samples *samples) {
+  if (samples->size == 0)
+    return;
+  uint64_t total = 0;
+  for (size_t i = 0; i < samples->size; ++i)
+    total += samples->ns[i];
+  qsort(samples->ns, samples->size, sizeof(*samples->ns), bench_ns_compare);
+  double seconds = (double)total / 1e9;
+  printf("{\"benchmark\":\"%s\",\"rows\":%zu,\"ops\":%zu,\"total_ms\":%.3f,\"ops_per_sec\":%.1f,",
+         name,
+         rows,
+         samples->size,
+         seconds * 1e3,
+         seconds > 0 ? (double)samples->size / seconds : 0.0);
+  if (whole_table)
+    printf("\"rows_per_sec\":%.1f,", seconds > 0 ? (double)rows * (double)samples->size / seconds : 0.0);
+  printf("\"p50_ns\":%llu,\"p90_ns\":%llu,\"p99_ns\":%llu,\"p999_ns\":%llu,\"max_ns\":%llu}\n",
+         (unsigned long long)bench_percentile(samples, 50),
+         (unsigned long long)bench_percentile(samples, 90),
+         (unsigned long long)bench_percentile(samples, 99),
+         (unsigned long long)bench_percentile(samples, 99.9),
+         (unsigned long long)samples->ns[samples->size - 1]);
+  fflush(stdout);
+  bench_samples_reset(samples);
+}
+
+static void bench_path(char *path, size_t size, const struct bench_options *options, const char *name) {
+  snprintf(path, size, "%s/%s", options->dir, name);
+}
+
+static size_t bench_parse_csv(const struct bench_options *options, const char *name, bool parallel, struct bench_samples *samples) {
+  // Rows are only split into fields, nothing is copied
+  char path[4096];
+  bench_path(path, sizeof(path), options, name);
+  size_t rows = 0;
+  for (size_t iteration = 0; iteration < options->iterations; ++iteration) {
+    uint64_t start = bench_now_ns();
+    struct csv_reader reader;
+    if (csv_reader_open(&reader, path) == NULL)
+      return 0;
+    if (parallel)
+      csv_reader_parse_parallel(&reader, 0);
+    struct csv_record record;
+    rows = 0;
+    while (csv_reader_next(&reader, &record))
+      ++rows;
+    csv_reader_close(&reader);
+    bench_samples_add(samples, bench_now_ns() - start);
+  }
+  return rows;
+}
+
+static struct csv_reader *bench_open_csv(const struct bench_options *options, const char *name, struct csv_reader *reader) {
+  char path[4096];
+  bench_path(path, sizeof(path), options, name);
+  if (csv_reader_open(reader, path) == NULL)
+    return NULL;
+  // The same way as the app loads tables
+  csv_reader_parse_parallel(reader, 0);
+  return reader;
+}
+
+static bool bench_save(const struct bench_options *options,
+                       bool (*save)(void *pool, FILE *fp),
+                       void *pool,
+                       struct bench_samples *samples) {
+  char path[4096];
+  bench_path(path, sizeof(path), options, "bench_out.csv");
+  for (size_t iteration = 0; iteration < options->iterations; ++iteration) {
+    uint64_t start = bench_now_ns();
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL)
+      return false;
+    bool saved = save(pool, fp);
+    fclose(fp);
+    bench_samples_add(samples, bench_now_ns() - start);
+    if (!saved)
+      return false;
+  }
+  remove(path);
+  return true;
+}
+
+static bool bench_books_save(void *pool, FILE *fp) {
+  return books_save_csv_to_file((struct books *)pool, fp);
+}
+
+static bool bench_students_save(void *pool, FILE *fp) {
+  return students_save_csv_to_file((struct students *)pool, fp);
+}
+
+static bool bench_users_save(void *pool, FILE *fp) {
+  return users_save_csv_to_file((struct users *)pool, fp);
+}
+
+static struct book *bench_random_book(struct books *pool) {
+  // Removed items are skipped, there are a few of them at most
+  struct book *item;
+  do {
+    item = books_first(pool) + bench_random_below(dynamic_array_size(&pool->arr));
+  } while (books_is_removed(pool, item));
+  return item;
+}
+
+static struct student *bench_random_student(struct students *pool) {
+  struct student *item;
+  do {
+    item = students_first(pool) + bench_random_below(dynamic_array_size(&pool->arr));
+  } while (students_is_removed(pool, item));
+  return item;
+}
+
+struct bench_reader {
+  struct books *pool;
+  const uint64_t *uids;
+  size_t size;
+};
+
+static DWORD WINAPI bench_books_reader(LPVOID param) {
+  // Lock is taken for each lookup, like a session of server does for each command
+  struct bench_reader *reader = (struct bench_reader *)param;
+  for (size_t i = 0; i < reader->size; ++i) {
+    books_lock_shared(reader->pool);
+    books_find_by_uid(reader->pool, reader->uids[i]);
+    books_unlock_shared(reader->pool);
+  }
+  return 0;
+}
+
+static bool bench_books_shared_run(struct books *pool, const uint64_t *uids, size_t lookups, size_t threads) {
+  struct bench_reader readers[MAXIMUM_WAIT_OBJECTS];
+  HANDLE handles[MAXIMUM_WAIT_OBJECTS];
+  size_t started = 0;
+  uint64_t start = bench_now_ns();
+  for (; started < threads; ++started) {
+    readers[started].pool = pool;
+    readers[started].uids = uids;
+    readers[started].size = lookups;
+    handles[started] = CreateThread(NULL, 0, bench_books_reader, readers + started, 0, NULL);
+    if (handles[started] == NULL)
+      break;
+  }
+  if (started > 0)
+    WaitForMultipleObjects((DWORD)started, handles, TRUE, INFINITE);
+  uint64_t elapsed = bench_now_ns() - start;
+  for (size_t i = 0; i < started; ++i)
+    CloseHandle(handles[i]);
+  if (started < threads)
+    return false;
+
+  // Wall time of all threads, not the sum of latencies like bench_report
+  double seconds = (double)elapsed / 1e9;
+  size_t ops = threads * lookups;
+  printf("{\"benchmark\":\"books_find_by_uid_shared\",\"rows\":%zu,\"threads\":%zu,\"ops\":%zu,\"total_ms\":%.3f,\"ops_per_sec\":%.1f}\n",
+         books_size(pool),
+         threads,
+         ops,
+         seconds * 1e3,
+         seconds > 0 ? (double)ops / seconds : 0.0);
+  fflush(stdout);
+  return true;
+}
+
+static void bench_books_shared(const struct bench_options *options, struct books *pool) {
+  // Each thread makes the same amount of lookups, so ops_per_sec grows with threads while readers don't wait
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  size_t max_threads = info.dwNumberOfProcessors == 0 ? 1 : info.dwNumberOfProcessors;
+  if (max_threads > MAXIMUM_WAIT_OBJECTS)
+    max_threads = MAXIMUM_WAIT_OBJECTS;
+  uint64_t *uids = malloc(options->lookups * sizeof(*uids));
+  if (uids == NULL)
+    return;
+  for (size_t i = 0; i < options->lookups; ++i)
+    uids[i] = bench_random_book(pool)->uid;
+
+  // Powers of two and then all of the cores
+  size_t threads = 1;
+  while (bench_books_shared_run(pool, uids, options->lookups, threads) && threads < max_threads)
+    threads = threads * 2 < max_threads ? threads * 2 : max_threads;
+  SAFE_FREE(uids);
+}
+
+static const char *bench_first_word(const char *str, char *buffer, size_t size) {
+  // Query of the word search is a word of the title
+  const char *cursor = str;
+  char token[TEXT_MAX_TOKEN];
+  if (!text_next_token(&cursor, token))
+    token[0] = '\0';
+  snprintf(buffer, size, "%s", token);
+  return buffer;
+}
+
+static void bench_books(const struct bench_options *options, struct bench_samples *samples) {
+  size_t rows = bench_parse_csv(options, "books.csv", false, samples);
+  bench_report("parse_csv_books", rows, true, samples);
+  bench_parse_csv(options, "books.csv", true, samples);
+  bench_report("parse_csv_parallel_books", rows, true, samples);
+
+  struct books *pool = NULL;
+  for (size_t iteration = 0; iteration < options->iterations; ++iteration) {
+    struct csv_reader reader;
+    if (bench_open_csv(options, "books.csv", &reader) == NULL)
+      return;
+    if (pool != NULL)
+      books_destroy(pool);
+    uint64_t start = bench_now_ns();
+    pool = books_create_from_csv(NULL, &reader);
+    bench_samples_add(samples, bench_now_ns() - start);
+    csv_reader_close(&reader);
+  }
+  bench_report("books_create_from_csv", rows, true, samples);
+  if (pool == NULL || books_size(pool) == 0)
+    return;
+  rows = books_size(pool);
+
+  for (size_t i = 0; i < options->lookups; ++i) {
+    uint64_t uid = bench_random_book(pool)->uid;
+    uint64_t start = bench_now_ns();
+    books_find_by_uid(pool, uid);
+    bench_samples_add(samples, bench_now_ns() - start);
+  }
+  bench_report("books_find_by_uid", rows, false, samples);
+  bench_books_shared(options, pool);
+
+  for (size_t i = 0; i < options->lookups; ++i) {
+    const char *authors = bench_random_book(pool)->authors;
+    uint64_t start = bench_now_ns();
+    books_find_by_authors(pool, authors, NULL, NULL);
+    bench_samples_add(samples, bench_now_ns() - start);
+  }
+  bench_report("books_find_by_authors", rows, false, samples);
+
+  char query[TEXT_MAX_TOKEN];
+  for (size_t i = 0; i < options->lookups; ++i) {
+    bench_first_word(bench_random_book(pool)->book_name, query, sizeof(query));
+    uint64_t start = bench_now_ns();
+    books_find_by_words(pool, query, NULL, NULL);
+    bench_samples_add(samples, bench_now_ns() - start);
+  }
+  bench_report("books_find_by_words", rows, false, samples);
+
+  for (size_t i = 0; i < options->lookups; ++i) {
+    // Fragment from the middle of authors, like the one typed at the desk
+    const char *authors = bench_random_book(pool)->authors;
+    snprintf(query, sizeof(query), "%.5s", authors + strlen(authors) / 3);
+    uint64_t start = bench_now_ns();
+    books_find_by_substring(pool, query, NULL, NULL);
+    bench_samples_add(samples, bench_now_ns() - start);
+  }
+  bench_report("books_find_by_substring", rows, false, samples);
+
+  // Uids of ISBN are 13 digits, so the small ones are free
+  for (size_t i = 0; i < options->lookups; ++i) {
+    book_insert_data data = {i + 1, " . .", " ", 1, 1};
+    uint64_t start = bench_now_ns();
+    books_insert(pool, data);
+    bench_samples_add(samples, bench_now_ns() - start);
+  }
+  bench_report("books_insert", rows, false, samples);
+
+  for (size_t i = 0; i < options->lookups; ++i) {
+    uint64_t start = bench_now_ns();
+    books_remove_by_uid(pool, i + 1);
+    bench_samples_add(samples, bench_now_ns() - start);
+  }
+  bench_report("books_remove", rows, false, samples);
+
+  if (bench_save(options, bench_books_save, pool, samples))
+    bench_report("books_save_csv_to_file", books_size(pool), true, samples);
+  bench_samples_reset(samples);
+  books_destroy(pool);
+}
+
+static void bench_students(const struct bench_options *options, struct bench_samples *samples) {
+  size_t rows = bench_parse_csv(options, "students.csv", false, samples);
+  bench_report("parse_csv_students", rows, true, samples);
+
+  struct students *pool = NULL;
+  for (size_t iteration = 0; iteration < options->iterations; ++iteration) {
+    struct csv_reader reader;
+    if (bench_open_csv(options, "students.csv", &reader) == NULL)
+      return;
+    if (pool != NULL)
+      students_destroy(pool);
+    uint64_t start = bench_now_ns();
+    pool = students_create_from_csv(NULL, &reader);
+    bench_samples_add(samples, bench_now_ns() - start);
+    csv_reader_close(&reader);
+  }
+  bench_report("students_create_from_csv", rows, true, samples);
+  if (pool == NULL || students_size(pool) == 0)
+    return;
+  rows = students_size(pool);
+
+  for (size_t i = 0; i < options->lookups; ++i) {
+    const char *uid = bench_random_student(pool)->record_book_uid;
+    uint64_t start = bench_now_ns();
+    students_find_by_uid(pool, uid);
+    bench_samples_add(samples, bench_now_ns() - start);
+  }
+  bench_report("students_find_by_uid", rows, false, samples);
+
+  for (size_t i = 0; i < options->lookups; ++i) {
+    const char *surname = bench_random_student(pool)->surname;
+    uint64_t start = bench_now_ns();
+    students_find_by_surname(pool, surname);
+    bench_samples_add(samples, bench_now_ns() - start);
+  }
+  bench_report("students_find_by_surname", rows, false, samples);
+
+  char prefix[8];
+  for (size_t i = 0; i < options->lookups; ++i) {
+    snprintf(prefix, sizeof(prefix), "%.3s", bench_random_student(pool)->surname);
+    uint64_t start = bench_now_ns();
+    students_iterator iterator = students_find_by_surname_prefix(pool, prefix);
+    while (students_next(&iterator) != NULL) {
+    }
+    bench_samples_add(samples, bench_now_ns() - start);
+  }
+  bench_report("students_find_by_surname_prefix", rows, false, samples);
+
+  // Each fuzzy search computes many distances, so there are fewer of them
+  char surname[BK_TREE_MAX_KEY];
+  for (size_t i = 0; i < options->lookups / 100 + 1; ++i) {
+    snprintf(surname, sizeof(surname), "%s", bench_random_student(pool)->surname);
+    if (surname[0] != '\0')
+      surname[bench_random_below(strlen(surname))] = 'x'; // One typo
+    uint64_t start = bench_now_ns();
+    students_find_similar_surnames(pool, surname, 1, NULL, NULL);
+    bench_samples_add(samples, bench_now_ns() - start);
+  }
+  bench_report("students_find_similar_surnames", rows, false, samples);
+
+  for (size_t i = 0; i < options->lookups; ++i) {
+    const char *faculty = bench_random_student(pool)->faculty;
+    uint64_t start = bench_now_ns();
+    students_filter_by_faculty(pool, faculty, NULL, NULL);
+    bench_samples_add(samples, bench_now_ns() - start);
+  }
+  bench_report("students_filter_by_faculty", rows, false, samples);
+
+  char uid[32];
+  for (size_t i = 0; i < options->lookups; ++i) {
+    snprintf(uid, sizeof(uid), "BENCH%zu", i);
+    student_insert_data data = {uid, "", "", "", "", " "};
+    uint64_t start = bench_now_ns();
+    students_insert(pool, data);
+    bench_samples_add(samples, bench_now_ns() - start);
+  }
+  bench_report("students_insert", rows, false, samples);
+
+  for (size_t i = 0; i < options->lookups; ++i) {
+    snprintf(uid, sizeof(uid), "BENCH%zu", i);
+    uint64_t start = bench_now_ns();
+    students_remove_by_uid(pool, uid);
+    bench_samples_add(samples, bench_now_ns() - start);
+  }
+  bench_report("students_remove", rows, false, samples);
+
+  if (bench_save(options, bench_students_save, pool, samples))
+    bench_report("students_save_csv_to_file", students_size(pool), true, samples);
+  bench_samples_reset(samples);
+  students_destroy(pool);
+}
+
+static void bench_users(const struct bench_options *options, struct bench_samples *samples) {
+  size_t rows = bench_parse_csv(options, "users.csv", false, samples);
+  bench_report("parse_csv_users", rows, true, samples);
+
+  struct users *pool = NULL;
+  for (size_t iteration = 0; iteration < options->iterations; ++iteration) {
+    struct csv_reader reader;
+    if (bench_open_csv(options, "users.csv", &reader) == NULL)
+      return;
+    if (pool != NULL)
+      users_destroy(pool);
+    uint64_t start = bench_now_ns();
+    pool = users_create_from_csv(NULL, &reader);
+    bench_samples_add(samples, bench_now_ns() - start);
+    csv_reader_close(&reader);
+  }
+  bench_report("users_create_from_csv", rows, true, samples);
+  if (pool == NULL || users_size(pool) == 0)
+    return;
+  rows = users_size(pool);
+
+  for (size_t i = 0; i < options->lookups; ++i) {
+    const char *name = (users_first(pool) + bench_random_below(users_size(pool)))->name;
+    uint64_t start = bench_now_ns();
+    users_find_by_name(pool, name);
+    bench_samples_add(samples, bench_now_ns() - start);
+  }
+  bench_report("users_find_by_name", rows, false, samples);
+
+  char name[32];
+  for (size_t i = 0; i < options->lookups; ++i) {
+    snprintf(name, sizeof(name), "bench%zu", i);
+    user_insert_data data = {name, "bench", false, false};
+    uint64_t start = bench_now_ns();
+    users_insert(pool, data);
+    bench_samples_add(samples, bench_now_ns() - start);
+  }
+  bench_report("users_insert", rows, false, samples);
+
+  for (size_t i = 0; i < options->lookups; ++i) {
+    snprintf(name, sizeof(name), "bench%zu", i);
+    uint64_t start = bench_now_ns();
+    users_remove_by_name(pool, name);
+    bench_samples_add(samples, bench_now_ns() - start);
+  }
+  bench_report("users_remove", rows, false, samples);
+
+  if (bench_save(options, bench_users_save, pool, samples))
+    bench_report("users_save_csv_to_file", users_size(pool), true, samples);
+  bench_samples_reset(samples);
+  users_destroy(pool);
+}
+
+static void bench_usage() {
+  fprintf(stderr,
+          "Usage: bench [--data DIR] [--iterations N] [--lookups N]\n"
+          "  DIR has books.csv, students.csv and users.csv made by datagen\n");
+}
+
+int main(int argc, char **argv) {
+  struct bench_options options = {".", 3, 100000};
+  for (int i = 1; i < argc; ++i) {
+    if (i + 1 == argc) {
+      bench_usage();
+      return 1;
+    }
+    const char *value = argv[++i];
+    if (strcmp(argv[i - 1], "--data") == 0) {
+      options.dir = value;
+    } else if (strcmp(argv[i - 1], "--iterations") == 0 && atoi(value) > 0) {
+      options.iterations = (size_t)atoi(value);
+    } else if (strcmp(argv[i - 1], "--lookups") == 0 && atoi(value) > 0) {
+      options.lookups = (size_t)atoi(value);
+    } else {
+      bench_usage();
+      return 1;
+    }
+  }
+
+  struct bench_samples samples = {NULL, 0, 0};
+  bench_books(&options, &samples);
+  bench_students(&options, &samples);
+  bench_users(&options, &samples);
+  SAFE_FREE(samples.ns);
+  // Stdout has only the JSON lines, the table of instrumented functions goes aside
+  if (metrics_enabled())
+    metrics_dump(stderr);
+  return 0;
+}
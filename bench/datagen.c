@@ -0,0 +1,250 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "output_buffer.h"
+
+/* Generator of synthetic tables for the benchmarks.
+ * Writes books.csv, students.csv and users.csv in the format of the loaders, text is CP-1251.
+ * The same seed and sizes give the same files.
+ */
+
+#define DATAGEN_MAX_ROWS 100000000ULL
+#define DATAGEN_ARRAY_SIZE(array) (sizeof(array) / sizeof(*(array)))
+
+static uint64_t datagen_state = 88172645463325252ULL;
+
+static uint64_t datagen_random() {
+  // xorshift64*
+  datagen_state ^= datagen_state >> 12;
+  datagen_state ^= datagen_state << 25;
+  datagen_state ^= datagen_state >> 27;
+  return datagen_state * 2685821657736338717ULL;
+}
+
+static size_t datagen_random_below(size_t bound) {
+  return (size_t)(datagen_random() % bound);
+}
+
+static const char *const surname_roots[] = {
+    "", "", "", "", "", "", "", "", "", "",
+    "", "", "", "", "", "", "", "", "", "",
+    "", "", "", "", "", "", "", "", "", "",
+    "", "", "", "", "", "", "", "", "", "",
+    "", "", "", "", "", "", "", "", "", "",
+};
+static const char *const surname_endings[] = {"", "", "", "", "", "", "", "", "", ""};
+static const char *const first_names[] = {
+    "", "", "", "", "", "", "", "", "", "",
+    "", "", "", "", "", "", "", "", "", "",
+};
+static const char *const patronymics[] = {
+    "", "", "", "", "", "", "",
+    "", "", "", "", "", "", "",
+};
+static const char *const faculties[] = {
+    "", "", "", "", "", "", "", "", "", "", "", "",
+};
+static const char *const specialities[] = {
+    " ", "   ", " ",
+    "", " ", "", "", "",
+    " ", " ", "", "", "",
+    "  ", " ", " ",
+};
+static const char *const title_words[] = {
+    "", "", "", "", "", "", "", "", "", "",
+    "", "", "", "", "C", "", "", "", "",
+    "", "", "", "", "", "", "", "",
+    "", "", "", "", "", "", "", "", "1", "2", "3",
+    "", "", "", "", "", "", "", "", "",
+    "Programming", "Pearls", "The", "Art", "of", "Computer", "Design", "Patterns", "Clean", "Code",
+};
+
+static const char *datagen_pick(const char *const *values, size_t size) {
+  return values[datagen_random_below(size)];
+}
+
+static void datagen_write_surname(struct output_buffer *out) {
+  output_buffer_write_string(out, datagen_pick(surname_roots, DATAGEN_ARRAY_SIZE(surname_roots)));
+  output_buffer_write_string(out, datagen_pick(surname_endings, DATAGEN_ARRAY_SIZE(surname_endings)));
+}
+
+static uint64_t datagen_isbn(uint64_t row) {
+  // Multiplier is coprime with 10^9, so the body is unique for each row and looks random
+  uint64_t isbn = 978000000000ULL + row * 387420489ULL % 1000000000ULL;
+  // Check digit of ISBN-13
+  uint64_t sum = 0;
+  uint64_t digits = isbn;
+  for (int position = 12; position > 0; --position) {
+    sum += digits % 10 * (position % 2 == 0 ? 3 : 1);
+    digits /= 10;
+  }
+  return isbn * 10 + (10 - sum % 10) % 10;
+}
+
+static bool datagen_books(const char *path, uint64_t rows) {
+  FILE *fp = fopen(path, "wb");
+  if (fp == NULL)
+    return false;
+  struct output_buffer out;
+  output_buffer_create(&out, fp);
+  char field[512];
+  for (uint64_t row = 0; row < rows; ++row) {
+    output_buffer_write_uint(&out, datagen_isbn(row));
+    output_buffer_write_char(&out, ';');
+
+    // One to three authors as "Surname I. O."
+    size_t authors = 1 + datagen_random_below(3);
+    for (size_t author = 0; author < authors; ++author) {
+      if (author > 0)
+        output_buffer_write_string(&out, ", ");
+      datagen_write_surname(&out);
+      output_buffer_write_char(&out, ' ');
+      output_buffer_write(&out, datagen_pick(first_names, DATAGEN_ARRAY_SIZE(first_names)), 1);
+      output_buffer_write_string(&out, ". ");
+      output_buffer_write(&out, datagen_pick(patronymics, DATAGEN_ARRAY_SIZE(patronymics)), 1);
+      output_buffer_write_char(&out, '.');
+    }
+    output_buffer_write_char(&out, ';');
+
+    // Title of two to six words, some of them have a delimiter to be quoted
+    field[0] = '\0';
+    size_t words = 2 + datagen_random_below(5);
+    for (size_t word = 0; word < words; ++word) {
+      if (word > 0)
+        strcat(field, datagen_random_below(20) == 0 ? "; " : " ");
+      strcat(field, datagen_pick(title_words, DATAGEN_ARRAY_SIZE(title_words)));
+    }
+    output_buffer_write_csv_field(&out, field);
+    output_buffer_write_char(&out, ';');
+
+    size_t total = 1 + datagen_random_below(20);
+    output_buffer_write_uint(&out, total);
+    output_buffer_write_char(&out, ';');
+    output_buffer_write_uint(&out, datagen_random_below(total + 1));
+    output_buffer_write_char(&out, '\n');
+  }
+  bool written = output_buffer_destroy(&out);
+  return fclose(fp) == 0 && written;
+}
+
+static bool datagen_students(const char *path, uint64_t rows) {
+  FILE *fp = fopen(path, "wb");
+  if (fp == NULL)
+    return false;
+  struct output_buffer out;
+  output_buffer_create(&out, fp);
+  char uid[32];
+  for (uint64_t row = 0; row < rows; ++row) {
+    // Record book numbers are unique but not sorted
+    snprintf(uid, sizeof(uid), "%02llu%07llu",
+             (unsigned long long)(row % 30),
+             (unsigned long long)(row * 2654435761ULL % 10000000ULL + row / 10000000ULL * 10000000ULL));
+    output_buffer_write_string(&out, uid);
+    output_buffer_write_char(&out, ';');
+    datagen_write_surname(&out);
+    output_buffer_write_char(&out, ';');
+    output_buffer_write_string(&out, datagen_pick(first_names, DATAGEN_ARRAY_SIZE(first_names)));
+    output_buffer_write_char(&out, ';');
+    output_buffer_write_string(&out, datagen_pick(patronymics, DATAGEN_ARRAY_SIZE(patronymics)));
+    output_buffer_write_char(&out, ';');
+    output_buffer_write_string(&out, datagen_pick(faculties, DATAGEN_ARRAY_SIZE(faculties)));
+    output_buffer_write_char(&out, ';');
+    output_buffer_write_string(&out, datagen_pick(specialities, DATAGEN_ARRAY_SIZE(specialities)));
+    output_buffer_write_char(&out, '\n');
+  }
+  bool written = output_buffer_destroy(&out);
+  return fclose(fp) == 0 && written;
+}
+
+static bool datagen_users(const char *path, uint64_t rows) {
+  FILE *fp = fopen(path, "wb");
+  if (fp == NULL)
+    return false;
+  struct output_buffer out;
+  output_buffer_create(&out, fp);
+  // The first one can do everything, so the generated tables are usable by the app
+  output_buffer_write_string(&out, "admin;admin;1;1\n");
+  char line[64];
+  for (uint64_t row = 1; row < rows; ++row) {
+    snprintf(line, sizeof(line), "user%llu;%016llx;%d;%d\n",
+             (unsigned long long)row,
+             (unsigned long long)datagen_random(),
+             (int)datagen_random_below(2),
+             (int)datagen_random_below(2));
+    output_buffer_write_string(&out, line);
+  }
+  bool written = output_buffer_destroy(&out);
+  return fclose(fp) == 0 && written;
+}
+
+static void datagen_usage() {
+  fprintf(stderr,
+          "Usage: datagen [--out DIR] [--rows N] [--books N] [--students N] [--users N] [--seed S]\n"
+          "  --rows sets all of the tables, the default is 1000 rows\n");
+}
+
+static bool datagen_parse_count(const char *value, uint64_t *count) {
+  char *end;
+  unsigned long long parsed = strtoull(value, &end, 10);
+  if (*value == '\0' || *end != '\0' || parsed == 0 || parsed > DATAGEN_MAX_ROWS)
+    return false;
+  *count = parsed;
+  return true;
+}
+
+int main(int argc, char **argv) {
+  const char *dir = ".";
+  uint64_t books_rows = 1000;
+  uint64_t students_rows = 1000;
+  uint64_t users_rows = 1000;
+  for (int i = 1; i < argc; ++i) {
+    if (i + 1 == argc) {
+      datagen_usage();
+      return 1;
+    }
+    const char *value = argv[++i];
+    bool parsed = true;
+    if (strcmp(argv[i - 1], "--out") == 0) {
+      dir = value;
+    } else if (strcmp(argv[i - 1], "--rows") == 0) {
+      parsed = datagen_parse_count(value, &books_rows);
+      students_rows = books_rows;
+      users_rows = books_rows;
+    } else if (strcmp(argv[i - 1], "--books") == 0) {
+      parsed = datagen_parse_count(value, &books_rows);
+    } else if (strcmp(argv[i - 1], "--students") == 0) {
+      parsed = datagen_parse_count(value, &students_rows);
+    } else if (strcmp(argv[i - 1], "--users") == 0) {
+      parsed = datagen_parse_count(value, &users_rows);
+    } else if (strcmp(argv[i - 1], "--seed") == 0) {
+      // Zero state would make xorshift return zeros forever
+      datagen_state = strtoull(value, NULL, 10) | 1;
+    } else {
+      parsed = false;
+    }
+    if (!parsed) {
+      datagen_usage();
+      return 1;
+    }
+  }
+
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/books.csv", dir);
+  if (!datagen_books(path, books_rows)) {
+    fprintf(stderr, "Can't write %s\n", path);
+    return 2;
+  }
+  snprintf(path, sizeof(path), "%s/students.csv", dir);
+  if (!datagen_students(path, students_rows)) {
+    fprintf(stderr, "Can't write %s\n", path);
+    return 2;
+  }
+  snprintf(path, sizeof(path), "%s/users.csv", dir);
+  if (!datagen_users(path, users_rows)) {
+    fprintf(stderr, "Can't write %s\n", path);
+    return 2;
+  }
+  return 0;
+}
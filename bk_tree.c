@@ -0,0 +1,318 @@
+#include "bk_tree.h"
+
+static bool bk_tree_ops_insert(struct table_index *index, void *item) {
+  return bk_tree_insert((struct bk_tree *)index, item);
+}
+
+static bool bk_tree_ops_remove(struct table_index *index, void *item) {
+  return bk_tree_remove((struct bk_tree *)index, item);
+}
+
+static void *bk_tree_ops_find(struct table_index *index, const void *key) {
+  return bk_tree_find((struct bk_tree *)index, (const char *)key);
+}
+
+static size_t bk_tree_ops_find_all(struct table_index *index,
+                                   const void *key,
+                                   table_index_callback callback,
+                                   void *context) {
+  return bk_tree_find_all((struct bk_tree *)index, (const char *)key, callback, context);
+}
+
+static void bk_tree_ops_rebuild(struct table_index *index) {
+  bk_tree_rebuild((struct bk_tree *)index);
+}
+
+static void bk_tree_ops_flush(struct table_index *index) {
+  bk_tree_flush((struct bk_tree *)index);
+}
+
+static const struct table_index_ops bk_tree_ops = {
+    bk_tree_ops_insert,
+    bk_tree_ops_remove,
+    bk_tree_ops_find,
+    bk_tree_ops_find_all,
+    bk_tree_ops_rebuild,
+    bk_tree_ops_flush,
+};
+
+struct bk_tree *bk_tree_create(struct bk_tree *at, struct dynamic_array *arr, bk_tree_key_getter key_getter, uint32_t fields) {
+  // Allocating a buffer for structure or use existing if tree was provided as the first argument
+  struct bk_tree *tree = at == NULL ? malloc(sizeof(*tree)) : at;
+  tree->base.ops = &bk_tree_ops;
+  tree->base.arr = arr;
+  tree->base.fields = fields;
+  tree->nodes = NULL;
+  tree->size = 0;
+  tree->capacity = 0;
+  tree->empty_size = 0;
+  tree->items_size = 0;
+  tree->needs_rebuild = false;
+  string_arena_create(&tree->keys);
+  tree->key_getter = key_getter;
+  tree->self_created = tree != at;
+  return tree;
+}
+
+static void bk_tree_clear(struct bk_tree *tree) {
+  for (size_t node = 0; node < tree->size; ++node) {
+    SAFE_FREE(tree->nodes[node].items);
+  }
+  SAFE_FREE(tree->nodes);
+  tree->size = 0;
+  tree->capacity = 0;
+  tree->empty_size = 0;
+  tree->items_size = 0;
+  tree->needs_rebuild = false;
+  // Keys are freed by the chunks
+  string_arena_destroy(&tree->keys);
+  string_arena_create(&tree->keys);
+}
+
+void bk_tree_destroy(struct bk_tree *tree) {
+  if (tree == NULL)
+    return;
+  bk_tree_clear(tree);
+  string_arena_destroy(&tree->keys);
+  if (tree->self_created)
+    free(tree);
+}
+
+static void bk_tree_lower(const char *key, char buffer[BK_TREE_MAX_KEY]) {
+  size_t length = 0;
+  for (const unsigned char *c = (const unsigned char *)key; *c != '\0' && length < BK_TREE_MAX_KEY - 1; ++c)
+    buffer[length++] = (char)text_to_lower(*c);
+  buffer[length] = '\0';
+}
+
+static size_t bk_tree_add_node(struct bk_tree *tree, const char *key, size_t distance) {
+  if (tree->size == tree->capacity) {
+    size_t capacity = tree->capacity < BK_TREE_MIN_CAPACITY ? BK_TREE_MIN_CAPACITY : tree->capacity * 2;
+    struct bk_tree_node *nodes = realloc(tree->nodes, capacity * sizeof(*nodes));
+    if (nodes == NULL)
+      return BK_TREE_NO_NODE;
+    tree->nodes = nodes;
+    tree->capacity = capacity;
+  }
+  const char *copy = string_arena_copy(&tree->keys, key);
+  if (copy == NULL)
+    return BK_TREE_NO_NODE;
+  struct bk_tree_node *node = tree->nodes + tree->size;
+  node->key = copy;
+  node->distance = distance;
+  node->first_child = BK_TREE_NO_NODE;
+  node->next_sibling = BK_TREE_NO_NODE;
+  node->items = NULL;
+  node->items_size = 0;
+  node->items_capacity = 0;
+  ++tree->empty_size;
+  return tree->size++;
+}
+
+static size_t bk_tree_find_node(struct bk_tree *tree, const char *key, bool create) {
+  // Node of the key in lower case, or the new one which is linked as a child
+  if (tree->size == 0)
+    return create ? bk_tree_add_node(tree, key, 0) : BK_TREE_NO_NODE;
+  size_t node = 0;
+  while (true) {
+    size_t distance = text_distance(key, tree->nodes[node].key);
+    if (distance == 0)
+      return node;
+    size_t child = tree->nodes[node].first_child;
+    while (child != BK_TREE_NO_NODE && tree->nodes[child].distance != distance)
+      child = tree->nodes[child].next_sibling;
+    if (child == BK_TREE_NO_NODE) {
+      if (!create)
+        return BK_TREE_NO_NODE;
+      child = bk_tree_add_node(tree, key, distance);
+      if (child == BK_TREE_NO_NODE)
+        return BK_TREE_NO_NODE;
+      tree->nodes[child].next_sibling = tree->nodes[node].first_child;
+      tree->nodes[node].first_child = child;
+      return child;
+    }
+    node = child;
+  }
+}
+
+bool bk_tree_insert(struct bk_tree *tree, void *item) {
+  struct dynamic_array_handle handle = dynamic_array_handle_of(tree->base.arr, item);
+  if (dynamic_array_handle_is_null(handle))
+    return false;
+  char key[BK_TREE_MAX_KEY];
+  bk_tree_lower(tree->key_getter(item), key);
+  size_t position = bk_tree_find_node(tree, key, true);
+  if (position == BK_TREE_NO_NODE)
+    return false;
+
+  struct bk_tree_node *node = tree->nodes + position;
+  if (node->items_size == node->items_capacity) {
+    size_t capacity = node->items_capacity == 0 ? 1 : node->items_capacity * 2;
+    struct dynamic_array_handle *items = realloc(node->items, capacity * sizeof(*items));
+    if (items == NULL)
+      return false;
+    node->items = items;
+    node->items_capacity = capacity;
+  }
+  if (node->items_size == 0)
+    --tree->empty_size;
+  node->items[node->items_size++] = handle;
+  ++tree->items_size;
+  return true;
+}
+
+bool bk_tree_remove(struct bk_tree *tree, void *item) {
+  struct dynamic_array_handle handle = dynamic_array_handle_of(tree->base.arr, item);
+  if (dynamic_array_handle_is_null(handle))
+    return false;
+  char key[BK_TREE_MAX_KEY];
+  bk_tree_lower(tree->key_getter(item), key);
+  size_t position = bk_tree_find_node(tree, key, false);
+  if (position == BK_TREE_NO_NODE)
+    return false;
+
+  struct bk_tree_node *node = tree->nodes + position;
+  for (size_t i = 0; i < node->items_size; ++i) {
+    if (!dynamic_array_handle_equals(node->items[i], handle))
+      continue;
+    // Order of namesakes doesn't matter, so the last one takes the place
+    node->items[i] = node->items[--node->items_size];
+    --tree->items_size;
+    if (node->items_size == 0)
+      ++tree->empty_size;
+    // Item is still in the array, so the tree is built again by the next search
+    if (tree->empty_size * 100 > tree->size * BK_TREE_MAX_EMPTY_PERCENT)
+      tree->needs_rebuild = true;
+    return true;
+  }
+  return false;
+}
+
+size_t bk_tree_find_all(struct bk_tree *tree, const char *key, table_index_callback callback, void *context) {
+  // Only for callers without the table lock, exclusive unlock flushes the tree before readers come
+  if (tree->needs_rebuild)
+    bk_tree_rebuild(tree);
+  char lower[BK_TREE_MAX_KEY];
+  bk_tree_lower(key, lower);
+  size_t position = bk_tree_find_node(tree, lower, false);
+  if (position == BK_TREE_NO_NODE)
+    return 0;
+  size_t found = 0;
+  for (size_t i = 0; i < tree->nodes[position].items_size; ++i) {
+    void *item = dynamic_array_resolve(tree->base.arr, tree->nodes[position].items[i]);
+    if (item == NULL)
+      continue;
+    ++found;
+    if (callback != NULL && !callback(item, context))
+      break; // Callback asked to stop
+  }
+  return found;
+}
+
+static bool bk_tree_find_callback(void *item, void *context) {
+  *(void **)context = item;
+  return false;
+}
+
+void *bk_tree_find(struct bk_tree *tree, const char *key) {
+  void *found = NULL;
+  bk_tree_find_all(tree, key, bk_tree_find_callback, &found);
+  return found;
+}
+
+struct bk_tree_match {
+  const char *key; // Key of node is kept for sorting, qsort has no context
+  size_t node;
+  size_t distance;
+};
+
+static int bk_tree_match_compare(const void *left, const void *right) {
+  const struct bk_tree_match *left_match = (const struct bk_tree_match *)left;
+  const struct bk_tree_match *right_match = (const struct bk_tree_match *)right;
+  // Closest first, keys of the same distance go in alphabetical order
+  if (left_match->distance != right_match->distance)
+    return left_match->distance < right_match->distance ? -1 : 1;
+  return strcmp(left_match->key, right_match->key);
+}
+
+size_t bk_tree_find_similar(struct bk_tree *tree,
+                            const char *key,
+                            size_t max_distance,
+                            bk_tree_callback callback,
+                            void *context) {
+  // Same as in bk_tree_find_all, readers under the shared lock never get here
+  if (tree->needs_rebuild)
+    bk_tree_rebuild(tree);
+  if (tree->size == 0)
+    return 0;
+  char lower[BK_TREE_MAX_KEY];
+  bk_tree_lower(key, lower);
+
+  // Each node goes to the stack once, so both arrays fit the amount of nodes
+  size_t *stack = malloc(tree->size * sizeof(*stack));
+  struct bk_tree_match *matches = malloc(tree->size * sizeof(*matches));
+  if (stack == NULL || matches == NULL) {
+    SAFE_FREE(stack);
+    SAFE_FREE(matches);
+    return 0;
+  }
+  size_t stack_size = 0;
+  size_t matches_size = 0;
+  stack[stack_size++] = 0;
+  while (stack_size > 0) {
+    size_t node = stack[--stack_size];
+    size_t distance = text_distance(lower, tree->nodes[node].key);
+    if (distance <= max_distance && tree->nodes[node].items_size > 0) {
+      matches[matches_size].key = tree->nodes[node].key;
+      matches[matches_size].node = node;
+      matches[matches_size].distance = distance;
+      ++matches_size;
+    }
+    // Keys of the child subtree are at the edge distance from this key,
+    // so they can be close to the query only if the edge is close to the distance of query
+    for (size_t child = tree->nodes[node].first_child; child != BK_TREE_NO_NODE; child = tree->nodes[child].next_sibling) {
+      size_t edge = tree->nodes[child].distance;
+      if (edge + max_distance >= distance && edge <= distance + max_distance)
+        stack[stack_size++] = child;
+    }
+  }
+  SAFE_FREE(stack);
+
+  qsort(matches, matches_size, sizeof(*matches), bk_tree_match_compare);
+  size_t found = 0;
+  bool stopped = false;
+  for (size_t i = 0; i < matches_size && !stopped; ++i) {
+    struct bk_tree_node *node = tree->nodes + matches[i].node;
+    for (size_t j = 0; j < node->items_size; ++j) {
+      void *item = dynamic_array_resolve(tree->base.arr, node->items[j]);
+      if (item == NULL)
+        continue;
+      ++found;
+      if (callback != NULL && !callback(item, matches[i].distance, context)) {
+        stopped = true; // Callback asked to stop
+        break;
+      }
+    }
+  }
+  SAFE_FREE(matches);
+  return found;
+}
+
+void bk_tree_rebuild(struct bk_tree *tree) {
+  // Drop all of the nodes and insert each item of dynamic array again
+  bk_tree_clear(tree);
+  size_t size = dynamic_array_size(tree->base.arr);
+  for (size_t position = 0; position < size; ++position) {
+    if (!dynamic_array_is_dead(tree->base.arr, position))
+      bk_tree_insert(tree, dynamic_array_get_at(tree->base.arr, position));
+  }
+}
+
+void bk_tree_flush(struct bk_tree *tree) {
+  if (tree->needs_rebuild)
+    bk_tree_rebuild(tree);
+}
+
+size_t bk_tree_size(struct bk_tree *tree) {
+  return tree->items_size;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "dynamic_array.h"
+#include "index_registry.h"
+#include "string_arena.h"
+#include "text.h"
+#include "common.h"
+
+#ifndef BK_TREE_MIN_CAPACITY
+#define BK_TREE_MIN_CAPACITY 16
+#endif
+
+// Keys are compared by this many first characters
+#ifndef BK_TREE_MAX_KEY
+#define BK_TREE_MAX_KEY 64
+#endif
+
+// Tree is rebuilt before the next search when nodes without items are more than this percent
+#ifndef BK_TREE_MAX_EMPTY_PERCENT
+#define BK_TREE_MAX_EMPTY_PERCENT 50
+#endif
+
+// Marks the end of the list of children
+#define BK_TREE_NO_NODE SIZE_MAX
+
+typedef const char *(*bk_tree_key_getter)(void *item);
+// Gets called for similar items from the closest one, returns false to stop the iteration
+typedef bool (*bk_tree_callback)(void *item, size_t distance, void *context);
+
+// Node of each distinct key in lower case, items with the same key share the node
+struct bk_tree_node {
+  const char *key;
+  size_t distance; // Distance from the key of parent, children of a node have different distances
+  size_t first_child;
+  size_t next_sibling;
+  struct dynamic_array_handle *items;
+  size_t items_size;
+  size_t items_capacity;
+};
+
+/* Burkhard-Keller tree over string key ignoring case, by Levenshtein distance.
+ * Triangle inequality lets the search skip each subtree whose edge differs from the distance
+ * to its parent by more than the allowed one.
+ * Node can't leave the tree without the subtree, so removal only empties it, and the tree is
+ * built again once empty nodes are too many.
+ */
+struct bk_tree {
+  struct table_index base; // Must be the first, registry passes the index by base pointer
+  struct bk_tree_node *nodes; // The first one is the root, children are referenced by positions
+  size_t size;
+  size_t capacity;
+  size_t empty_size; // Nodes without items
+  size_t items_size;
+  bool needs_rebuild;
+  struct string_arena keys;
+  bk_tree_key_getter key_getter;
+  bool self_created;
+};
+
+struct bk_tree *bk_tree_create(struct bk_tree *at, struct dynamic_array *arr, bk_tree_key_getter key_getter, uint32_t fields);
+void bk_tree_destroy(struct bk_tree *tree);
+
+bool bk_tree_insert(struct bk_tree *tree, void *item);
+bool bk_tree_remove(struct bk_tree *tree, void *item);
+// Items with the same key ignoring case
+void *bk_tree_find(struct bk_tree *tree, const char *key);
+size_t bk_tree_find_all(struct bk_tree *tree, const char *key, table_index_callback callback, void *context);
+// Visits items which keys are within max_distance edits from the key, ordered by the distance
+size_t bk_tree_find_similar(struct bk_tree *tree,
+                            const char *key,
+                            size_t max_distance,
+                            bk_tree_callback callback,
+                            void *context);
+void bk_tree_rebuild(struct bk_tree *tree);
+/* Rebuilds the tree if it has too many empty nodes, searches don't change the tree after that.
+ * Searches rebuild it themselves only for single-threaded callers which don't take the table lock.
+ */
+void bk_tree_flush(struct bk_tree *tree);
+
+// Amount of indexed items
+size_t bk_tree_size(struct bk_tree *tree);
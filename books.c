@@ -1,60 +1,352 @@
 #include "books.h"
 
+// Fields split into words and trigrams by the text indexes
+static const inverted_index_key_getter books_words_fields[] = {books_item_book_name, books_item_authors};
+static const trigram_index_key_getter books_trigram_fields[] = {books_item_book_name, books_item_authors};
+
 struct books *books_create(struct books *pool) {
+  METRICS_BEGIN(books_create);
   // Allocating a buffer for structure or use existing if pool was provided as argument
   struct books *buffer = pool == NULL ? malloc(sizeof(struct books)) : pool;
   // Construct a dynamic array
   dynamic_array_create(&buffer->arr, sizeof(struct book), books_item_constructor, books_item_destructor, NULL);
+  // Items are referenced by handles, which survive moves of items
+  dynamic_array_enable_handles(&buffer->arr);
+  // Removed books keep their slots until compaction, so removal doesn't move the sorted items
+  dynamic_array_enable_tombstones(&buffer->arr);
+  // Construct indexes by authors, by words and by trigrams, array keeps them up to date
+  hash_index_create(&buffer->authors_index,
+                    &buffer->arr,
+                    books_item_authors,
+                    BOOKS_FIELD_BIT(BOOKS_FIELD_AUTHORS),
+                    false);
+  dynamic_array_add_index(&buffer->arr, &buffer->authors_index.base);
+  // Books are found by uid with the binary search over the sorted array, none of indexes is primary
+  inverted_index_create(&buffer->words_index,
+                        &buffer->arr,
+                        books_words_fields,
+                        sizeof(books_words_fields) / sizeof(books_words_fields[0]),
+                        BOOKS_FIELD_BIT(BOOKS_FIELD_AUTHORS) | BOOKS_FIELD_BIT(BOOKS_FIELD_BOOK_NAME));
+  dynamic_array_add_index(&buffer->arr, &buffer->words_index.base);
+  trigram_index_create(&buffer->trigram_index,
+                       &buffer->arr,
+                       books_trigram_fields,
+                       sizeof(books_trigram_fields) / sizeof(books_trigram_fields[0]),
+                       BOOKS_FIELD_BIT(BOOKS_FIELD_AUTHORS) | BOOKS_FIELD_BIT(BOOKS_FIELD_BOOK_NAME));
+  dynamic_array_add_index(&buffer->arr, &buffer->trigram_index.base);
+  snapshot_init(&buffer->snapshot);
+  string_arena_create(&buffer->strings);
   // Do not release if we didn't allocate by ourselves
   buffer->self_created = pool == buffer;
+  METRICS_END();
   return buffer;
 }
 
 void books_destroy(struct books *pool) {
   if (pool == NULL)
     return;
+  METRICS_BEGIN(books_destroy);
+  hash_index_destroy(&pool->authors_index);
+  inverted_index_destroy(&pool->words_index);
+  trigram_index_destroy(&pool->trigram_index);
+  // Items own nothing but strings, so they are released all at once by chunks instead of one by one
+  pool->arr.item_destructor = NULL;
   dynamic_array_destroy(&pool->arr);
+  snapshot_release(&pool->snapshot);
+  string_arena_destroy(&pool->strings);
   // Do not release if we didn't allocate by ourselves
-  if (!pool->self_created)
+  if (!pool->self_created) {
+    METRICS_END();
     return;
+  }
   free(pool);
+  METRICS_END();
 }
 
 struct book *books_insert(struct books *pool, book_insert_data data) {
+  METRICS_BEGIN(books_insert);
   // Find for item in structure
   struct book *found = books_find_by_uid(pool, data.uid);
-  if (found != NULL)
+  if (found != NULL) {
+    METRICS_END();
     return found;
+  }
   // Insert if we didn't find it and return a pointer
-  return (struct book *)dynamic_array_insert(&pool->arr, &data, NULL);
+  struct book *item = (struct book *)dynamic_array_insert(&pool->arr, &data, NULL);
+  METRICS_END();
+  return item;
+}
+
+struct books_bulk_entry {
+  book_insert_data data; // Must be the first, the entry is passed to item constructor as insert data
+  size_t order; // Index of insert data or offset of csv row
+};
+
+static int books_bulk_entry_compare(const void *left, const void *right) {
+  const struct books_bulk_entry *left_entry = (const struct books_bulk_entry *)left;
+  const struct books_bulk_entry *right_entry = (const struct books_bulk_entry *)right;
+  // Sort by uid, then by order of insertion, so qsort behaves like a stable sort
+  if (left_entry->data.uid != right_entry->data.uid)
+    return left_entry->data.uid < right_entry->data.uid ? -1 : 1;
+  if (left_entry->order != right_entry->order)
+    return left_entry->order < right_entry->order ? -1 : 1;
+  return 0;
+}
+
+static size_t books_bulk_sort_unique(struct books_bulk_entry *entries, size_t count) {
+  qsort(entries, count, sizeof(struct books_bulk_entry), books_bulk_entry_compare);
+
+  // Keep only the first entry of each uid, the same way as books_insert ignores duplicates
+  size_t unique = 0;
+  for (size_t i = 0; i < count; ++i) {
+    if (unique == 0 || entries[unique - 1].data.uid != entries[i].data.uid)
+      entries[unique++] = entries[i];
+  }
+  return unique;
+}
+
+size_t books_insert_bulk(struct books *pool, book_insert_data *data, size_t count) {
+  METRICS_BEGIN(books_insert_bulk);
+  if (count == 0) {
+    METRICS_END();
+    return 0;
+  }
+
+  struct books_bulk_entry *entries = malloc(count * sizeof(struct books_bulk_entry));
+  if (entries == NULL) {
+    METRICS_END();
+    return 0; // Nothing is inserted without the space to sort them
+  }
+  for (size_t i = 0; i < count; ++i) {
+    entries[i].data = data[i];
+    entries[i].order = i;
+  }
+  size_t unique = books_bulk_sort_unique(entries, count);
+
+  size_t inserted = 0;
+  if (dynamic_array_size(&pool->arr) == 0) {
+    // Entries are sorted and unique, so each of them goes right after the last item
+    inserted = dynamic_array_append_n(&pool->arr, entries, sizeof(struct books_bulk_entry), unique);
+  } else {
+    // Existing items win, insert one by one
+    for (size_t i = 0; i < unique; ++i) {
+      if (books_find_by_uid(pool, entries[i].data.uid) == NULL && books_insert(pool, entries[i].data) != NULL)
+        ++inserted;
+    }
+  }
+  SAFE_FREE(entries);
+  METRICS_END();
+  return inserted;
 }
 
 bool books_remove(struct books *pool, struct book *at) {
-  return dynamic_array_remove(&pool->arr, (void *)at);
+  METRICS_BEGIN(books_remove);
+  if (!dynamic_array_remove(&pool->arr, (void *)at)) {
+    METRICS_END();
+    return false;
+  }
+  // Move the rest of items over the dead ones when there are too many of them
+  if (dynamic_array_needs_compaction(&pool->arr))
+    books_compact(pool);
+  METRICS_END();
+  return true;
 }
 
 bool books_remove_by_uid(struct books *pool, uint64_t uid) {
+  METRICS_BEGIN(books_remove_by_uid);
   // Find for item in structure
   struct book *item = books_find_by_uid(pool, uid);
-  if (item == NULL)
+  if (item == NULL) {
+    METRICS_END();
     return false;
+  }
   // Remove if found
-  return dynamic_array_remove(&pool->arr, (void *)item);
+  bool removed = books_remove(pool, item);
+  METRICS_END();
+  return removed;
+}
+
+bool books_update_field(struct books *pool, struct book *item, enum books_field field, const char *value) {
+  METRICS_BEGIN(books_update_field);
+  const char **position = NULL;
+  if (field == BOOKS_FIELD_AUTHORS)
+    position = &item->authors;
+  else if (field == BOOKS_FIELD_BOOK_NAME)
+    position = &item->book_name;
+  // Copy the value because it may be located in temporary buffer, the old one is kept if there is no memory
+  const char *new_value = position == NULL ? NULL : string_arena_copy(&pool->strings, value);
+  if (new_value == NULL) {
+    METRICS_END();
+    return false; // Uid is the order of table, the book should be removed and inserted again
+  }
+  // Indexes by the field forget the old value and get the new one
+  dynamic_array_update_begin(&pool->arr, item, BOOKS_FIELD_BIT(field));
+  books_release_string(pool, position);
+  *position = new_value;
+  dynamic_array_update_end(&pool->arr, item, BOOKS_FIELD_BIT(field));
+  METRICS_END();
+  return true;
+}
+
+bool books_update_amount(struct books *pool, struct book *item, enum books_field field, size_t amount) {
+  if (field == BOOKS_FIELD_AVAILABLE_AMOUNT)
+    item->available_amount = amount;
+  else if (field == BOOKS_FIELD_TOTAL_AMOUNT)
+    item->total_amount = amount;
+  else
+    return false;
+  return true;
+}
+
+size_t books_remove_if(struct books *pool, books_range_callback predicate, void *context) {
+  METRICS_BEGIN(books_remove_if);
+  // Mark all of matching items and compact once, so the whole purge is linear
+  size_t removed = 0;
+  for (size_t i = 0; i < dynamic_array_size(&pool->arr); ++i) {
+    struct book *item = books_first(pool) + i;
+    if (!dynamic_array_is_dead(&pool->arr, i) && predicate(item, context) && dynamic_array_remove(&pool->arr, item))
+      ++removed;
+  }
+  books_compact(pool);
+  METRICS_END();
+  return removed;
+}
+
+void books_compact(struct books *pool) {
+  METRICS_BEGIN(books_compact);
+  dynamic_array_compact(&pool->arr);
+  METRICS_END();
+}
+
+bool books_is_removed(struct books *pool, struct book *item) {
+  return dynamic_array_is_dead(&pool->arr, item - books_first(pool));
+}
+
+static struct book *books_bound(struct book *first, size_t size, uint64_t uid, bool upper) {
+  // Binary search for the first item with uid not less (or more if upper) than the provided one
+  while (size > 0) {
+    size_t half = size / 2;
+    struct book *middle = first + half;
+    if (upper ? middle->uid <= uid : middle->uid < uid) {
+      first = middle + 1;
+      size -= half + 1;
+    } else {
+      size = half;
+    }
+  }
+  return first;
+}
+
+struct book *books_lower_bound(struct books *pool, uint64_t uid) {
+  METRICS_BEGIN(books_lower_bound);
+  // Items are sorted by uid, so the first item with uid not less than the provided one
+  struct book *bound = books_bound(books_first(pool), dynamic_array_size(&pool->arr), uid, false);
+  METRICS_END();
+  return bound;
 }
 
 struct book *books_find_by_uid(struct books *pool, uint64_t uid) {
-  // If there are some items
-  if (books_size(pool) > 0) {
-    for (struct book *item = books_first(pool); item <= books_last(pool); ++item) {
-      // If pointer is not null and uid equals
-      if (item != NULL && item->uid == uid) {
-        return item;
-      }
+  METRICS_BEGIN(books_find_by_uid);
+  struct book *end = books_first(pool) + dynamic_array_size(&pool->arr);
+  // Removed items keep their uid, the live one goes after them
+  for (struct book *item = books_lower_bound(pool, uid); item != end && item->uid == uid; ++item) {
+    if (!books_is_removed(pool, item)) {
+      METRICS_END();
+      return item;
     }
   }
+  METRICS_END();
   return NULL;
 }
 
+struct books_find_context {
+  books_range_callback callback;
+  void *context;
+};
+
+static bool books_find_index_callback(void *item, void *context) {
+  struct books_find_context *find = (struct books_find_context *)context;
+  return find->callback((struct book *)item, find->context);
+}
+
+size_t books_find_by_authors(struct books *pool, const char *authors, books_range_callback callback, void *context) {
+  METRICS_BEGIN(books_find_by_authors);
+  // Books of the authors are listed by the index
+  struct books_find_context find = {callback, context};
+  size_t found = hash_index_find_all(&pool->authors_index, authors, callback == NULL ? NULL : books_find_index_callback, &find);
+  METRICS_END();
+  return found;
+}
+
+size_t books_find_by_words(struct books *pool, const char *query, books_range_callback callback, void *context) {
+  METRICS_BEGIN(books_find_by_words);
+  // Posting lists of the words are intersected by the index
+  struct books_find_context find = {callback, context};
+  size_t found = inverted_index_find_all(&pool->words_index, query, callback == NULL ? NULL : books_find_index_callback, &find);
+  METRICS_END();
+  return found;
+}
+
+size_t books_find_by_substring(struct books *pool, const char *query, books_range_callback callback, void *context) {
+  METRICS_BEGIN(books_find_by_substring);
+  // Candidates with all of the trigrams of query are verified by the index
+  struct books_find_context find = {callback, context};
+  size_t found = trigram_index_find_all(&pool->trigram_index, query, callback == NULL ? NULL : books_find_index_callback, &find);
+  METRICS_END();
+  return found;
+}
+
+struct books_ranked_context {
+  books_ranked_callback callback;
+  void *context;
+};
+
+static bool books_ranked_index_callback(void *item, size_t distance, void *context) {
+  struct books_ranked_context *ranked = (struct books_ranked_context *)context;
+  return ranked->callback((struct book *)item, distance, ranked->context);
+}
+
+size_t books_find_similar(struct books *pool,
+                          const char *query,
+                          size_t max_distance,
+                          books_ranked_callback callback,
+                          void *context) {
+  METRICS_BEGIN(books_find_similar);
+  struct books_ranked_context ranked = {callback, context};
+  size_t found = trigram_index_find_similar(&pool->trigram_index,
+                                            query,
+                                            max_distance,
+                                            callback == NULL ? NULL : books_ranked_index_callback,
+                                            &ranked);
+  METRICS_END();
+  return found;
+}
+
+size_t books_range(struct books *pool, uint64_t uid_lo, uint64_t uid_hi, books_range_callback callback, void *context) {
+  METRICS_BEGIN(books_range);
+  size_t count = 0;
+  struct book *end = books_first(pool) + dynamic_array_size(&pool->arr);
+  // Start from the first item in range and stop at the first item out of range
+  for (struct book *item = books_lower_bound(pool, uid_lo); item != end && item->uid <= uid_hi; ++item) {
+    if (books_is_removed(pool, item))
+      continue;
+    ++count;
+    if (callback != NULL && !callback(item, context))
+      break; // Callback asked to stop
+  }
+  METRICS_END();
+  return count;
+}
+
+struct dynamic_array_handle books_handle_of(struct books *pool, struct book *item) {
+  return dynamic_array_handle_of(&pool->arr, item);
+}
+
+struct book *books_resolve(struct books *pool, struct dynamic_array_handle handle) {
+  // NULL if the item was removed
+  return (struct book *)dynamic_array_resolve(&pool->arr, handle);
+}
+
 struct book *books_first(struct books *books) {
   // Return pointer to first item
   return (struct book *)dynamic_array_first(&books->arr);
@@ -70,95 +362,309 @@ struct book *books_end(struct books *pool) {
   return (struct book *)dynamic_array_end(&pool->arr);
 }
 
+void books_lock_shared(struct books *pool) {
+  dynamic_array_lock_shared(&pool->arr);
+}
+
+void books_unlock_shared(struct books *pool) {
+  dynamic_array_unlock_shared(&pool->arr);
+}
+
+void books_lock_exclusive(struct books *pool) {
+  dynamic_array_lock_exclusive(&pool->arr);
+}
+
+void books_unlock_exclusive(struct books *pool) {
+  dynamic_array_unlock_exclusive(&pool->arr);
+}
+
 size_t books_size(struct books *pool) {
-  // Count of books
-  return dynamic_array_size(&pool->arr);
+  // Count of books, removed ones are not counted
+  return dynamic_array_live_size(&pool->arr);
 }
 
-void books_item_constructor(struct dynamic_array *arr, void *item, void *data) {
+void *books_item_constructor(struct dynamic_array *arr, void *item, void *data) {
   // Books constructor, gets clalled by dynamic_array_insert
 
   book_insert_data *insert_data = (book_insert_data *)data;
   struct book *buffer_first = (struct book *)dynamic_array_first(arr);
-  struct book *buffer_last = (struct book *)dynamic_array_last(arr);
-  struct book *position = buffer_last + 1 /*get reserved space, not the last one*/;
-
-  // If there are some items
-  if (dynamic_array_size(arr) > 0) {
-    // If the first item uid more than inserting item uid
-    if (buffer_first->uid >= insert_data->uid) {
-      // Insert the item at the first position
-      position = buffer_first;
-      // Move all items for 1 item down
-      dynamic_array_move(arr, (void *)(position + 1), (void *)position);
-    } else if (buffer_last->uid <= insert_data->uid) {
-      /* Nothing to do */
-    } else {
-      for (struct book *current_position = position - 1 /*skip reserved*/; current_position >= buffer_first;
-           --current_position) {
-        // If the inserting item uid more than iterating item uid
-        if (insert_data->uid >= current_position->uid) {
-          // Put the item down than current item
-          position = current_position + 1;
-          // Move all items for 1 item down
-          dynamic_array_move(arr, (void *)(position + 1), (void *)position);
-          break;
-        }
-      }
-    }
-  } else {
-    // Nothing is there, so it can be created at the start of buffer
-    position = buffer_first;
+  size_t size = dynamic_array_size(arr);
+  struct book *position = buffer_first + size /*get reserved space, not the last one*/;
+
+  // Appending in ascending order doesn't need to move anything
+  if (size > 0 && (position - 1)->uid > insert_data->uid) {
+    // Put the item after all items with the same or less uid
+    position = books_bound(buffer_first, size, insert_data->uid, true);
+    // Move all items for 1 item down
+    dynamic_array_move(arr, (void *)(position + 1), (void *)position);
   }
 
   position->uid = insert_data->uid;
-  position->authors = copy_string(insert_data->authors);
-  position->book_name = copy_string(insert_data->book_name);
+  struct books *pool = (struct books *)arr; // Dynamic array is the first member of pool
+  position->authors = string_arena_copy(&pool->strings, insert_data->authors);
+  position->book_name = string_arena_copy(&pool->strings, insert_data->book_name);
   position->available_amount = insert_data->available_amount;
   position->total_amount = insert_data->total_amount;
+  return position;
 }
 
 void books_item_destructor(struct dynamic_array *arr, void *item) {
   // Books destructor, gets called by dynamic_array_remove
 
   struct book *this_item = (struct book *)item;
+  struct books *pool = (struct books *)arr; // Dynamic array is the first member of pool
   // Safe release of each item in structure
-  SAFE_FREE(this_item->authors);
-  SAFE_FREE(this_item->book_name);
+  books_release_string(pool, &this_item->authors);
+  books_release_string(pool, &this_item->book_name);
+}
+
+const char *books_item_authors(void *item) {
+  // Key of the index by authors
+  return ((struct book *)item)->authors;
+}
+
+const char *books_item_book_name(void *item) {
+  return ((struct book *)item)->book_name;
+}
+
+void books_release_string(struct books *pool, const char **str) {
+  // Strings of snapshot get released all at once with the snapshot
+  if (snapshot_owns(&pool->snapshot, *str)) {
+    *str = NULL;
+    return;
+  }
+  string_arena_release(&pool->strings, *str);
+  *str = NULL;
 }
 
-struct books *books_create_from_csv(struct books *pool, struct csv_data *csv) {
+struct books *books_create_from_csv(struct books *pool, struct csv_reader *reader) {
+  METRICS_BEGIN(books_create_from_csv);
   struct books *buffer = books_create(pool);
-  for (struct csv_row *row = csv_data_first(csv); row <= csv_data_last(csv); ++row) {
-    if (csv_row_size(row) < 5)
+  size_t capacity = csv_reader_count_lines(reader);
+  if (capacity == 0) {
+    METRICS_END();
+    return buffer;
+  }
+
+  /* Collect uid and row offset of all rows first, so the array gets built in one pass instead of sorted insertion
+   * per row. Offsets grow in file order, so they also keep the order of rows for duplicates.
+   */
+  struct books_bulk_entry *entries = malloc(capacity * sizeof(struct books_bulk_entry));
+  if (entries == NULL) {
+    // The caller can't use a table without its rows
+    books_destroy(buffer);
+    METRICS_END();
+    return NULL;
+  }
+  size_t count = 0;
+  struct csv_record record;
+  while (count < capacity && csv_reader_next(reader, &record)) {
+    if (record.size < 5)
       continue;
+    entries[count].data.uid = csv_field_to_uint64(&record.fields[0]);
+    entries[count].order = record.offset;
+    ++count;
+  }
+  size_t unique = books_bulk_sort_unique(entries, count);
+
+  dynamic_array_reserve(&buffer->arr, unique);
+  for (size_t i = 0; i < unique; ++i) {
+    // Read the row again and copy only the values we keep
+    csv_reader_seek(reader, entries[i].order);
+    csv_reader_next(reader, &record);
+    if (!csv_reader_copy_values(reader, &record))
+      continue; // Row without memory for its values is skipped like a broken one
     book_insert_data data;
-    // Get each of values, but do not copy values because the data is temporary
-    data.uid = strtoull(*csv_row_get_at(row, 0), NULL, 10);
-    data.authors = *csv_row_get_at(row, 1);
-    data.book_name = *csv_row_get_at(row, 2);
-    data.total_amount = strtoul(*csv_row_get_at(row, 3), NULL, 10);
-    data.available_amount = strtoul(*csv_row_get_at(row, 4), NULL, 10);
-    // Insert item
-    books_insert(buffer, data);
+    data.uid = entries[i].data.uid;
+    data.authors = record.values[1];
+    data.book_name = record.values[2];
+    data.total_amount = strtoul(record.values[3], NULL, 10);
+    data.available_amount = strtoul(record.values[4], NULL, 10);
+    // Entries are sorted and unique, so each of them goes right after the last item
+    dynamic_array_insert(&buffer->arr, &data, NULL);
   }
+  SAFE_FREE(entries);
+  METRICS_END();
   return buffer;
 }
 
-void books_save_csv_to_file(struct books *pool, FILE *fp) {
-  static char buffer[512 + 1];
-  for (struct book *entry = books_first(pool); entry <= books_last(pool); ++entry) {
-    if (entry == NULL)
-      continue;
-    memset(buffer, 0, sizeof(buffer));
-    sprintf_s(buffer,
-              sizeof(buffer),
-              "%llu;%s;%s;%d;%d\n",
-              entry->uid,
-              entry->authors,
-              entry->book_name,
-              (int)entry->available_amount,
-              (int)entry->total_amount);
-    fwrite(buffer, sizeof(char), strlen(buffer), fp);
+static void books_write_csv_row(const struct book *entry, struct output_buffer *out) {
+  output_buffer_write_uint(out, entry->uid);
+  output_buffer_write_char(out, ';');
+  output_buffer_write_csv_field(out, entry->authors);
+  output_buffer_write_char(out, ';');
+  output_buffer_write_csv_field(out, entry->book_name);
+  output_buffer_write_char(out, ';');
+  // Column order is the same as in books_create_from_csv
+  output_buffer_write_uint(out, entry->total_amount);
+  output_buffer_write_char(out, ';');
+  output_buffer_write_uint(out, entry->available_amount);
+  output_buffer_write_char(out, '\n');
+}
+
+bool books_save_csv_to_file(struct books *pool, FILE *fp) {
+  METRICS_BEGIN(books_save_csv_to_file);
+  // Removed items are dropped on save
+  books_compact(pool);
+  struct output_buffer out;
+  output_buffer_create(&out, fp);
+  for (size_t i = 0; i < books_size(pool); ++i) {
+    books_write_csv_row(books_first(pool) + i, &out);
   }
+  bool written = output_buffer_destroy(&out);
+  METRICS_END();
+  return written;
+}
+
+struct books_snapshot_record {
+  uint64_t uid;
+  uint64_t authors;
+  uint64_t book_name;
+  uint64_t available_amount;
+  uint64_t total_amount;
+};
+
+static bool books_item_from_record(const struct snapshot *snapshot, size_t position, struct book *item) {
+  const struct books_snapshot_record *record = (const struct books_snapshot_record *)snapshot->records + position;
+  item->uid = record->uid;
+  item->authors = snapshot_string(snapshot, record->authors);
+  item->book_name = snapshot_string(snapshot, record->book_name);
+  item->available_amount = (size_t)record->available_amount;
+  item->total_amount = (size_t)record->total_amount;
+  // Do not trust the broken snapshot, items must be sorted and strings must be in heap
+  return item->authors != NULL && item->book_name != NULL && (position == 0 || (record - 1)->uid < record->uid);
+}
+
+struct books *books_create_from_snapshot(struct books *pool, const char *path, const struct snapshot_stamp *stamp) {
+  METRICS_BEGIN(books_create_from_snapshot);
+  struct snapshot snapshot;
+  if (!snapshot_load(&snapshot, path, SNAPSHOT_TABLE_BOOKS, sizeof(struct books_snapshot_record), stamp)) {
+    METRICS_END();
+    return NULL;
+  }
+
+  struct books *buffer = books_create(pool);
+  // The pool owns the snapshot, items point to its strings
+  buffer->snapshot = snapshot;
+  dynamic_array_reserve(&buffer->arr, snapshot.records_count);
+  for (size_t i = 0; i < snapshot.records_count; ++i) {
+    struct book item;
+    if (!books_item_from_record(&snapshot, i, &item)) {
+      // The caller falls back to CSV
+      books_destroy(buffer);
+      METRICS_END();
+      return NULL;
+    }
+    // Items are sorted already, so they are appended as is
+    dynamic_array_append_raw(&buffer->arr, &item, 1);
+  }
+  METRICS_END();
+  return buffer;
+}
+
+bool books_build_snapshot(struct books *pool, struct snapshot *snapshot) {
+  METRICS_BEGIN(books_build_snapshot);
+  // Copy all items to the snapshot, it doesn't depend on the pool anymore
+  books_compact(pool);
+  struct snapshot_builder builder;
+  snapshot_builder_init(&builder, sizeof(struct books_snapshot_record), books_size(pool));
+  for (size_t i = 0; i < books_size(pool); ++i) {
+    struct book *entry = books_first(pool) + i;
+    struct books_snapshot_record *record = (struct books_snapshot_record *)snapshot_builder_add_record(&builder);
+    record->uid = entry->uid;
+    record->authors = snapshot_builder_add_string(&builder, entry->authors);
+    record->book_name = snapshot_builder_add_string(&builder, entry->book_name);
+    record->available_amount = entry->available_amount;
+    record->total_amount = entry->total_amount;
+  }
+  bool built = snapshot_builder_finish(&builder, snapshot, SNAPSHOT_TABLE_BOOKS);
+  snapshot_builder_release(&builder);
+  METRICS_END();
+  return built;
+}
+
+bool books_save_snapshot(struct books *pool, const char *path, const struct snapshot_stamp *stamp) {
+  METRICS_BEGIN(books_save_snapshot);
+  struct snapshot snapshot;
+  if (!books_build_snapshot(pool, &snapshot)) {
+    METRICS_END();
+    return false;
+  }
+  bool written = snapshot_write(&snapshot, path, stamp);
+  snapshot_release(&snapshot);
+  METRICS_END();
+  return written;
+}
+
+bool books_save_csv_from_snapshot(const struct snapshot *snapshot, FILE *fp) {
+  METRICS_BEGIN(books_save_csv_from_snapshot);
+  // The same as books_save_csv_to_file, but for the copy of pool
+  struct output_buffer out;
+  output_buffer_create(&out, fp);
+  for (size_t i = 0; i < snapshot->records_count; ++i) {
+    struct book item;
+    if (!books_item_from_record(snapshot, i, &item)) {
+      output_buffer_destroy(&out);
+      METRICS_END();
+      return false;
+    }
+    books_write_csv_row(&item, &out);
+  }
+  bool written = output_buffer_destroy(&out);
+  METRICS_END();
+  return written;
+}
+
+void books_journal_apply(void *context, uint8_t op, const char **fields, size_t count) {
+  METRICS_BEGIN(books_journal_apply);
+  struct books *pool = (struct books *)context;
+  switch (op) {
+  case JOURNAL_OP_INSERT: {
+    if (count < 5)
+      break;
+    book_insert_data data;
+    data.uid = strtoull(fields[0], NULL, 10);
+    data.authors = fields[1];
+    data.book_name = fields[2];
+    data.available_amount = strtoul(fields[3], NULL, 10);
+    data.total_amount = strtoul(fields[4], NULL, 10);
+    books_insert(pool, data);
+    break;
+  }
+  case JOURNAL_OP_REMOVE: {
+    if (count < 1)
+      break;
+    books_remove_by_uid(pool, strtoull(fields[0], NULL, 10));
+    break;
+  }
+  }
+  METRICS_END();
+}
+
+bool books_journal_insert(struct journal *journal, const struct book *item) {
+  METRICS_BEGIN(books_journal_insert);
+  if (item == NULL) {
+    METRICS_END();
+    return false;
+  }
+  char uid_buffer[32];
+  char available_buffer[32];
+  char total_buffer[32];
+  sprintf_s(uid_buffer, sizeof(uid_buffer), "%llu", (unsigned long long)item->uid);
+  sprintf_s(available_buffer, sizeof(available_buffer), "%llu", (unsigned long long)item->available_amount);
+  sprintf_s(total_buffer, sizeof(total_buffer), "%llu", (unsigned long long)item->total_amount);
+  const char *fields[] = {uid_buffer, item->authors, item->book_name, available_buffer, total_buffer};
+  bool appended = journal_append(journal, JOURNAL_OP_INSERT, fields, sizeof(fields) / sizeof(*fields));
+  METRICS_END();
+  return appended;
+}
+
+bool books_journal_remove(struct journal *journal, uint64_t uid) {
+  METRICS_BEGIN(books_journal_remove);
+  char uid_buffer[32];
+  sprintf_s(uid_buffer, sizeof(uid_buffer), "%llu", (unsigned long long)uid);
+  const char *fields[] = {uid_buffer};
+  bool appended = journal_append(journal, JOURNAL_OP_REMOVE, fields, sizeof(fields) / sizeof(*fields));
+  METRICS_END();
+  return appended;
 }
@@ -7,8 +7,14 @@
 #include <string.h>
 
 #include "dynamic_array.h"
-#include "csv/csv_parser.h"
-#include "csv/csv_row.h"
+#include "hash_index.h"
+#include "inverted_index.h"
+#include "trigram_index.h"
+#include "snapshot.h"
+#include "string_arena.h"
+#include "output_buffer.h"
+#include "journal.h"
+#include "csv/csv_reader.h"
 #include "common.h"
 
 struct book {
@@ -21,28 +27,94 @@ struct book {
 
 typedef struct book book_insert_data;
 
+enum books_field {
+  BOOKS_FIELD_UID,
+  BOOKS_FIELD_AUTHORS,
+  BOOKS_FIELD_BOOK_NAME,
+  BOOKS_FIELD_AVAILABLE_AMOUNT,
+  BOOKS_FIELD_TOTAL_AMOUNT,
+};
+
+// Bit of the field in masks of indexes and dynamic_array_update_begin
+#define BOOKS_FIELD_BIT(field) (1u << (field))
+
+// Gets called for each item in range, returns false to stop the iteration
+typedef bool (*books_range_callback)(struct book *item, void *context);
+// Gets called for similar items from the closest one, returns false to stop the iteration
+typedef bool (*books_ranked_callback)(struct book *item, size_t distance, void *context);
+
 struct books {
-  struct dynamic_array arr;
+  struct dynamic_array arr; // Must be the first, item destructor gets the pool by array pointer
+  struct hash_index authors_index;
+  struct inverted_index words_index; // Words of names and authors
+  struct trigram_index trigram_index; // Substrings of names and authors
+  struct snapshot snapshot; // Owns the strings of items loaded from snapshot
+  struct string_arena strings; // Owns the strings of items inserted after that
   bool self_created;
 };
 
 struct books *books_create(struct books *pool);
 void books_destroy(struct books *pool);
 struct book *books_insert(struct books *pool, book_insert_data data);
+size_t books_insert_bulk(struct books *pool, book_insert_data *data, size_t count);
 bool books_remove(struct books *pool, struct book *at);
 bool books_remove_by_uid(struct books *pool, uint64_t uid);
+// Changes the authors or the name in place, the item stays unchanged if it returns false
+bool books_update_field(struct books *pool, struct book *item, enum books_field field, const char *value);
+// Amounts aren't indexed, so the item just gets the new one
+bool books_update_amount(struct books *pool, struct book *item, enum books_field field, size_t amount);
+// Removes all items the predicate returns true for
+size_t books_remove_if(struct books *pool, books_range_callback predicate, void *context);
+void books_compact(struct books *pool);
+bool books_is_removed(struct books *pool, struct book *item);
 
 struct book *books_find_by_uid(struct books *pool, uint64_t uid);
+size_t books_find_by_authors(struct books *pool, const char *authors, books_range_callback callback, void *context);
+// Visits books which have all of the words of query in the name or authors, case and punctuation are ignored
+size_t books_find_by_words(struct books *pool, const char *query, books_range_callback callback, void *context);
+// Both of them ignore case and compare Cyrillic by its transliteration, see text_normalize
+size_t books_find_by_substring(struct books *pool, const char *query, books_range_callback callback, void *context);
+size_t books_find_similar(struct books *pool,
+                          const char *query,
+                          size_t max_distance,
+                          books_ranked_callback callback,
+                          void *context);
+struct book *books_lower_bound(struct books *pool, uint64_t uid);
+// Visits items with uid in [uid_lo, uid_hi] in ascending order, ISBN prefix is the range of all its continuations
+size_t books_range(struct books *pool, uint64_t uid_lo, uint64_t uid_hi, books_range_callback callback, void *context);
+
+// Handle stays valid until the item is removed, unlike the pointer to item
+struct dynamic_array_handle books_handle_of(struct books *pool, struct book *item);
+struct book *books_resolve(struct books *pool, struct dynamic_array_handle handle);
 
 struct book *books_first(struct books *pool);
 struct book *books_last(struct books *pool);
 struct book *books_end(struct books *pool);
 
+// Readers share the table and the writer has it alone, the pointers to items are valid only under the lock
+void books_lock_shared(struct books *pool);
+void books_unlock_shared(struct books *pool);
+void books_lock_exclusive(struct books *pool);
+void books_unlock_exclusive(struct books *pool);
+
 size_t books_size(struct books *pool);
 
 // Helpers
-void books_item_constructor(struct dynamic_array *arr, void *item, void *data);
+void *books_item_constructor(struct dynamic_array *arr, void *item, void *data);
 void books_item_destructor(struct dynamic_array *arr, void *item);
+void books_release_string(struct books *pool, const char **str);
+const char *books_item_authors(void *item);
+const char *books_item_book_name(void *item);
+
+// Returns NULL if there is no memory to collect the rows
+struct books *books_create_from_csv(struct books *pool, struct csv_reader *reader);
+bool books_save_csv_to_file(struct books *pool, FILE *fp);
+
+struct books *books_create_from_snapshot(struct books *pool, const char *path, const struct snapshot_stamp *stamp);
+bool books_build_snapshot(struct books *pool, struct snapshot *snapshot);
+bool books_save_snapshot(struct books *pool, const char *path, const struct snapshot_stamp *stamp);
+bool books_save_csv_from_snapshot(const struct snapshot *snapshot, FILE *fp);
 
-struct books *books_create_from_csv(struct books *pool, struct csv_data *csv);
-void books_save_csv_to_file(struct books *pool, FILE *fp);
+void books_journal_apply(void *context, uint8_t op, const char **fields, size_t count);
+bool books_journal_insert(struct journal *journal, const struct book *item);
+bool books_journal_remove(struct journal *journal, uint64_t uid);
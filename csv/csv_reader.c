@@ -0,0 +1,475 @@
+#include "csv_reader.h"
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+// States of csv_reader_next which matter for splitting the file, a quote is special only at the start of field
+enum csv_scan_state {
+  CSV_SCAN_ROW_START, // Empty lines are skipped here
+  CSV_SCAN_FIELD_START,
+  CSV_SCAN_PLAIN, // Unquoted field or the rest after the closing quote
+  CSV_SCAN_QUOTED,
+  CSV_SCAN_QUOTE, // Quote inside of quoted field, closing or the first of doubled ones
+  CSV_SCAN_STATES
+};
+
+struct csv_chunk_row {
+  size_t offset;
+  size_t first_field;
+  size_t size;
+};
+
+struct csv_chunk {
+  struct csv_reader reader; // Reader limited by the end of chunk
+  size_t begin;
+  size_t end;
+  unsigned char exits[CSV_SCAN_STATES]; // State at the end of chunk for each state at its start
+  struct csv_field *fields;
+  size_t fields_size;
+  size_t fields_capacity;
+  struct csv_chunk_row *rows;
+  size_t rows_size;
+  size_t rows_capacity;
+};
+
+static void csv_reader_release_chunks(struct csv_reader *reader);
+static bool csv_reader_next_parsed(struct csv_reader *reader, struct csv_record *record);
+static void csv_reader_seek_parsed(struct csv_reader *reader, size_t offset);
+
+struct csv_reader *csv_reader_open(struct csv_reader *at, const char *path) {
+  HANDLE file = CreateFileA(path,
+                            GENERIC_READ,
+                            FILE_SHARE_READ,
+                            NULL,
+                            OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+                            NULL);
+  if (file == INVALID_HANDLE_VALUE)
+    return NULL;
+
+  LARGE_INTEGER file_size;
+  if (!GetFileSizeEx(file, &file_size)) {
+    CloseHandle(file);
+    return NULL;
+  }
+
+  HANDLE mapping = NULL;
+  const char *data = NULL;
+  // Empty file can't be mapped, but it's a valid file without rows
+  if (file_size.QuadPart > 0) {
+    mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping != NULL)
+      data = (const char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (data == NULL) {
+      if (mapping != NULL)
+        CloseHandle(mapping);
+      CloseHandle(file);
+      return NULL;
+    }
+  }
+
+  // Allocating a buffer for structure or use existing if reader was provided as the first argument
+  struct csv_reader *reader = at == NULL ? malloc(sizeof(*reader)) : at;
+  reader->file = file;
+  reader->mapping = mapping;
+  reader->data = data;
+  reader->size = (size_t)file_size.QuadPart;
+  reader->position = 0;
+  reader->scratch = NULL;
+  reader->scratch_capacity = 0;
+  reader->chunks = NULL;
+  reader->chunks_size = 0;
+  reader->chunk_position = 0;
+  reader->row_position = 0;
+  reader->self_created = reader != at;
+  return reader;
+}
+
+void csv_reader_close(struct csv_reader *reader) {
+  if (reader == NULL)
+    return;
+  if (reader->data != NULL)
+    UnmapViewOfFile(reader->data);
+  if (reader->mapping != NULL)
+    CloseHandle(reader->mapping);
+  if (reader->file != NULL)
+    CloseHandle(reader->file);
+  SAFE_FREE(reader->scratch);
+  csv_reader_release_chunks(reader);
+  if (reader->self_created)
+    free(reader);
+}
+
+bool csv_reader_next(struct csv_reader *reader, struct csv_record *record) {
+  if (reader->chunks != NULL)
+    return csv_reader_next_parsed(reader, record);
+
+  const char *data = reader->data;
+  size_t size = reader->size;
+  size_t position = reader->position;
+
+  // Skip empty lines
+  while (position < size && (data[position] == '\n' || data[position] == '\r'))
+    ++position;
+  if (position >= size) {
+    reader->position = position;
+    return false; // No more rows
+  }
+
+  record->size = 0;
+  record->offset = position;
+  bool row_end = false;
+  while (!row_end) {
+    struct csv_field field = {data + position, 0, false};
+    bool quoted = position < size && data[position] == '"';
+    if (quoted) {
+      // Quoted field may contain delimiters, new lines and doubled quotes
+      field.data = data + ++position;
+      while (position < size) {
+        if (data[position] == '"') {
+          if (position + 1 < size && data[position + 1] == '"') {
+            field.escaped = true;
+            position += 2;
+            continue;
+          }
+          break;
+        }
+        ++position;
+      }
+      field.length = (size_t)(data + position - field.data);
+      if (position < size)
+        ++position; // Skip the closing quote
+      // Skip anything between the closing quote and delimiter
+      while (position < size && data[position] != CSV_READER_DELIMITER && data[position] != '\n')
+        ++position;
+    } else {
+      while (position < size && data[position] != CSV_READER_DELIMITER && data[position] != '\n')
+        ++position;
+      field.length = (size_t)(data + position - field.data);
+    }
+
+    if (position >= size || data[position] == '\n') {
+      row_end = true;
+      // Do not keep the carriage return of CRLF line ending
+      if (!quoted && field.length > 0 && field.data[field.length - 1] == '\r')
+        --field.length;
+    }
+    if (position < size)
+      ++position; // Skip the delimiter or new line
+
+    if (record->size < CSV_READER_MAX_FIELDS)
+      record->fields[record->size++] = field;
+  }
+
+  reader->position = position;
+  return true;
+}
+
+void csv_reader_seek(struct csv_reader *reader, size_t offset) {
+  // Offset should be taken from csv_record, so it points to the start of row
+  if (reader->chunks != NULL) {
+    csv_reader_seek_parsed(reader, offset);
+    return;
+  }
+  reader->position = offset < reader->size ? offset : reader->size;
+}
+
+size_t csv_reader_count_lines(struct csv_reader *reader) {
+  // Upper bound of rows amount, may be used to reserve the space before reading
+  size_t count = 0;
+  if (reader->chunks != NULL) {
+    // Rows are already parsed, so the amount is exact
+    for (size_t i = 0; i < reader->chunks_size; ++i)
+      count += reader->chunks[i].rows_size;
+    return count;
+  }
+  const char *end = reader->data + reader->size;
+  for (const char *line = reader->data; line != NULL && line < end; ++count) {
+    line = memchr(line, '\n', (size_t)(end - line));
+    if (line != NULL)
+      ++line;
+  }
+  return count;
+}
+
+static size_t csv_field_unescape(const struct csv_field *field, char *dest) {
+  if (!field->escaped) {
+    memcpy(dest, field->data, field->length);
+    dest[field->length] = '\0';
+    return field->length;
+  }
+  // Replace doubled quotes with single ones
+  size_t length = 0;
+  for (size_t i = 0; i < field->length; ++i) {
+    dest[length++] = field->data[i];
+    if (field->data[i] == '"' && i + 1 < field->length && field->data[i + 1] == '"')
+      ++i;
+  }
+  dest[length] = '\0';
+  return length;
+}
+
+bool csv_reader_copy_values(struct csv_reader *reader, struct csv_record *record) {
+  // Get the space for all values of row
+  size_t required = 0;
+  for (size_t i = 0; i < record->size; ++i)
+    required += record->fields[i].length + 1;
+  if (reader->scratch_capacity < required) {
+    size_t capacity = reader->scratch_capacity < 256 ? 256 : reader->scratch_capacity;
+    while (capacity < required)
+      capacity *= 2;
+    char *scratch = realloc(reader->scratch, capacity);
+    if (scratch == NULL)
+      return false;
+    reader->scratch = scratch;
+    reader->scratch_capacity = capacity;
+  }
+
+  // Values are valid until the next call, the buffer gets reused for each row
+  char *value = reader->scratch;
+  for (size_t i = 0; i < record->size; ++i) {
+    record->values[i] = value;
+    value += csv_field_unescape(&record->fields[i], value) + 1;
+  }
+  return true;
+}
+
+const char *csv_field_copy(const struct csv_field *field) {
+  char *str = malloc(field->length + 1);
+  csv_field_unescape(field, str);
+  return str;
+}
+
+uint64_t csv_field_to_uint64(const struct csv_field *field) {
+  // The same as strtoull with base 10, but doesn't need zero-terminated string
+  uint64_t value = 0;
+  size_t i = 0;
+  while (i < field->length && (field->data[i] == ' ' || field->data[i] == '\t'))
+    ++i;
+  for (; i < field->length && field->data[i] >= '0' && field->data[i] <= '9'; ++i)
+    value = value * 10 + (uint64_t)(field->data[i] - '0');
+  return value;
+}
+
+static void csv_reader_release_chunks(struct csv_reader *reader) {
+  for (size_t i = 0; i < reader->chunks_size; ++i) {
+    SAFE_FREE(reader->chunks[i].fields);
+    SAFE_FREE(reader->chunks[i].rows);
+  }
+  SAFE_FREE(reader->chunks);
+  reader->chunks_size = 0;
+}
+
+static bool csv_reader_next_parsed(struct csv_reader *reader, struct csv_record *record) {
+  // Go through the chunks in file order
+  while (reader->chunk_position < reader->chunks_size) {
+    struct csv_chunk *chunk = &reader->chunks[reader->chunk_position];
+    if (reader->row_position < chunk->rows_size) {
+      struct csv_chunk_row *row = &chunk->rows[reader->row_position++];
+      record->size = row->size;
+      record->offset = row->offset;
+      memcpy(record->fields, chunk->fields + row->first_field, row->size * sizeof(struct csv_field));
+      return true;
+    }
+    ++reader->chunk_position;
+    reader->row_position = 0;
+  }
+  return false;
+}
+
+static void csv_reader_seek_parsed(struct csv_reader *reader, size_t offset) {
+  // Find the chunk of offset, then binary search for the row, rows are sorted by offset
+  size_t chunk_position = 0;
+  while (chunk_position + 1 < reader->chunks_size && reader->chunks[chunk_position].end <= offset)
+    ++chunk_position;
+  struct csv_chunk *chunk = &reader->chunks[chunk_position];
+  size_t first = 0;
+  size_t size = chunk->rows_size;
+  while (size > 0) {
+    size_t half = size / 2;
+    if (chunk->rows[first + half].offset < offset) {
+      first += half + 1;
+      size -= half + 1;
+    } else {
+      size = half;
+    }
+  }
+  reader->chunk_position = chunk_position;
+  reader->row_position = first;
+}
+
+static enum csv_scan_state csv_scan_next(enum csv_scan_state state, char c) {
+  switch (state) {
+  case CSV_SCAN_QUOTED:return c == '"' ? CSV_SCAN_QUOTE : CSV_SCAN_QUOTED;
+  case CSV_SCAN_QUOTE:
+    if (c == '"')
+      return CSV_SCAN_QUOTED; // Doubled quote, otherwise it was the closing one
+    break;
+  case CSV_SCAN_ROW_START:
+    if (c == '\r')
+      return CSV_SCAN_ROW_START;
+    // Fall through - the row starts with a field
+  case CSV_SCAN_FIELD_START:
+    if (c == '"')
+      return CSV_SCAN_QUOTED;
+    break;
+  default:break;
+  }
+  if (c == '\n')
+    return CSV_SCAN_ROW_START;
+  return c == CSV_READER_DELIMITER ? CSV_SCAN_FIELD_START : CSV_SCAN_PLAIN;
+}
+
+static DWORD WINAPI csv_chunk_scan(LPVOID param) {
+  struct csv_chunk *chunk = (struct csv_chunk *)param;
+  // State at the start of chunk isn't known yet, so the chunk is scanned from each of them
+  const char *data = chunk->reader.data;
+  size_t position = chunk->begin;
+  bool same = false;
+  for (int state = 0; state < CSV_SCAN_STATES; ++state)
+    chunk->exits[state] = (unsigned char)state;
+  for (; position < chunk->end && !same; ++position) {
+    same = true;
+    for (int state = 0; state < CSV_SCAN_STATES; ++state) {
+      chunk->exits[state] = (unsigned char)csv_scan_next(chunk->exits[state], data[position]);
+      same = same && chunk->exits[state] == chunk->exits[0];
+    }
+  }
+  if (same) {
+    // Scans from all of the states agree from here, so only one of them goes on
+    enum csv_scan_state exit = chunk->exits[0];
+    for (; position < chunk->end; ++position)
+      exit = csv_scan_next(exit, data[position]);
+    memset(chunk->exits, exit, sizeof(chunk->exits));
+  }
+  return 0;
+}
+
+static DWORD WINAPI csv_chunk_parse(LPVOID param) {
+  struct csv_chunk *chunk = (struct csv_chunk *)param;
+  struct csv_record record;
+  while (csv_reader_next(&chunk->reader, &record)) {
+    // Grow the arrays geometrically
+    if (chunk->rows_size == chunk->rows_capacity) {
+      size_t capacity = chunk->rows_capacity < 1024 ? 1024 : chunk->rows_capacity * 2;
+      struct csv_chunk_row *rows = realloc(chunk->rows, capacity * sizeof(struct csv_chunk_row));
+      if (rows == NULL)
+        return 1;
+      chunk->rows = rows;
+      chunk->rows_capacity = capacity;
+    }
+    if (chunk->fields_size + record.size > chunk->fields_capacity) {
+      size_t capacity = chunk->fields_capacity < 1024 ? 1024 : chunk->fields_capacity * 2;
+      while (capacity < chunk->fields_size + record.size)
+        capacity *= 2;
+      struct csv_field *fields = realloc(chunk->fields, capacity * sizeof(struct csv_field));
+      if (fields == NULL)
+        return 1;
+      chunk->fields = fields;
+      chunk->fields_capacity = capacity;
+    }
+
+    struct csv_chunk_row *row = &chunk->rows[chunk->rows_size++];
+    row->offset = record.offset;
+    row->first_field = chunk->fields_size;
+    row->size = record.size;
+    memcpy(chunk->fields + chunk->fields_size, record.fields, record.size * sizeof(struct csv_field));
+    chunk->fields_size += record.size;
+  }
+  return 0;
+}
+
+static bool csv_chunks_run(struct csv_chunk *chunks, size_t chunks_size, LPTHREAD_START_ROUTINE routine) {
+  // Returns false if the routine failed for any of chunks
+  HANDLE threads[MAXIMUM_WAIT_OBJECTS];
+  bool succeeded = true;
+  for (size_t i = 0; i < chunks_size; ++i) {
+    threads[i] = CreateThread(NULL, 0, routine, &chunks[i], 0, NULL);
+    if (threads[i] == NULL && routine(&chunks[i]) != 0)
+      succeeded = false; // Do it on the current thread if we can't create another one
+  }
+  for (size_t i = 0; i < chunks_size; ++i) {
+    if (threads[i] != NULL) {
+      DWORD code = 1;
+      WaitForSingleObject(threads[i], INFINITE);
+      if (!GetExitCodeThread(threads[i], &code) || code != 0)
+        succeeded = false;
+      CloseHandle(threads[i]);
+    }
+  }
+  return succeeded;
+}
+
+bool csv_reader_parse_parallel(struct csv_reader *reader, size_t threads_count) {
+  if (reader->chunks != NULL || reader->position != 0)
+    return false; // Already parsed or partially read
+
+  if (threads_count == 0) {
+    SYSTEM_INFO system_info;
+    GetSystemInfo(&system_info);
+    threads_count = system_info.dwNumberOfProcessors;
+  }
+  if (threads_count > MAXIMUM_WAIT_OBJECTS)
+    threads_count = MAXIMUM_WAIT_OBJECTS;
+  // Do not split small files, creating threads costs more than parsing
+  if (threads_count > reader->size / CSV_READER_PARALLEL_MIN_CHUNK)
+    threads_count = reader->size / CSV_READER_PARALLEL_MIN_CHUNK;
+  if (threads_count < 2)
+    return false;
+
+  struct csv_chunk *chunks = calloc(threads_count, sizeof(struct csv_chunk));
+  if (chunks == NULL)
+    return false;
+
+  // Scan equal parts of file at first
+  size_t chunk_size = reader->size / threads_count;
+  for (size_t i = 0; i < threads_count; ++i) {
+    chunks[i].reader = *reader;
+    chunks[i].reader.scratch = NULL;
+    chunks[i].reader.scratch_capacity = 0;
+    chunks[i].reader.self_created = false;
+    chunks[i].begin = i * chunk_size;
+    chunks[i].end = i + 1 == threads_count ? reader->size : (i + 1) * chunk_size;
+  }
+  csv_chunks_run(chunks, threads_count, csv_chunk_scan);
+
+  /* Move each split point past the next line break which ends a row. The parser state at the split point is known
+   * by passing the state of file start through the scans of all chunks before it.
+   */
+  enum csv_scan_state boundary = chunks[0].exits[CSV_SCAN_ROW_START];
+  for (size_t i = 1; i < threads_count; ++i) {
+    enum csv_scan_state state = boundary;
+    boundary = chunks[i].exits[boundary]; // State at the original split point of the next chunk
+    size_t split = chunks[i].begin;
+    while (split < reader->size) {
+      char c = reader->data[split++];
+      state = csv_scan_next(state, c);
+      if (c == '\n' && state == CSV_SCAN_ROW_START)
+        break; // The chunk starts after the line break
+    }
+    // Quoted field may span the whole chunk, then the previous chunk takes it and this one stays empty
+    if (split < chunks[i - 1].begin)
+      split = chunks[i - 1].begin;
+    chunks[i - 1].end = split;
+    chunks[i].begin = split;
+  }
+
+  // Parse the chunks, each one gets its own reader limited by the end of chunk
+  for (size_t i = 0; i < threads_count; ++i) {
+    chunks[i].reader.position = chunks[i].begin;
+    chunks[i].reader.size = chunks[i].end;
+  }
+  bool parsed = csv_chunks_run(chunks, threads_count, csv_chunk_parse);
+
+  reader->chunks = chunks;
+  reader->chunks_size = threads_count;
+  if (!parsed) {
+    // Chunk without memory for its rows has lost the rest of them, the caller reads the file sequentially instead
+    csv_reader_release_chunks(reader);
+    return false;
+  }
+  reader->chunk_position = 0;
+  reader->row_position = 0;
+  reader->position = reader->size;
+  return true;
+}
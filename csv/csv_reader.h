@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "../common.h"
+
+#ifndef CSV_READER_MAX_FIELDS
+#define CSV_READER_MAX_FIELDS 16
+#endif
+
+#ifndef CSV_READER_PARALLEL_MIN_CHUNK
+#define CSV_READER_PARALLEL_MIN_CHUNK (4 * 1024 * 1024)
+#endif
+
+#ifndef CSV_READER_DELIMITER
+#define CSV_READER_DELIMITER ';'
+#endif
+
+// View of a field, points directly to the mapped file and is not zero-terminated
+struct csv_field {
+  const char *data;
+  size_t length;
+  bool escaped; // Quoted field with doubled quotes inside
+};
+
+struct csv_record {
+  struct csv_field fields[CSV_READER_MAX_FIELDS];
+  const char *values[CSV_READER_MAX_FIELDS]; // Zero-terminated copies, filled by csv_reader_copy_values
+  size_t size;
+  size_t offset; // Offset of the row from the start of file
+};
+
+struct csv_chunk;
+
+struct csv_reader {
+  void *file;
+  void *mapping;
+  const char *data;
+  size_t size;
+  size_t position;
+  char *scratch; // Temporary buffer for zero-terminated values of the current row
+  size_t scratch_capacity;
+  struct csv_chunk *chunks; // Rows parsed ahead by csv_reader_parse_parallel, in file order
+  size_t chunks_size;
+  size_t chunk_position;
+  size_t row_position;
+  bool self_created;
+};
+
+struct csv_reader *csv_reader_open(struct csv_reader *at, const char *path);
+void csv_reader_close(struct csv_reader *reader);
+
+// Returns false if the rows weren't parsed ahead, csv_reader_next reads the file sequentially then
+bool csv_reader_parse_parallel(struct csv_reader *reader, size_t threads_count);
+bool csv_reader_next(struct csv_reader *reader, struct csv_record *record);
+void csv_reader_seek(struct csv_reader *reader, size_t offset);
+size_t csv_reader_count_lines(struct csv_reader *reader);
+// Returns false if there is no memory for the values, they aren't filled then
+bool csv_reader_copy_values(struct csv_reader *reader, struct csv_record *record);
+
+const char *csv_field_copy(const struct csv_field *field);
+uint64_t csv_field_to_uint64(const struct csv_field *field);
@@ -1,9 +1,17 @@
 #include "dynamic_array.h"
+#include "index_registry.h"
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+// SRWLOCK is a single pointer, so the lock field of header holds it
+_Static_assert(sizeof(SRWLOCK) == sizeof(void *), "SRWLOCK doesn't fit the lock of dynamic array");
 
 struct dynamic_array *dynamic_array_create(struct dynamic_array *at, size_t item_size,
                                            dynamic_array_item_constructor constructor,
                                            dynamic_array_item_destructor destructor,
                                            dynamic_array_item_finder finder) {
+  METRICS_BEGIN(dynamic_array_create);
   // Allocating a buffer for structure or use existing if pool was provided as the first argument
   struct dynamic_array *arr = at == NULL ? malloc(sizeof(*arr)) : at;
   arr->buffer = NULL;
@@ -13,65 +21,302 @@ struct dynamic_array *dynamic_array_create(struct dynamic_array *at, size_t item
   arr->item_constructor = constructor;
   arr->item_destructor = destructor;
   arr->item_finder = finder;
+  arr->tombstones_enabled = false;
+  arr->tombstones = NULL;
+  arr->dead_count = 0;
+  arr->handles_enabled = false;
+  arr->slots = NULL;
+  arr->slots_size = 0;
+  arr->slots_capacity = 0;
+  arr->free_slot = 0;
+  arr->item_slots = NULL;
+  arr->indexes = NULL;
+  arr->primary_index = NULL;
+  InitializeSRWLock((PSRWLOCK)&arr->lock);
   arr->self_created = arr != at;
+  METRICS_END();
   return arr;
 }
 
 void dynamic_array_destroy(struct dynamic_array *arr) {
   if (arr == NULL)
     return;
-
-  uintptr_t buffer_first = dynamic_array_first_intptr(arr);
-  uintptr_t buffer_last = dynamic_array_last_intptr(arr);
+  METRICS_BEGIN(dynamic_array_destroy);
 
   if (arr->buffer != NULL) {
-    for (uintptr_t item = buffer_last; item >= buffer_first; item -= arr->item_size) {
-      if (item != 0) {
-        dynamic_array_remove(arr, (void *)item);
+    // Nothing is moved while all of items are destroyed, so just call destructors
+    if (arr->item_destructor != NULL) {
+      for (size_t i = arr->size; i > 0; --i) {
+        if (!dynamic_array_is_dead(arr, i - 1))
+          arr->item_destructor(arr, (void *)((uintptr_t)arr->buffer + (i - 1) * arr->item_size));
       }
     }
+    arr->size = 0;
+    arr->dead_count = 0;
+    arr->capacity = 0;
     free(arr->buffer);
+    arr->buffer = NULL;
   }
+  SAFE_FREE(arr->tombstones);
+  SAFE_FREE(arr->slots);
+  SAFE_FREE(arr->item_slots);
+  index_registry_destroy(arr->indexes);
+  arr->indexes = NULL;
+  arr->primary_index = NULL;
+  arr->slots_size = 0;
+  arr->slots_capacity = 0;
+  arr->free_slot = 0;
 
   if (arr->self_created)
     free(arr);
+  METRICS_END();
 }
 
 void dynamic_array_reserve(struct dynamic_array *arr, size_t amount) {
   if (arr->capacity >= amount)
     return; // The buffer capacity is already enough for this value
+  METRICS_BEGIN(dynamic_array_reserve);
 
-  arr->capacity = amount;
+  if (arr->tombstones_enabled) {
+    // Flags of new slots are zeroed, they are not dead
+    uint8_t *tombstones = realloc(arr->tombstones, amount);
+    METRICS_REALLOCATED();
+    if (tombstones == NULL) {
+      METRICS_END();
+      return;
+    }
+    METRICS_ALLOCATED(amount - arr->capacity);
+    memset(tombstones + arr->capacity, 0, amount - arr->capacity);
+    arr->tombstones = tombstones;
+  }
+  if (arr->handles_enabled) {
+    uint32_t *item_slots = realloc(arr->item_slots, amount * sizeof(*item_slots));
+    METRICS_REALLOCATED();
+    if (item_slots == NULL) {
+      METRICS_END();
+      return;
+    }
+    METRICS_ALLOCATED((amount - arr->capacity) * sizeof(*item_slots));
+    arr->item_slots = item_slots;
+  }
+
+  size_t old_buffer_size = arr->capacity * arr->item_size;
   size_t new_buffer_size = amount * arr->item_size;
-  void *new_buffer = malloc(new_buffer_size); // Allocate a buffer
-  memset(new_buffer, 0, new_buffer_size); // Zeroify the whole buffer
-  if (arr->buffer != NULL) {
-    // Move the values of previous buffer to new buffer
-    memmove_s(new_buffer, new_buffer_size, arr->buffer, arr->size * arr->item_size);
-    // Release the previous buffer
-    free(arr->buffer);
+  // Grow the buffer in place if possible, otherwise realloc moves the values of previous buffer by itself
+  void *new_buffer = realloc(arr->buffer, new_buffer_size);
+  METRICS_REALLOCATED();
+  if (new_buffer == NULL) {
+    METRICS_END();
+    return; // Keep the previous buffer untouched if there is no memory
   }
+  METRICS_ALLOCATED(new_buffer_size - old_buffer_size);
+  if (arr->buffer != NULL && new_buffer != arr->buffer)
+    METRICS_MOVED(old_buffer_size);
+  // Zeroify only the new part of buffer
+  memset((void *)((uintptr_t)new_buffer + old_buffer_size), 0, new_buffer_size - old_buffer_size);
   arr->buffer = new_buffer;
+  arr->capacity = amount;
+  METRICS_END();
+}
+
+void dynamic_array_grow(struct dynamic_array *arr, size_t amount) {
+  if (arr->capacity >= amount)
+    return; // The buffer capacity is already enough for this value
+  METRICS_BEGIN(dynamic_array_grow);
+
+  // Multiply the capacity by growth factor, so N inserts cost O(N) copies in total
+  size_t new_capacity = arr->capacity < DYNAMIC_ARRAY_MIN_CAPACITY ? DYNAMIC_ARRAY_MIN_CAPACITY : arr->capacity;
+  while (new_capacity < amount)
+    new_capacity *= DYNAMIC_ARRAY_GROWTH_FACTOR;
+  dynamic_array_reserve(arr, new_capacity);
+  METRICS_END();
+}
+
+void dynamic_array_shrink_to_fit(struct dynamic_array *arr) {
+  if (arr->capacity == arr->size)
+    return; // Nothing to release
+  METRICS_BEGIN(dynamic_array_shrink_to_fit);
+
+  if (arr->size == 0) {
+    // Release the whole buffer if there are no items
+    SAFE_FREE(arr->buffer);
+    SAFE_FREE(arr->tombstones);
+    SAFE_FREE(arr->item_slots);
+    arr->capacity = 0;
+    METRICS_END();
+    return;
+  }
+
+  if (arr->tombstones_enabled) {
+    uint8_t *tombstones = realloc(arr->tombstones, arr->size);
+    METRICS_REALLOCATED();
+    if (tombstones == NULL) {
+      METRICS_END();
+      return;
+    }
+    arr->tombstones = tombstones;
+  }
+  if (arr->handles_enabled) {
+    uint32_t *item_slots = realloc(arr->item_slots, arr->size * sizeof(*item_slots));
+    METRICS_REALLOCATED();
+    if (item_slots == NULL) {
+      METRICS_END();
+      return;
+    }
+    arr->item_slots = item_slots;
+  }
+
+  void *new_buffer = realloc(arr->buffer, arr->size * arr->item_size);
+  METRICS_REALLOCATED();
+  if (new_buffer == NULL) {
+    METRICS_END();
+    return; // Keep the previous buffer, it's still valid
+  }
+  if (new_buffer != arr->buffer)
+    METRICS_MOVED(arr->size * arr->item_size);
+  arr->buffer = new_buffer;
+  arr->capacity = arr->size;
+  METRICS_END();
+}
+
+static bool dynamic_array_attach_slot(struct dynamic_array *arr, size_t position) {
+  // Take the free slot or add the new one
+  size_t slot = arr->free_slot - 1;
+  if (arr->free_slot != 0) {
+    arr->free_slot = arr->slots[slot].position;
+  } else {
+    if (arr->slots_size == arr->slots_capacity) {
+      size_t capacity = arr->slots_capacity < DYNAMIC_ARRAY_MIN_CAPACITY ? DYNAMIC_ARRAY_MIN_CAPACITY
+                                                                          : arr->slots_capacity * DYNAMIC_ARRAY_GROWTH_FACTOR;
+      struct dynamic_array_slot *slots = realloc(arr->slots, capacity * sizeof(*slots));
+      METRICS_REALLOCATED();
+      if (slots == NULL) {
+        arr->item_slots[position] = UINT32_MAX; // The item has no handle
+        return false;
+      }
+      METRICS_ALLOCATED((capacity - arr->slots_capacity) * sizeof(*slots));
+      arr->slots = slots;
+      arr->slots_capacity = capacity;
+    }
+    slot = arr->slots_size++;
+    arr->slots[slot].generation = 1;
+  }
+  arr->slots[slot].position = position;
+  arr->item_slots[position] = (uint32_t)slot;
+  return true;
+}
+
+static void dynamic_array_release_slot(struct dynamic_array *arr, size_t position) {
+  uint32_t slot = arr->item_slots[position];
+  if (slot >= arr->slots_size)
+    return;
+  // Handles of the removed item don't match the slot anymore
+  if (++arr->slots[slot].generation == 0)
+    arr->slots[slot].generation = 1;
+  arr->slots[slot].position = arr->free_slot;
+  arr->free_slot = slot + 1;
+  // Dead item may still be moved, it must not touch the slot
+  arr->item_slots[position] = UINT32_MAX;
+}
+
+static void dynamic_array_update_slots(struct dynamic_array *arr, size_t position, size_t count) {
+  // Items were moved to the positions, let their slots know
+  for (size_t i = position; i < position + count; ++i) {
+    if (arr->item_slots[i] < arr->slots_size)
+      arr->slots[arr->item_slots[i]].position = i;
+  }
 }
 
 void *dynamic_array_insert(struct dynamic_array *arr, void *data, void *at) {
   if (arr->item_constructor == NULL)
     return NULL; // Constructor was provided as the dynamic array create argument before
+  METRICS_BEGIN(dynamic_array_insert);
 
   if (at == NULL) {
-    dynamic_array_reserve(arr, arr->size + 1);
-    at = (void *)(dynamic_array_last_intptr(arr) + arr->item_size); // after the last item
+    dynamic_array_grow(arr, arr->size + 1);
+    if (arr->capacity <= arr->size) {
+      METRICS_END();
+      return NULL; // Failed to grow the buffer
+    }
+    at = (void *)(dynamic_array_first_intptr(arr) + arr->size * arr->item_size); // after the last item
   }
 
   void *buffer_first = dynamic_array_first(arr);
   void *buffer_end = dynamic_array_end(arr);
 
-  if (!(at >= buffer_first && at <= buffer_end))
+  if (!(at >= buffer_first && at <= buffer_end)) {
+    METRICS_END();
     return NULL; // Do not create if position is out of bounds
+  }
 
-  arr->item_constructor(arr, at, data); // Call item constructor
+  void *item = arr->item_constructor(arr, at, data); // Call item constructor
+  if (item == NULL) {
+    METRICS_END();
+    return NULL; // Constructor failed and left the array as it was
+  }
   ++arr->size;
-  return at;
+  if (arr->tombstones_enabled) {
+    // Constructor could move items down, the flag of moved one is left in the slot of new item
+    arr->tombstones[((uintptr_t)item - dynamic_array_first_intptr(arr)) / arr->item_size] = 0;
+  }
+  if (arr->handles_enabled)
+    dynamic_array_attach_slot(arr, ((uintptr_t)item - dynamic_array_first_intptr(arr)) / arr->item_size);
+  if (arr->indexes != NULL)
+    index_registry_on_insert(arr->indexes, item);
+  METRICS_END();
+  return item;
+}
+
+size_t dynamic_array_append_raw(struct dynamic_array *arr, const void *items, size_t count) {
+  METRICS_BEGIN(dynamic_array_append_raw);
+  // Items are already constructed, so they are copied as is without item constructor
+  dynamic_array_grow(arr, arr->size + count);
+  if (arr->capacity < arr->size + count) {
+    METRICS_END();
+    return 0; // Failed to grow the buffer
+  }
+
+  memcpy((void *)(dynamic_array_first_intptr(arr) + arr->size * arr->item_size), items, count * arr->item_size);
+  if (arr->handles_enabled) {
+    for (size_t position = arr->size; position < arr->size + count; ++position)
+      dynamic_array_attach_slot(arr, position);
+  }
+  arr->size += count;
+  if (arr->indexes != NULL) {
+    for (size_t position = arr->size - count; position < arr->size; ++position)
+      index_registry_on_insert(arr->indexes, (void *)(dynamic_array_first_intptr(arr) + position * arr->item_size));
+  }
+  METRICS_END();
+  return count;
+}
+
+size_t dynamic_array_append_n(struct dynamic_array *arr, void *data, size_t data_size, size_t count) {
+  if (arr->item_constructor == NULL)
+    return 0; // Constructor was provided as the dynamic array create argument before
+  METRICS_BEGIN(dynamic_array_append_n);
+
+  // Reserve the space for all items at once
+  dynamic_array_reserve(arr, arr->size + count);
+  if (arr->capacity < arr->size + count) {
+    METRICS_END();
+    return 0; // Failed to reserve the buffer
+  }
+
+  size_t inserted = 0;
+  for (uintptr_t item_data = (uintptr_t)data; inserted < count; item_data += data_size, ++inserted) {
+    // Construct the item after the last one
+    void *at = (void *)(dynamic_array_first_intptr(arr) + arr->size * arr->item_size);
+    void *item = arr->item_constructor(arr, at, (void *)item_data);
+    if (item == NULL)
+      break; // Items constructed before stay in the array
+    ++arr->size;
+    if (arr->handles_enabled)
+      dynamic_array_attach_slot(arr, ((uintptr_t)item - dynamic_array_first_intptr(arr)) / arr->item_size);
+    if (arr->indexes != NULL)
+      index_registry_on_insert(arr->indexes, item);
+  }
+  METRICS_END();
+  return inserted;
 }
 
 bool dynamic_array_remove(struct dynamic_array *arr, void *at) {
@@ -81,10 +326,27 @@ bool dynamic_array_remove(struct dynamic_array *arr, void *at) {
   if (!(at >= buffer_first && at <= buffer_last))
     return false; // Do not remove if position is out of bounds
 
+  size_t position = ((uintptr_t)at - (uintptr_t)buffer_first) / arr->item_size;
+  if (dynamic_array_is_dead(arr, position))
+    return false; // Already removed
+  METRICS_BEGIN(dynamic_array_remove);
+
+  if (arr->indexes != NULL)
+    index_registry_on_remove(arr->indexes, at); // Indexes need the values of item, so before destructor
   if (arr->item_destructor != NULL)
     arr->item_destructor(arr, at); // Call destructor if was provided
+  if (arr->handles_enabled)
+    dynamic_array_release_slot(arr, position);
+  if (arr->tombstones_enabled) {
+    // Mark the slot instead of moving all of next items
+    arr->tombstones[position] = 1;
+    ++arr->dead_count;
+    METRICS_END();
+    return true;
+  }
   dynamic_array_move(arr, at, (void *)((uintptr_t)at + arr->item_size)); // Move items up
   --arr->size;
+  METRICS_END();
   return true;
 }
 
@@ -104,19 +366,172 @@ bool dynamic_array_move(struct dynamic_array *arr, void *dest, void *src) {
     return false; // Return false if source is out of bounds
   if (src_size <= 0)
     return true; // Nothing to copy, but it's ok
+  METRICS_BEGIN(dynamic_array_move);
 
   memmove_s(dest,
             dest_capacity,
             src,
             src_size);
+  METRICS_MOVED(src_size);
+  if (arr->tombstones_enabled) {
+    // Dead flags are moved together with items
+    memmove(arr->tombstones + (dest_int - buffer_first) / arr->item_size,
+            arr->tombstones + (src_int - buffer_first) / arr->item_size,
+            src_size / arr->item_size);
+  }
+  if (arr->handles_enabled) {
+    // Slots of items are moved too, then the slots get the new positions
+    size_t dest_position = (dest_int - buffer_first) / arr->item_size;
+    memmove(arr->item_slots + dest_position,
+            arr->item_slots + (src_int - buffer_first) / arr->item_size,
+            src_size / arr->item_size * sizeof(*arr->item_slots));
+    dynamic_array_update_slots(arr, dest_position, src_size / arr->item_size);
+  }
 
+  METRICS_END();
   return true;
 }
 
-void *dynamic_array_find(struct dynamic_array *arr, void *data) {
-  if (arr->item_finder == NULL)
+bool dynamic_array_enable_tombstones(struct dynamic_array *arr) {
+  if (arr->tombstones_enabled)
+    return true;
+  if (arr->capacity > 0) {
+    arr->tombstones = calloc(arr->capacity, sizeof(*arr->tombstones));
+    if (arr->tombstones == NULL)
+      return false;
+    METRICS_ALLOCATED(arr->capacity * sizeof(*arr->tombstones));
+  }
+  arr->tombstones_enabled = true;
+  return true;
+}
+
+bool dynamic_array_is_dead(struct dynamic_array *arr, size_t position) {
+  return arr->dead_count > 0 && arr->tombstones[position] != 0;
+}
+
+bool dynamic_array_needs_compaction(struct dynamic_array *arr) {
+  return arr->dead_count * 100 > arr->size * DYNAMIC_ARRAY_MAX_DEAD_PERCENT;
+}
+
+void dynamic_array_compact(struct dynamic_array *arr) {
+  if (arr->dead_count == 0)
+    return;
+  METRICS_BEGIN(dynamic_array_compact);
+  // Each live item is moved once, so compaction is linear however many items were removed
+  size_t live_size = 0;
+  for (size_t i = 0; i < arr->size; ++i) {
+    if (arr->tombstones[i] != 0)
+      continue;
+    if (live_size != i) {
+      memcpy((void *)(dynamic_array_first_intptr(arr) + live_size * arr->item_size),
+             (void *)(dynamic_array_first_intptr(arr) + i * arr->item_size),
+             arr->item_size);
+      METRICS_MOVED(arr->item_size);
+      if (arr->handles_enabled) {
+        arr->item_slots[live_size] = arr->item_slots[i];
+        dynamic_array_update_slots(arr, live_size, 1);
+      }
+    }
+    ++live_size;
+  }
+  memset(arr->tombstones, 0, arr->size);
+  arr->size = live_size;
+  arr->dead_count = 0;
+  METRICS_END();
+}
+
+bool dynamic_array_enable_handles(struct dynamic_array *arr) {
+  if (arr->handles_enabled)
+    return true;
+  METRICS_BEGIN(dynamic_array_enable_handles);
+  if (arr->capacity > 0) {
+    arr->item_slots = malloc(arr->capacity * sizeof(*arr->item_slots));
+    if (arr->item_slots == NULL) {
+      METRICS_END();
+      return false;
+    }
+    METRICS_ALLOCATED(arr->capacity * sizeof(*arr->item_slots));
+  }
+  arr->handles_enabled = true;
+  // Items which are already in the array get their slots too
+  for (size_t position = 0; position < arr->size; ++position) {
+    if (dynamic_array_is_dead(arr, position))
+      arr->item_slots[position] = UINT32_MAX;
+    else
+      dynamic_array_attach_slot(arr, position);
+  }
+  METRICS_END();
+  return true;
+}
+
+struct dynamic_array_handle dynamic_array_handle_of(struct dynamic_array *arr, const void *item) {
+  struct dynamic_array_handle handle = {0, 0};
+  if (!arr->handles_enabled || item == NULL)
+    return handle;
+  size_t position = ((uintptr_t)item - dynamic_array_first_intptr(arr)) / arr->item_size;
+  if (position >= arr->size || dynamic_array_is_dead(arr, position) || arr->item_slots[position] >= arr->slots_size)
+    return handle;
+  handle.slot = arr->item_slots[position];
+  handle.generation = arr->slots[handle.slot].generation;
+  return handle;
+}
+
+void *dynamic_array_resolve(struct dynamic_array *arr, struct dynamic_array_handle handle) {
+  // Slot of removed item has another generation
+  if (handle.slot >= arr->slots_size || arr->slots[handle.slot].generation != handle.generation)
     return NULL;
-  return arr->item_finder(arr, data);
+  return (void *)(dynamic_array_first_intptr(arr) + arr->slots[handle.slot].position * arr->item_size);
+}
+
+bool dynamic_array_handle_is_null(struct dynamic_array_handle handle) {
+  return handle.generation == 0;
+}
+
+bool dynamic_array_handle_equals(struct dynamic_array_handle left, struct dynamic_array_handle right) {
+  return left.slot == right.slot && left.generation == right.generation;
+}
+
+bool dynamic_array_add_index(struct dynamic_array *arr, struct table_index *index) {
+  if (!dynamic_array_enable_handles(arr))
+    return false;
+  METRICS_BEGIN(dynamic_array_add_index);
+  if (arr->indexes == NULL)
+    arr->indexes = index_registry_create(NULL);
+  bool added = arr->indexes != NULL && index_registry_add(arr->indexes, index);
+  METRICS_END();
+  return added;
+}
+
+void dynamic_array_set_primary_index(struct dynamic_array *arr, struct table_index *index) {
+  arr->primary_index = index;
+}
+
+void dynamic_array_update_begin(struct dynamic_array *arr, void *item, uint32_t fields) {
+  METRICS_BEGIN(dynamic_array_update_begin);
+  if (arr->indexes != NULL)
+    index_registry_update_begin(arr->indexes, item, fields);
+  METRICS_END();
+}
+
+void dynamic_array_update_end(struct dynamic_array *arr, void *item, uint32_t fields) {
+  METRICS_BEGIN(dynamic_array_update_end);
+  if (arr->indexes != NULL)
+    index_registry_update_end(arr->indexes, item, fields);
+  METRICS_END();
+}
+
+void *dynamic_array_find(struct dynamic_array *arr, void *data) {
+  METRICS_BEGIN(dynamic_array_find);
+  void *found;
+  if (arr->item_finder == NULL) {
+    // Only the unique index finds the item by key, a non-unique one would give any of matching items
+    struct table_index *index = arr->primary_index;
+    found = index == NULL ? NULL : index->ops->find(index, data);
+  } else {
+    found = arr->item_finder(arr, data);
+  }
+  METRICS_END();
+  return found;
 }
 
 void *dynamic_array_get_at(struct dynamic_array *arr, size_t position) {
@@ -155,11 +570,34 @@ uintptr_t dynamic_array_end_intptr(struct dynamic_array *arr) {
   return (uintptr_t)dynamic_array_end(arr);
 }
 
+void dynamic_array_lock_shared(struct dynamic_array *arr) {
+  AcquireSRWLockShared((PSRWLOCK)&arr->lock);
+}
+
+void dynamic_array_unlock_shared(struct dynamic_array *arr) {
+  ReleaseSRWLockShared((PSRWLOCK)&arr->lock);
+}
+
+void dynamic_array_lock_exclusive(struct dynamic_array *arr) {
+  AcquireSRWLockExclusive((PSRWLOCK)&arr->lock);
+}
+
+void dynamic_array_unlock_exclusive(struct dynamic_array *arr) {
+  // Stashed entries would be merged by the first search otherwise, and readers search at the same time
+  index_registry_flush(arr->indexes);
+  ReleaseSRWLockExclusive((PSRWLOCK)&arr->lock);
+}
+
 size_t dynamic_array_size(struct dynamic_array *arr) {
   // Amount of items in buffer
   return arr->size;
 }
 
+size_t dynamic_array_live_size(struct dynamic_array *arr) {
+  // Amount of items which are not removed
+  return arr->size - arr->dead_count;
+}
+
 size_t dynamic_array_capacity(struct dynamic_array *arr) {
   // The reserved capacity of buffer
   return arr->capacity;
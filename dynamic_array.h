@@ -1,14 +1,47 @@
 #pragma once
 
 #include <memory.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdbool.h>
 
+#include "metrics.h"
 #include "common.h"
 
+#ifndef DYNAMIC_ARRAY_MIN_CAPACITY
+#define DYNAMIC_ARRAY_MIN_CAPACITY 8
+#endif
+
+#ifndef DYNAMIC_ARRAY_GROWTH_FACTOR
+#define DYNAMIC_ARRAY_GROWTH_FACTOR 2
+#endif
+
+// Dead items may take up to this percent of slots before the array should be compacted
+#ifndef DYNAMIC_ARRAY_MAX_DEAD_PERCENT
+#define DYNAMIC_ARRAY_MAX_DEAD_PERCENT 25
+#endif
+
 struct dynamic_array;
+struct index_registry;
+struct table_index;
 
-typedef void (*dynamic_array_item_constructor)(struct dynamic_array *arr, void *item, void *data);
+/* Stable reference to an item, stays valid while the item is moved or the buffer is reallocated.
+ * Slot keeps the current position of item, generation of slot changes when the item is removed,
+ * so the handle of removed item resolves to NULL even if the slot is reused.
+ */
+struct dynamic_array_handle {
+  uint32_t slot;
+  uint32_t generation; // Zero is never used by slots, so zeroed handle is the null one
+};
+
+struct dynamic_array_slot {
+  size_t position; // Position of item, or next free slot + 1 if the slot is free
+  uint32_t generation;
+};
+
+// Constructor gets the reserved space after the last item and returns the position where the item was constructed,
+// or NULL without changing the array if the item can't be made
+typedef void *(*dynamic_array_item_constructor)(struct dynamic_array *arr, void *item, void *data);
 typedef void (*dynamic_array_item_destructor)(struct dynamic_array *arr, void *item);
 typedef void **(*dynamic_array_item_finder)(struct dynamic_array *arr, void *data);
 
@@ -20,6 +53,21 @@ struct dynamic_array {
   dynamic_array_item_constructor item_constructor;
   dynamic_array_item_destructor item_destructor;
   dynamic_array_item_finder item_finder;
+  // In tombstone mode removed items are only marked dead and stay in their slots until the compaction,
+  // size counts the slots of dead items too
+  bool tombstones_enabled;
+  uint8_t *tombstones; // Dead flag of each slot
+  size_t dead_count;
+  // Handles mode keeps a slot for each item, slot of the item at each position is in item_slots
+  bool handles_enabled;
+  struct dynamic_array_slot *slots;
+  size_t slots_size;
+  size_t slots_capacity;
+  size_t free_slot; // First free slot + 1, zero if there are no free slots
+  uint32_t *item_slots;
+  struct index_registry *indexes; // Secondary indexes notified about inserted, removed and updated items
+  struct table_index *primary_index; // Unique index searched by dynamic_array_find, NULL if the table has none
+  void *lock; // SRWLOCK of the table, windows.h stays out of the header. See dynamic_array_lock_shared
   bool self_created;
 };
 
@@ -31,11 +79,37 @@ struct dynamic_array *dynamic_array_create(struct dynamic_array *at,
 void dynamic_array_destroy(struct dynamic_array *arr);
 
 void dynamic_array_reserve(struct dynamic_array *arr, size_t amount);
+void dynamic_array_grow(struct dynamic_array *arr, size_t amount);
+void dynamic_array_shrink_to_fit(struct dynamic_array *arr);
 
 void *dynamic_array_insert(struct dynamic_array *arr, void *data, void *at);
+size_t dynamic_array_append_raw(struct dynamic_array *arr, const void *items, size_t count);
+size_t dynamic_array_append_n(struct dynamic_array *arr, void *data, size_t data_size, size_t count);
 bool dynamic_array_remove(struct dynamic_array *arr, void *at);
 bool dynamic_array_move(struct dynamic_array *arr, void *dest, void *src);
 
+bool dynamic_array_enable_tombstones(struct dynamic_array *arr);
+bool dynamic_array_is_dead(struct dynamic_array *arr, size_t position);
+bool dynamic_array_needs_compaction(struct dynamic_array *arr);
+// Moves live items over the dead ones, positions of items change
+void dynamic_array_compact(struct dynamic_array *arr);
+
+bool dynamic_array_enable_handles(struct dynamic_array *arr);
+struct dynamic_array_handle dynamic_array_handle_of(struct dynamic_array *arr, const void *item);
+// Returns NULL if the item was removed
+void *dynamic_array_resolve(struct dynamic_array *arr, struct dynamic_array_handle handle);
+bool dynamic_array_handle_is_null(struct dynamic_array_handle handle);
+bool dynamic_array_handle_equals(struct dynamic_array_handle left, struct dynamic_array_handle right);
+
+// Index is kept up to date by the array, it uses handles of items
+bool dynamic_array_add_index(struct dynamic_array *arr, struct table_index *index);
+// Index must be unique and already added, dynamic_array_find looks up its keys
+void dynamic_array_set_primary_index(struct dynamic_array *arr, struct table_index *index);
+// Must wrap the changes of item fields, fields is the bit mask of changed ones
+void dynamic_array_update_begin(struct dynamic_array *arr, void *item, uint32_t fields);
+void dynamic_array_update_end(struct dynamic_array *arr, void *item, uint32_t fields);
+
+// Uses the item finder, or the primary index with data as its key
 void *dynamic_array_find(struct dynamic_array *arr, void *data);
 void *dynamic_array_get_at(struct dynamic_array *arr, size_t position);
 
@@ -47,5 +121,16 @@ uintptr_t dynamic_array_first_intptr(struct dynamic_array *arr);
 uintptr_t dynamic_array_last_intptr(struct dynamic_array *arr);
 uintptr_t dynamic_array_end_intptr(struct dynamic_array *arr);
 
+/* Readers share the table and the writer has it alone, arrays themselves don't take the lock.
+ * Pointers to items and iterators stay valid only while the lock is held, any change may move or free them.
+ * Indexes finish their deferred work on exclusive unlock, so searches under the shared lock change nothing.
+ * Locks are not recursive and the shared one can't be upgraded.
+ */
+void dynamic_array_lock_shared(struct dynamic_array *arr);
+void dynamic_array_unlock_shared(struct dynamic_array *arr);
+void dynamic_array_lock_exclusive(struct dynamic_array *arr);
+void dynamic_array_unlock_exclusive(struct dynamic_array *arr);
+
 size_t dynamic_array_size(struct dynamic_array *arr);
+size_t dynamic_array_live_size(struct dynamic_array *arr);
 size_t dynamic_array_capacity(struct dynamic_array *arr);
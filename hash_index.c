@@ -0,0 +1,245 @@
+#include "hash_index.h"
+
+static bool hash_index_ops_insert(struct table_index *index, void *item) {
+  return hash_index_insert((struct hash_index *)index, item);
+}
+
+static bool hash_index_ops_remove(struct table_index *index, void *item) {
+  return hash_index_remove((struct hash_index *)index, item);
+}
+
+static void *hash_index_ops_find(struct table_index *index, const void *key) {
+  return hash_index_find((struct hash_index *)index, (const char *)key);
+}
+
+static size_t hash_index_ops_find_all(struct table_index *index,
+                                      const void *key,
+                                      table_index_callback callback,
+                                      void *context) {
+  return hash_index_find_all((struct hash_index *)index, (const char *)key, callback, context);
+}
+
+static void hash_index_ops_rebuild(struct table_index *index) {
+  hash_index_rebuild((struct hash_index *)index);
+}
+
+static const struct table_index_ops hash_index_ops = {
+    hash_index_ops_insert,
+    hash_index_ops_remove,
+    hash_index_ops_find,
+    hash_index_ops_find_all,
+    hash_index_ops_rebuild,
+    NULL,
+};
+
+struct hash_index *hash_index_create(struct hash_index *at,
+                                     struct dynamic_array *arr,
+                                     hash_index_key_getter key_getter,
+                                     uint32_t fields,
+                                     bool unique) {
+  // Allocating a buffer for structure or use existing if index was provided as the first argument
+  struct hash_index *index = at == NULL ? malloc(sizeof(*index)) : at;
+  index->base.ops = &hash_index_ops;
+  index->base.arr = arr;
+  index->base.fields = fields;
+  index->slots = NULL;
+  index->capacity = 0;
+  index->size = 0;
+  index->items_size = 0;
+  index->key_getter = key_getter;
+  index->unique = unique;
+  index->self_created = index != at;
+  return index;
+}
+
+static void hash_index_clear(struct hash_index *index) {
+  for (size_t slot = 0; slot < index->capacity; ++slot) {
+    SAFE_FREE(index->slots[slot].rest);
+  }
+  SAFE_FREE(index->slots);
+  index->capacity = 0;
+  index->size = 0;
+  index->items_size = 0;
+}
+
+void hash_index_destroy(struct hash_index *index) {
+  if (index == NULL)
+    return;
+  hash_index_clear(index);
+  if (index->self_created)
+    free(index);
+}
+
+uint64_t hash_string(const char *str) {
+  // FNV-1a
+  uint64_t hash = 14695981039346656037ULL;
+  for (const unsigned char *c = (const unsigned char *)str; *c != '\0'; ++c) {
+    hash ^= *c;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+static const char *hash_index_entry_key(struct hash_index *index, struct hash_index_entry *entry) {
+  // Each item of entry has the same key, so the first one is asked
+  return index->key_getter(dynamic_array_resolve(index->base.arr, entry->first));
+}
+
+static struct hash_index_entry *hash_index_lookup(struct hash_index *index, const char *key, uint64_t hash) {
+  // Entry of the key or the empty slot where it should be placed
+  size_t mask = index->capacity - 1;
+  for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+    struct hash_index_entry *entry = index->slots + slot;
+    if (dynamic_array_handle_is_null(entry->first))
+      return entry;
+    if (entry->hash == hash && strcmp(hash_index_entry_key(index, entry), key) == 0)
+      return entry;
+  }
+}
+
+static bool hash_index_resize(struct hash_index *index, size_t capacity) {
+  struct hash_index_entry *slots = calloc(capacity, sizeof(*slots));
+  if (slots == NULL)
+    return false; // Old slots stay as they were
+  struct hash_index_entry *old_slots = index->slots;
+  size_t old_capacity = index->capacity;
+
+  index->slots = slots;
+  index->capacity = capacity;
+  // Entries are moved as is, keys are distinct already
+  for (size_t slot = 0; slot < old_capacity; ++slot) {
+    if (dynamic_array_handle_is_null(old_slots[slot].first))
+      continue;
+    size_t mask = capacity - 1;
+    size_t new_slot = old_slots[slot].hash & mask;
+    while (!dynamic_array_handle_is_null(index->slots[new_slot].first))
+      new_slot = (new_slot + 1) & mask;
+    index->slots[new_slot] = old_slots[slot];
+  }
+  SAFE_FREE(old_slots);
+  return true;
+}
+
+bool hash_index_insert(struct hash_index *index, void *item) {
+  struct dynamic_array_handle handle = dynamic_array_handle_of(index->base.arr, item);
+  if (dynamic_array_handle_is_null(handle))
+    return false;
+  // Keep the load factor not more than 1/2
+  if ((index->size + 1) * 2 > index->capacity) {
+    size_t capacity = index->capacity < HASH_INDEX_MIN_CAPACITY ? HASH_INDEX_MIN_CAPACITY : index->capacity * 2;
+    if (!hash_index_resize(index, capacity))
+      return false;
+  }
+
+  const char *key = index->key_getter(item);
+  uint64_t hash = hash_string(key);
+  struct hash_index_entry *entry = hash_index_lookup(index, key, hash);
+  if (dynamic_array_handle_is_null(entry->first)) {
+    // The first item with this key
+    entry->hash = hash;
+    entry->first = handle;
+    ++index->size;
+    ++index->items_size;
+    return true;
+  }
+  if (index->unique)
+    return false;
+
+  if (entry->rest_size == entry->rest_capacity) {
+    size_t capacity = entry->rest_capacity == 0 ? 4 : entry->rest_capacity * 2;
+    struct dynamic_array_handle *rest = realloc(entry->rest, capacity * sizeof(*rest));
+    if (rest == NULL)
+      return false;
+    entry->rest = rest;
+    entry->rest_capacity = capacity;
+  }
+  entry->rest[entry->rest_size++] = handle;
+  ++index->items_size;
+  return true;
+}
+
+bool hash_index_remove(struct hash_index *index, void *item) {
+  // Must be called before the item gets removed from dynamic array
+  if (item == NULL || index->size == 0)
+    return false;
+
+  struct dynamic_array_handle handle = dynamic_array_handle_of(index->base.arr, item);
+  const char *key = index->key_getter(item);
+  struct hash_index_entry *entry = hash_index_lookup(index, key, hash_string(key));
+  if (dynamic_array_handle_is_null(entry->first))
+    return false; // The key was not indexed
+
+  if (!dynamic_array_handle_equals(entry->first, handle)) {
+    // Take the item from the rest, order of items is not kept
+    for (size_t i = 0; i < entry->rest_size; ++i) {
+      if (dynamic_array_handle_equals(entry->rest[i], handle)) {
+        entry->rest[i] = entry->rest[--entry->rest_size];
+        --index->items_size;
+        return true;
+      }
+    }
+    return false; // The item was not indexed
+  }
+  --index->items_size;
+  if (entry->rest_size > 0) {
+    // Another item of the key takes the first place
+    entry->first = entry->rest[--entry->rest_size];
+    return true;
+  }
+
+  // Backward shift deletion, so probe sequences never break and there are no tombstones
+  SAFE_FREE(entry->rest);
+  size_t mask = index->capacity - 1;
+  size_t hole = (size_t)(entry - index->slots);
+  for (size_t next = (hole + 1) & mask; !dynamic_array_handle_is_null(index->slots[next].first);
+       next = (next + 1) & mask) {
+    size_t home = index->slots[next].hash & mask;
+    // Move the entry to the hole if its home slot is not between the hole and the entry
+    if (((next - home) & mask) >= ((next - hole) & mask)) {
+      index->slots[hole] = index->slots[next];
+      hole = next;
+    }
+  }
+  memset(index->slots + hole, 0, sizeof(*index->slots));
+  --index->size;
+  return true;
+}
+
+void *hash_index_find(struct hash_index *index, const char *key) {
+  if (key == NULL || index->size == 0)
+    return NULL;
+  struct hash_index_entry *entry = hash_index_lookup(index, key, hash_string(key));
+  return dynamic_array_resolve(index->base.arr, entry->first);
+}
+
+size_t hash_index_find_all(struct hash_index *index, const char *key, table_index_callback callback, void *context) {
+  if (key == NULL || index->size == 0)
+    return 0;
+  struct hash_index_entry *entry = hash_index_lookup(index, key, hash_string(key));
+  if (dynamic_array_handle_is_null(entry->first))
+    return 0;
+  size_t count = 1;
+  if (callback != NULL && !callback(dynamic_array_resolve(index->base.arr, entry->first), context))
+    return count; // Callback asked to stop
+  for (size_t i = 0; i < entry->rest_size; ++i) {
+    ++count;
+    if (callback != NULL && !callback(dynamic_array_resolve(index->base.arr, entry->rest[i]), context))
+      break;
+  }
+  return count;
+}
+
+void hash_index_rebuild(struct hash_index *index) {
+  // Drop all of the entries and index each item of dynamic array again
+  hash_index_clear(index);
+  size_t size = dynamic_array_size(index->base.arr);
+  for (size_t position = 0; position < size; ++position) {
+    if (!dynamic_array_is_dead(index->base.arr, position))
+      hash_index_insert(index, dynamic_array_get_at(index->base.arr, position));
+  }
+}
+
+size_t hash_index_size(struct hash_index *index) {
+  // Amount of indexed items
+  return index->items_size;
+}
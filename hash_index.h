@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "dynamic_array.h"
+#include "index_registry.h"
+#include "common.h"
+
+#ifndef HASH_INDEX_MIN_CAPACITY
+#define HASH_INDEX_MIN_CAPACITY 16
+#endif
+
+typedef const char *(*hash_index_key_getter)(void *item);
+
+// Entry of each distinct key, the first item is kept inline because most of keys have only one
+struct hash_index_entry {
+  uint64_t hash;
+  struct dynamic_array_handle first; // Null handle means an empty slot
+  struct dynamic_array_handle *rest; // The rest of items with the same key
+  size_t rest_size;
+  size_t rest_capacity;
+};
+
+/* Open addressing (linear probing) index by string key over the items of dynamic array.
+ * Entries keep handles of items instead of pointers, so the index stays valid when items are moved.
+ * Unique index refuses the second item with the same key, otherwise all of them are kept under the key.
+ */
+struct hash_index {
+  struct table_index base; // Must be the first, registry passes the index by base pointer
+  struct hash_index_entry *slots;
+  size_t capacity;
+  size_t size; // Amount of distinct keys
+  size_t items_size; // Amount of indexed items
+  hash_index_key_getter key_getter;
+  bool unique;
+  bool self_created;
+};
+
+struct hash_index *hash_index_create(struct hash_index *at,
+                                     struct dynamic_array *arr,
+                                     hash_index_key_getter key_getter,
+                                     uint32_t fields,
+                                     bool unique);
+void hash_index_destroy(struct hash_index *index);
+
+bool hash_index_insert(struct hash_index *index, void *item);
+bool hash_index_remove(struct hash_index *index, void *item);
+void *hash_index_find(struct hash_index *index, const char *key);
+size_t hash_index_find_all(struct hash_index *index, const char *key, table_index_callback callback, void *context);
+void hash_index_rebuild(struct hash_index *index);
+
+size_t hash_index_size(struct hash_index *index);
+
+uint64_t hash_string(const char *str);
@@ -0,0 +1,88 @@
+#include "index_registry.h"
+
+struct index_registry *index_registry_create(struct index_registry *at) {
+  // Allocating a buffer for structure or use existing if registry was provided as the first argument
+  struct index_registry *registry = at == NULL ? malloc(sizeof(*registry)) : at;
+  registry->indexes = NULL;
+  registry->size = 0;
+  registry->capacity = 0;
+  registry->self_created = registry != at;
+  return registry;
+}
+
+void index_registry_destroy(struct index_registry *registry) {
+  if (registry == NULL)
+    return;
+  SAFE_FREE(registry->indexes);
+  registry->size = 0;
+  registry->capacity = 0;
+  if (registry->self_created)
+    free(registry);
+}
+
+bool index_registry_add(struct index_registry *registry, struct table_index *index) {
+  if (registry->size == registry->capacity) {
+    size_t capacity = registry->capacity < INDEX_REGISTRY_MIN_CAPACITY ? INDEX_REGISTRY_MIN_CAPACITY
+                                                                       : registry->capacity * 2;
+    struct table_index **indexes = realloc(registry->indexes, capacity * sizeof(*indexes));
+    if (indexes == NULL)
+      return false;
+    registry->indexes = indexes;
+    registry->capacity = capacity;
+  }
+  registry->indexes[registry->size++] = index;
+  // Index the items which are already in the array
+  index->ops->rebuild(index);
+  return true;
+}
+
+void index_registry_on_insert(struct index_registry *registry, void *item) {
+  for (size_t i = 0; i < registry->size; ++i) {
+    registry->indexes[i]->ops->insert(registry->indexes[i], item);
+  }
+}
+
+void index_registry_on_remove(struct index_registry *registry, void *item) {
+  for (size_t i = 0; i < registry->size; ++i) {
+    registry->indexes[i]->ops->remove(registry->indexes[i], item);
+  }
+}
+
+void index_registry_update_begin(struct index_registry *registry, void *item, uint32_t fields) {
+  for (size_t i = 0; i < registry->size; ++i) {
+    if ((registry->indexes[i]->fields & fields) != 0)
+      registry->indexes[i]->ops->remove(registry->indexes[i], item);
+  }
+}
+
+void index_registry_update_end(struct index_registry *registry, void *item, uint32_t fields) {
+  for (size_t i = 0; i < registry->size; ++i) {
+    if ((registry->indexes[i]->fields & fields) != 0)
+      registry->indexes[i]->ops->insert(registry->indexes[i], item);
+  }
+}
+
+void index_registry_rebuild(struct index_registry *registry) {
+  for (size_t i = 0; i < registry->size; ++i) {
+    registry->indexes[i]->ops->rebuild(registry->indexes[i]);
+  }
+}
+
+void index_registry_flush(struct index_registry *registry) {
+  if (registry == NULL)
+    return;
+  for (size_t i = 0; i < registry->size; ++i) {
+    if (registry->indexes[i]->ops->flush != NULL)
+      registry->indexes[i]->ops->flush(registry->indexes[i]);
+  }
+}
+
+size_t index_registry_size(struct index_registry *registry) {
+  return registry == NULL ? 0 : registry->size;
+}
+
+struct table_index *index_registry_get_at(struct index_registry *registry, size_t position) {
+  if (registry == NULL || position >= registry->size)
+    return NULL;
+  return registry->indexes[position];
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "dynamic_array.h"
+#include "common.h"
+
+#ifndef INDEX_REGISTRY_MIN_CAPACITY
+#define INDEX_REGISTRY_MIN_CAPACITY 4
+#endif
+
+// Key of index is made of all item fields
+#define TABLE_INDEX_ALL_FIELDS UINT32_MAX
+
+struct table_index;
+
+// Gets called for each item found, returns false to stop the iteration
+typedef bool (*table_index_callback)(void *item, void *context);
+
+struct table_index_ops {
+  bool (*insert)(struct table_index *index, void *item);
+  // Gets called while the item is still in the array and has the indexed values
+  bool (*remove)(struct table_index *index, void *item);
+  void *(*find)(struct table_index *index, const void *key);
+  size_t (*find_all)(struct table_index *index, const void *key, table_index_callback callback, void *context);
+  void (*rebuild)(struct table_index *index);
+  // Does the work deferred by changes, so the next searches only read the index. May be NULL
+  void (*flush)(struct table_index *index);
+};
+
+/* Base of each index, must be the first member of index structure.
+ * Indexes keep handles of items, so moves of items don't touch them.
+ */
+struct table_index {
+  const struct table_index_ops *ops;
+  struct dynamic_array *arr;
+  uint32_t fields; // Bit mask of item fields which make the key, changes of other fields are not passed to index
+};
+
+/* All indexes of dynamic array, it notifies them about inserted, removed and updated items.
+ * Registry doesn't own the indexes, they are destroyed by the table.
+ */
+struct index_registry {
+  struct table_index **indexes;
+  size_t size;
+  size_t capacity;
+  bool self_created;
+};
+
+struct index_registry *index_registry_create(struct index_registry *at);
+void index_registry_destroy(struct index_registry *registry);
+
+bool index_registry_add(struct index_registry *registry, struct table_index *index);
+void index_registry_on_insert(struct index_registry *registry, void *item);
+void index_registry_on_remove(struct index_registry *registry, void *item);
+// Item leaves indexes by the fields before they are changed and comes back after that
+void index_registry_update_begin(struct index_registry *registry, void *item, uint32_t fields);
+void index_registry_update_end(struct index_registry *registry, void *item, uint32_t fields);
+void index_registry_rebuild(struct index_registry *registry);
+void index_registry_flush(struct index_registry *registry);
+
+size_t index_registry_size(struct index_registry *registry);
+struct table_index *index_registry_get_at(struct index_registry *registry, size_t position);
@@ -0,0 +1,229 @@
+#include "inverted_index.h"
+
+static bool inverted_index_ops_insert(struct table_index *index, void *item) {
+  return inverted_index_insert((struct inverted_index *)index, item);
+}
+
+static bool inverted_index_ops_remove(struct table_index *index, void *item) {
+  return inverted_index_remove((struct inverted_index *)index, item);
+}
+
+static void *inverted_index_ops_find(struct table_index *index, const void *key) {
+  return inverted_index_find((struct inverted_index *)index, (const char *)key);
+}
+
+static size_t inverted_index_ops_find_all(struct table_index *index,
+                                          const void *key,
+                                          table_index_callback callback,
+                                          void *context) {
+  return inverted_index_find_all((struct inverted_index *)index, (const char *)key, callback, context);
+}
+
+static void inverted_index_ops_rebuild(struct table_index *index) {
+  inverted_index_rebuild((struct inverted_index *)index);
+}
+
+static const struct table_index_ops inverted_index_ops = {
+    inverted_index_ops_insert,
+    inverted_index_ops_remove,
+    inverted_index_ops_find,
+    inverted_index_ops_find_all,
+    inverted_index_ops_rebuild,
+    NULL,
+};
+
+struct inverted_index *inverted_index_create(struct inverted_index *at,
+                                             struct dynamic_array *arr,
+                                             const inverted_index_key_getter *key_getters,
+                                             size_t key_getters_size,
+                                             uint32_t fields) {
+  // Allocating a buffer for structure or use existing if index was provided as the first argument
+  struct inverted_index *index = at == NULL ? malloc(sizeof(*index)) : at;
+  index->base.ops = &inverted_index_ops;
+  index->base.arr = arr;
+  index->base.fields = fields;
+  index->slots = NULL;
+  index->capacity = 0;
+  index->size = 0;
+  string_arena_create(&index->words);
+  index->key_getters = key_getters;
+  index->key_getters_size = key_getters_size;
+  index->self_created = index != at;
+  return index;
+}
+
+static void inverted_index_clear(struct inverted_index *index) {
+  for (size_t slot = 0; slot < index->capacity; ++slot) {
+    posting_list_clear(&index->slots[slot].postings);
+  }
+  SAFE_FREE(index->slots);
+  index->capacity = 0;
+  index->size = 0;
+  // Words are freed by the chunks
+  string_arena_destroy(&index->words);
+  string_arena_create(&index->words);
+}
+
+void inverted_index_destroy(struct inverted_index *index) {
+  if (index == NULL)
+    return;
+  inverted_index_clear(index);
+  string_arena_destroy(&index->words);
+  if (index->self_created)
+    free(index);
+}
+
+static struct inverted_index_word *inverted_index_lookup(struct inverted_index *index, const char *word, uint64_t hash) {
+  // Entry of the word or the empty slot where it should be placed
+  size_t mask = index->capacity - 1;
+  for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+    struct inverted_index_word *entry = index->slots + slot;
+    if (entry->word == NULL || (entry->hash == hash && strcmp(entry->word, word) == 0))
+      return entry;
+  }
+}
+
+static void inverted_index_resize(struct inverted_index *index, size_t capacity) {
+  struct inverted_index_word *old_slots = index->slots;
+  size_t old_capacity = index->capacity;
+
+  index->slots = calloc(capacity, sizeof(*index->slots));
+  index->capacity = capacity;
+  // Entries are moved as is, words are distinct already
+  for (size_t slot = 0; slot < old_capacity; ++slot) {
+    if (old_slots[slot].word == NULL)
+      continue;
+    size_t mask = capacity - 1;
+    size_t new_slot = old_slots[slot].hash & mask;
+    while (index->slots[new_slot].word != NULL)
+      new_slot = (new_slot + 1) & mask;
+    index->slots[new_slot] = old_slots[slot];
+  }
+  SAFE_FREE(old_slots);
+}
+
+static struct inverted_index_word *inverted_index_find_word(struct inverted_index *index, const char *word) {
+  if (index->size == 0)
+    return NULL;
+  struct inverted_index_word *entry = inverted_index_lookup(index, word, hash_string(word));
+  return entry->word == NULL ? NULL : entry;
+}
+
+static struct inverted_index_word *inverted_index_add_word(struct inverted_index *index, const char *word) {
+  // Keep the load factor not more than 1/2
+  if ((index->size + 1) * 2 > index->capacity) {
+    size_t capacity = index->capacity < INVERTED_INDEX_MIN_CAPACITY ? INVERTED_INDEX_MIN_CAPACITY : index->capacity * 2;
+    inverted_index_resize(index, capacity);
+  }
+  uint64_t hash = hash_string(word);
+  struct inverted_index_word *entry = inverted_index_lookup(index, word, hash);
+  if (entry->word != NULL)
+    return entry;
+  // Words are never removed, even when they have no postings left, vocabulary of table stays about the same
+  entry->word = string_arena_copy(&index->words, word);
+  if (entry->word == NULL)
+    return NULL;
+  entry->hash = hash;
+  ++index->size;
+  return entry;
+}
+
+static bool inverted_index_add_item(struct inverted_index *index, void *item, bool append) {
+  struct dynamic_array_handle handle = dynamic_array_handle_of(index->base.arr, item);
+  if (dynamic_array_handle_is_null(handle))
+    return false;
+  bool added = true;
+  char token[TEXT_MAX_TOKEN];
+  for (size_t i = 0; i < index->key_getters_size; ++i) {
+    const char *cursor = index->key_getters[i](item);
+    if (cursor == NULL)
+      continue;
+    while (text_next_token(&cursor, token)) {
+      struct inverted_index_word *entry = inverted_index_add_word(index, token);
+      if (entry == NULL || !posting_list_add(&entry->postings, handle, append))
+        added = false;
+    }
+  }
+  return added;
+}
+
+bool inverted_index_insert(struct inverted_index *index, void *item) {
+  return inverted_index_add_item(index, item, false);
+}
+
+bool inverted_index_remove(struct inverted_index *index, void *item) {
+  struct dynamic_array_handle handle = dynamic_array_handle_of(index->base.arr, item);
+  if (dynamic_array_handle_is_null(handle))
+    return false;
+  char token[TEXT_MAX_TOKEN];
+  for (size_t i = 0; i < index->key_getters_size; ++i) {
+    const char *cursor = index->key_getters[i](item);
+    if (cursor == NULL)
+      continue;
+    while (text_next_token(&cursor, token)) {
+      struct inverted_index_word *entry = inverted_index_find_word(index, token);
+      if (entry != NULL)
+        posting_list_remove(&entry->postings, handle);
+    }
+  }
+  return true;
+}
+
+size_t inverted_index_find_all(struct inverted_index *index,
+                               const char *query,
+                               table_index_callback callback,
+                               void *context) {
+  // Posting lists of each word of query
+  struct posting_list *lists[INVERTED_INDEX_MAX_QUERY_WORDS];
+  size_t lists_size = 0;
+  char token[TEXT_MAX_TOKEN];
+  while (lists_size < INVERTED_INDEX_MAX_QUERY_WORDS && text_next_token(&query, token)) {
+    struct inverted_index_word *entry = inverted_index_find_word(index, token);
+    if (entry == NULL)
+      return 0; // No item has this word
+    lists[lists_size++] = &entry->postings;
+  }
+
+  struct dynamic_array_handle *candidates;
+  size_t candidates_size = posting_list_intersect(lists, lists_size, &candidates);
+  size_t found = 0;
+  for (size_t i = 0; i < candidates_size; ++i) {
+    void *item = dynamic_array_resolve(index->base.arr, candidates[i]);
+    if (item == NULL)
+      continue;
+    ++found;
+    if (callback != NULL && !callback(item, context))
+      break; // Callback asked to stop
+  }
+  SAFE_FREE(candidates);
+  return found;
+}
+
+static bool inverted_index_find_callback(void *item, void *context) {
+  *(void **)context = item;
+  return false;
+}
+
+void *inverted_index_find(struct inverted_index *index, const char *query) {
+  void *found = NULL;
+  inverted_index_find_all(index, query, inverted_index_find_callback, &found);
+  return found;
+}
+
+void inverted_index_rebuild(struct inverted_index *index) {
+  // Drop all of the words, postings of each item are appended and every list is sorted once
+  inverted_index_clear(index);
+  size_t size = dynamic_array_size(index->base.arr);
+  for (size_t position = 0; position < size; ++position) {
+    if (!dynamic_array_is_dead(index->base.arr, position))
+      inverted_index_add_item(index, dynamic_array_get_at(index->base.arr, position), true);
+  }
+  for (size_t slot = 0; slot < index->capacity; ++slot) {
+    if (index->slots[slot].word != NULL)
+      posting_list_sort(&index->slots[slot].postings);
+  }
+}
+
+size_t inverted_index_size(struct inverted_index *index) {
+  return index->size;
+}
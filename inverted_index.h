@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "dynamic_array.h"
+#include "index_registry.h"
+#include "hash_index.h"
+#include "posting_list.h"
+#include "string_arena.h"
+#include "text.h"
+#include "common.h"
+
+#ifndef INVERTED_INDEX_MIN_CAPACITY
+#define INVERTED_INDEX_MIN_CAPACITY 64
+#endif
+
+// Query can't have more words than this, the rest of them are ignored
+#ifndef INVERTED_INDEX_MAX_QUERY_WORDS
+#define INVERTED_INDEX_MAX_QUERY_WORDS 16
+#endif
+
+typedef const char *(*inverted_index_key_getter)(void *item);
+
+struct inverted_index_word {
+  uint64_t hash;
+  const char *word; // NULL means an empty slot
+  struct posting_list postings; // Items which have the word
+};
+
+/* Full-text index over the words of several string fields of items.
+ * Words are split by text_next_token, so search ignores case and punctuation.
+ * Query returns items which have all of its words, posting lists of them are intersected.
+ */
+struct inverted_index {
+  struct table_index base; // Must be the first, registry passes the index by base pointer
+  struct inverted_index_word *slots; // Open addressing (linear probing) table of words
+  size_t capacity;
+  size_t size; // Amount of distinct words
+  struct string_arena words;
+  const inverted_index_key_getter *key_getters; // Fields to be indexed, the array must live as long as the index
+  size_t key_getters_size;
+  bool self_created;
+};
+
+struct inverted_index *inverted_index_create(struct inverted_index *at,
+                                             struct dynamic_array *arr,
+                                             const inverted_index_key_getter *key_getters,
+                                             size_t key_getters_size,
+                                             uint32_t fields);
+void inverted_index_destroy(struct inverted_index *index);
+
+bool inverted_index_insert(struct inverted_index *index, void *item);
+bool inverted_index_remove(struct inverted_index *index, void *item);
+// Returns any item which has all of the words of query
+void *inverted_index_find(struct inverted_index *index, const char *query);
+// Visits items which have all of the words of query in the order of slots
+size_t inverted_index_find_all(struct inverted_index *index,
+                               const char *query,
+                               table_index_callback callback,
+                               void *context);
+void inverted_index_rebuild(struct inverted_index *index);
+
+// Amount of distinct words
+size_t inverted_index_size(struct inverted_index *index);
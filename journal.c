@@ -0,0 +1,281 @@
+#include "journal.h"
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#define JOURNAL_ENTRY_HEADER_SIZE (2 * sizeof(uint32_t))
+
+struct journal_compaction {
+  struct snapshot snapshot;
+  char csv_path[JOURNAL_MAX_PATH];
+  char snapshot_path[JOURNAL_MAX_PATH];
+  char old_path[JOURNAL_MAX_PATH];
+  char path[JOURNAL_MAX_PATH]; // Journal which couldn't be opened for writing, empty if it was rotated
+  journal_csv_writer writer;
+};
+
+static uint32_t journal_checksum(const char *data, size_t size) {
+  // FNV-1a
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= (unsigned char)data[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static size_t journal_replay_file(const char *path, journal_apply_callback apply, void *context, size_t *entries) {
+  FILE *fp = NULL;
+  fopen_s(&fp, path, "rb");
+  if (fp == NULL)
+    return 0; // There is no journal
+
+  fseek(fp, 0L, SEEK_END);
+  long file_size = ftell(fp);
+  fseek(fp, 0L, SEEK_SET);
+  char *buffer = file_size > 0 ? malloc((size_t)file_size) : NULL;
+  size_t size = buffer != NULL ? fread(buffer, sizeof(char), (size_t)file_size, fp) : 0;
+  fclose(fp);
+
+  // Apply entries until the end or the first broken one, which could be written partially before crash
+  size_t position = 0;
+  while (position + JOURNAL_ENTRY_HEADER_SIZE <= size) {
+    uint32_t payload_size;
+    uint32_t checksum;
+    memcpy(&payload_size, buffer + position, sizeof(uint32_t));
+    memcpy(&checksum, buffer + position + sizeof(uint32_t), sizeof(uint32_t));
+    const char *payload = buffer + position + JOURNAL_ENTRY_HEADER_SIZE;
+    if (payload_size < 2 || payload_size > size - position - JOURNAL_ENTRY_HEADER_SIZE
+        || journal_checksum(payload, payload_size) != checksum)
+      break;
+
+    uint8_t op = (uint8_t)payload[0];
+    size_t count = (uint8_t)payload[1];
+    const char *fields[JOURNAL_MAX_FIELDS];
+    size_t fields_count = 0;
+    for (size_t i = 2; i < payload_size && fields_count < JOURNAL_MAX_FIELDS; ++fields_count) {
+      fields[fields_count] = payload + i;
+      const char *end = memchr(payload + i, '\0', payload_size - i);
+      if (end == NULL)
+        break;
+      i = (size_t)(end - payload) + 1;
+    }
+    if (fields_count != count || payload[payload_size - 1] != '\0')
+      break;
+
+    apply(context, op, fields, count);
+    ++*entries;
+    position += JOURNAL_ENTRY_HEADER_SIZE + payload_size;
+  }
+  SAFE_FREE(buffer);
+  return position;
+}
+
+static void journal_truncate(const char *path, size_t size) {
+  // Drop the broken tail, otherwise the next entries would be appended after it and never replayed
+  HANDLE file = CreateFileA(path, GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE)
+    return;
+  LARGE_INTEGER position;
+  position.QuadPart = (LONGLONG)size;
+  if (SetFilePointerEx(file, position, NULL, FILE_BEGIN))
+    SetEndOfFile(file);
+  CloseHandle(file);
+}
+
+static size_t journal_file_size(const char *path) {
+  WIN32_FILE_ATTRIBUTE_DATA attributes;
+  if (!GetFileAttributesExA(path, GetFileExInfoStandard, &attributes))
+    return 0;
+  return ((size_t)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow;
+}
+
+struct journal *journal_open(struct journal *at, const char *path, journal_apply_callback apply, void *context) {
+  // Allocating a buffer for structure or use existing if journal was provided as the first argument
+  struct journal *journal = at == NULL ? malloc(sizeof(*journal)) : at;
+  journal->fp = NULL;
+  journal->entries = 0;
+  journal->compaction = NULL;
+  journal->self_created = journal != at;
+  sprintf_s(journal->path, sizeof(journal->path), "%s", path);
+  sprintf_s(journal->old_path, sizeof(journal->old_path), "%s.old", path);
+
+  // Entries of unfinished compaction go first
+  if (apply != NULL) {
+    size_t old_size = journal_replay_file(journal->old_path, apply, context, &journal->entries);
+    if (old_size < journal_file_size(journal->old_path))
+      journal_truncate(journal->old_path, old_size);
+    size_t size = journal_replay_file(journal->path, apply, context, &journal->entries);
+    if (size < journal_file_size(journal->path))
+      journal_truncate(journal->path, size);
+  }
+
+  fopen_s(&journal->fp, journal->path, "ab");
+  if (journal->fp == NULL) {
+    journal_close(journal);
+    return NULL;
+  }
+  return journal;
+}
+
+void journal_close(struct journal *journal) {
+  if (journal == NULL)
+    return;
+  // Let the checkpoint be written before exit
+  journal_wait(journal);
+  if (journal->fp != NULL) {
+    fclose(journal->fp);
+    journal->fp = NULL;
+  }
+  if (journal->self_created)
+    free(journal);
+}
+
+bool journal_append(struct journal *journal, uint8_t op, const char **fields, size_t count) {
+  if (journal->fp == NULL || count > JOURNAL_MAX_FIELDS)
+    return false;
+
+  size_t payload_size = 2;
+  for (size_t i = 0; i < count; ++i)
+    payload_size += strlen(fields[i]) + 1;
+
+  // Build the whole entry first, so it's written by one call
+  char *entry = malloc(JOURNAL_ENTRY_HEADER_SIZE + payload_size);
+  if (entry == NULL)
+    return false;
+  char *payload = entry + JOURNAL_ENTRY_HEADER_SIZE;
+  payload[0] = (char)op;
+  payload[1] = (char)count;
+  size_t position = 2;
+  for (size_t i = 0; i < count; ++i) {
+    size_t length = strlen(fields[i]) + 1;
+    memcpy(payload + position, fields[i], length);
+    position += length;
+  }
+  uint32_t size = (uint32_t)payload_size;
+  uint32_t checksum = journal_checksum(payload, payload_size);
+  memcpy(entry, &size, sizeof(uint32_t));
+  memcpy(entry + sizeof(uint32_t), &checksum, sizeof(uint32_t));
+
+  bool written = fwrite(entry, sizeof(char), JOURNAL_ENTRY_HEADER_SIZE + payload_size, journal->fp)
+      == JOURNAL_ENTRY_HEADER_SIZE + payload_size;
+  // The change is kept even if the application crashes right after
+  written = fflush(journal->fp) == 0 && written;
+  SAFE_FREE(entry);
+  if (written)
+    ++journal->entries;
+  return written;
+}
+
+size_t journal_entries(struct journal *journal) {
+  // Amount of entries since the last compaction
+  return journal->entries;
+}
+
+static bool journal_append_file(const char *src_path, const char *dest_path) {
+  FILE *src = NULL;
+  FILE *dest = NULL;
+  fopen_s(&src, src_path, "rb");
+  fopen_s(&dest, dest_path, "ab");
+  bool copied = src != NULL && dest != NULL;
+  static char buffer[64 * 1024];
+  while (copied) {
+    size_t size = fread(buffer, sizeof(char), sizeof(buffer), src);
+    if (size == 0)
+      break;
+    copied = fwrite(buffer, sizeof(char), size, dest) == size;
+  }
+  if (src != NULL)
+    fclose(src);
+  if (dest != NULL)
+    copied = fclose(dest) == 0 && copied;
+  return copied;
+}
+
+static DWORD WINAPI journal_compaction_thread(LPVOID param) {
+  struct journal_compaction *compaction = (struct journal_compaction *)param;
+
+  // Replace CSV at first, the snapshot is marked with the version of new CSV
+  char temp_path[JOURNAL_MAX_PATH + 4];
+  sprintf_s(temp_path, sizeof(temp_path), "%s.tmp", compaction->csv_path);
+  FILE *fp = NULL;
+  fopen_s(&fp, temp_path, "w");
+  bool written = fp != NULL && compaction->writer(&compaction->snapshot, fp);
+  if (fp != NULL)
+    written = fclose(fp) == 0 && written;
+  written = written && MoveFileExA(temp_path, compaction->csv_path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+  if (!written)
+    DeleteFileA(temp_path);
+
+  struct snapshot_stamp stamp;
+  if (written && snapshot_stamp_of(compaction->csv_path, &stamp))
+    snapshot_write(&compaction->snapshot, compaction->snapshot_path, &stamp);
+
+  // Entries are in CSV now, the old journal would be replayed again if we failed
+  if (written)
+    DeleteFileA(compaction->old_path);
+  if (written && compaction->path[0] != '\0')
+    DeleteFileA(compaction->path);
+
+  snapshot_release(&compaction->snapshot);
+  free(compaction);
+  return written ? 0 : 1;
+}
+
+bool journal_compact(struct journal *journal,
+                     struct snapshot *snapshot,
+                     const char *csv_path,
+                     const char *snapshot_path,
+                     journal_csv_writer writer) {
+  // Only one compaction at a time
+  journal_wait(journal);
+
+  /* Move the entries to the old journal, the snapshot already contains them. If the previous compaction failed,
+   * the old journal still exists, so the entries are appended to it. Journal which couldn't be opened has nothing
+   * to rotate, the checkpoint is the only copy of changes then.
+   */
+  bool opened = journal->fp != NULL;
+  if (opened) {
+    fclose(journal->fp);
+    journal->fp = NULL;
+    bool rotated = GetFileAttributesA(journal->old_path) == INVALID_FILE_ATTRIBUTES
+                   ? MoveFileExA(journal->path, journal->old_path, MOVEFILE_WRITE_THROUGH)
+                   : journal_append_file(journal->path, journal->old_path) && DeleteFileA(journal->path);
+    fopen_s(&journal->fp, journal->path, "ab");
+    if (!rotated || journal->fp == NULL) {
+      snapshot_release(snapshot);
+      return false;
+    }
+    journal->entries = 0;
+  }
+
+  struct journal_compaction *compaction = malloc(sizeof(struct journal_compaction));
+  if (compaction == NULL) {
+    snapshot_release(snapshot);
+    return false;
+  }
+  compaction->snapshot = *snapshot;
+  snapshot_init(snapshot); // The compaction owns the snapshot now
+  sprintf_s(compaction->csv_path, sizeof(compaction->csv_path), "%s", csv_path);
+  sprintf_s(compaction->snapshot_path, sizeof(compaction->snapshot_path), "%s", snapshot_path);
+  sprintf_s(compaction->old_path, sizeof(compaction->old_path), "%s", journal->old_path);
+  // Entries replayed from the journal are in the snapshot, they must not be replayed over the new CSV
+  sprintf_s(compaction->path, sizeof(compaction->path), "%s", opened ? "" : journal->path);
+  compaction->writer = writer;
+
+  journal->compaction = CreateThread(NULL, 0, journal_compaction_thread, compaction, 0, NULL);
+  if (journal->compaction == NULL)
+    return journal_compaction_thread(compaction) == 0; // Do it on the current thread
+  return true;
+}
+
+bool journal_wait(struct journal *journal) {
+  if (journal->compaction == NULL)
+    return true;
+  DWORD code = 1;
+  WaitForSingleObject(journal->compaction, INFINITE);
+  GetExitCodeThread(journal->compaction, &code);
+  CloseHandle(journal->compaction);
+  journal->compaction = NULL;
+  return code == 0;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "snapshot.h"
+#include "common.h"
+
+#define JOURNAL_OP_INSERT 1
+#define JOURNAL_OP_REMOVE 2
+#define JOURNAL_OP_UPDATE 3
+
+#ifndef JOURNAL_MAX_FIELDS
+#define JOURNAL_MAX_FIELDS 16
+#endif
+
+#ifndef JOURNAL_MAX_PATH
+#define JOURNAL_MAX_PATH 260
+#endif
+
+// Amount of entries after which the journal should be folded into the checkpoint
+#ifndef JOURNAL_COMPACT_THRESHOLD
+#define JOURNAL_COMPACT_THRESHOLD 10000
+#endif
+
+// Applies the entry to the table while the journal is replayed
+typedef void (*journal_apply_callback)(void *context, uint8_t op, const char **fields, size_t count);
+// Writes the copy of table as CSV
+typedef bool (*journal_csv_writer)(const struct snapshot *snapshot, FILE *fp);
+
+/* Append-only log of table changes. Each entry is:
+ * uint32 payload size, uint32 checksum of payload, uint8 operation, uint8 amount of fields, zero-terminated fields.
+ * Compaction moves the entries to "<path>.old" and folds them into CSV and snapshot on the background thread,
+ * the old journal is removed only when the checkpoint is written.
+ */
+struct journal {
+  FILE *fp;
+  char path[JOURNAL_MAX_PATH];
+  char old_path[JOURNAL_MAX_PATH];
+  size_t entries;
+  void *compaction; // Background thread of compaction
+  bool self_created;
+};
+
+struct journal *journal_open(struct journal *at, const char *path, journal_apply_callback apply, void *context);
+void journal_close(struct journal *journal);
+
+bool journal_append(struct journal *journal, uint8_t op, const char **fields, size_t count);
+size_t journal_entries(struct journal *journal);
+
+// Starts to write the checkpoint on the background thread, also when the journal couldn't be opened
+bool journal_compact(struct journal *journal,
+                     struct snapshot *snapshot,
+                     const char *csv_path,
+                     const char *snapshot_path,
+                     journal_csv_writer writer);
+// Waits for the running compaction, returns false if its checkpoint wasn't written
+bool journal_wait(struct journal *journal);
@@ -7,98 +7,105 @@
 #include "books.h"
 #include "students.h"
 #include "users.h"
+#include "metrics.h"
+#include "batch.h"
+#include "menu.h"
+#include "server.h"
 
-#include "csv/csv_parser.h"
+#include "csv/csv_reader.h"
 
-size_t get_size_of_file(FILE *fp) {
-  if (fp == NULL)
-    return 0;
-
-  // Get the current position of file
-  long current_position = ftell(fp);
-
-  size_t fsize = 0;
-  // Go to the end of file
-  fseek(fp, 0L, SEEK_END);
-  // Get the size of file
-  fsize = ftell(fp);
-  // Go back to the previous position of file
-  fseek(fp, current_position, SEEK_SET);
-
-  return fsize;
-}
-
-const char *read_file_data(FILE *fp) {
-  if (fp == NULL)
-    return 0;
-
-  // Go to the start of file
-  fseek(fp, 0L, SEEK_SET);
-  // Get the size of file
-  size_t file_size = get_size_of_file(fp);
-  // Allocate the file size buffer
-  char *buffer = malloc(file_size + 1);
-  // Read file data to buffer
-  fread(buffer, sizeof(char), file_size, fp);
-  // Zero-terminate a buffer
-  buffer[file_size] = '\0';
-
-  return (const char *)buffer;
-}
+// Changes made since the last save, replayed on the next start
+static struct journal books_journal;
+static struct journal students_journal;
+// Loaders run on their own threads, so the failures are reported once all of them are done
+static bool books_journal_opened = false;
+static bool students_journal_opened = false;
 
 struct books *parse_books() {
-  FILE *fp = NULL;
-  fopen_s(&fp, "./books.csv", "r");
-  if (fp == NULL) {
+  // CSV is the source of data, snapshot is used only if it was made from the same CSV
+  struct snapshot_stamp stamp;
+  if (!snapshot_stamp_of("./books.csv", &stamp)) {
     return NULL;
   }
+  struct books *pool = books_create_from_snapshot(NULL, "./books.bin", &stamp);
+  if (pool == NULL) {
+    struct csv_reader reader;
+    if (csv_reader_open(&reader, "./books.csv") == NULL) {
+      return NULL;
+    }
 
-  struct csv_data *data = NULL;
-  const char *buffer = read_file_data(fp);
-  fclose(fp);
-  data = parse_csv(buffer);
-  SAFE_FREE(buffer);
+    // Parse large files on all cores, small ones get read sequentially
+    csv_reader_parse_parallel(&reader, 0);
+    pool = books_create_from_csv(NULL, &reader);
+    csv_reader_close(&reader);
+    // Make the snapshot for the next start
+    if (pool != NULL)
+      books_save_snapshot(pool, "./books.bin", &stamp);
+  }
 
-  struct books *pool = books_create_from_csv(NULL, data);
-  free(data);
+  // Replay changes that weren't saved yet, then keep logging new ones.
+  // Unlock finishes the work deferred by loading, so the first readers don't do it at the same time
+  if (pool != NULL) {
+    books_lock_exclusive(pool);
+    books_journal_opened = journal_open(&books_journal, "./books.journal", books_journal_apply, pool) != NULL;
+    books_unlock_exclusive(pool);
+  }
   return pool;
 }
 
 struct students *parse_students() {
-  FILE *fp = NULL;
-  fopen_s(&fp, "./students.csv", "r");
-  if (fp == NULL) {
+  // CSV is the source of data, snapshot is used only if it was made from the same CSV
+  struct snapshot_stamp stamp;
+  if (!snapshot_stamp_of("./students.csv", &stamp)) {
     return NULL;
   }
+  struct students *pool = students_create_from_snapshot(NULL, "./students.bin", &stamp);
+  if (pool == NULL) {
+    struct csv_reader reader;
+    if (csv_reader_open(&reader, "./students.csv") == NULL) {
+      return NULL;
+    }
 
-  size_t fsize = get_size_of_file(fp);
-
-  struct csv_data *data = NULL;
-  const char *buffer = read_file_data(fp);
-  fclose(fp);
-  data = parse_csv(buffer);
-  SAFE_FREE(buffer);
+    // Parse large files on all cores, small ones get read sequentially
+    csv_reader_parse_parallel(&reader, 0);
+    pool = students_create_from_csv(NULL, &reader);
+    csv_reader_close(&reader);
+    // Make the snapshot for the next start
+    students_save_snapshot(pool, "./students.bin", &stamp);
+  }
 
-  struct students *pool = students_create_from_csv(NULL, data);
-  free(data);
+  // Replay changes that weren't saved yet, then keep logging new ones.
+  // Unlock finishes the work deferred by loading, so the first readers don't do it at the same time
+  if (pool != NULL) {
+    students_lock_exclusive(pool);
+    students_journal_opened = journal_open(&students_journal, "./students.journal", students_journal_apply, pool) != NULL;
+    students_unlock_exclusive(pool);
+  }
   return pool;
 }
 
 struct users *parse_users() {
-  FILE *fp = NULL;
-  fopen_s(&fp, "./users.csv", "r");
-  if (fp == NULL) {
+  // CSV is the source of data, snapshot is used only if it was made from the same CSV
+  struct snapshot_stamp stamp;
+  if (!snapshot_stamp_of("./users.csv", &stamp)) {
     return NULL;
   }
+  struct users *pool = users_create_from_snapshot(NULL, "./users.bin", &stamp);
+  if (pool != NULL) {
+    return pool;
+  }
 
-  struct csv_data *data = NULL;
-  const char *buffer = read_file_data(fp);
-  fclose(fp);
-  data = parse_csv(buffer);
-  SAFE_FREE(buffer);
+  struct csv_reader reader;
+  if (csv_reader_open(&reader, "./users.csv") == NULL) {
+    return NULL;
+  }
 
-  struct users *pool = users_create_from_csv(NULL, data);
-  free(data);
+  // Parse large files on all cores, small ones get read sequentially
+  csv_reader_parse_parallel(&reader, 0);
+  pool = users_create_from_csv(NULL, &reader);
+  csv_reader_close(&reader);
+  // Make the snapshot for the next start
+  users_save_snapshot(pool, "./users.bin", &stamp);
   return pool;
 }
 
@@ -107,15 +114,71 @@ static struct students *students_pool = NULL;
 static struct users *users_pool = NULL;
 static struct user *this_user = NULL;
 
-const char *get_user_input(const char *text) {
+DWORD WINAPI parse_books_thread(LPVOID param) {
+  books_pool = parse_books();
+  return 0;
+}
+
+DWORD WINAPI parse_students_thread(LPVOID param) {
+  students_pool = parse_students();
+  return 0;
+}
+
+DWORD WINAPI parse_users_thread(LPVOID param) {
+  users_pool = parse_users();
+  return 0;
+}
+
+void close_journals() {
+  // Let the running compactions finish their checkpoints
+  journal_close(&books_journal);
+  journal_close(&students_journal);
+}
+
+void parse_all() {
+  // Each table is loaded by its own thread, so startup takes as long as the largest table
+  LPTHREAD_START_ROUTINE loaders[] = {parse_books_thread, parse_students_thread, parse_users_thread};
+  HANDLE threads[sizeof(loaders) / sizeof(*loaders)];
+  for (size_t i = 0; i < sizeof(loaders) / sizeof(*loaders); ++i) {
+    threads[i] = CreateThread(NULL, 0, loaders[i], NULL, 0, NULL);
+    if (threads[i] == NULL)
+      loaders[i](NULL); // Load on the current thread if we can't create another one
+  }
+  // Wait for all of tables before any of them is used
+  for (size_t i = 0; i < sizeof(loaders) / sizeof(*loaders); ++i) {
+    if (threads[i] != NULL) {
+      WaitForSingleObject(threads[i], INFINITE);
+      CloseHandle(threads[i]);
+    }
+  }
+  // Tables still work without the journal, but their changes are kept only by the explicit save
+  if (books_pool != NULL && !books_journal_opened)
+    printf("    books.journal,      .\n");
+  if (students_pool != NULL && !students_journal_opened)
+    printf("    students.journal,      .\n");
+  atexit(close_journals);
+}
+
+const char *read_user_input(const char *text, void *context) {
   static char user_input_buffer[144 + 1];
   printf("%s", text);
   memset((void *)user_input_buffer, 0, sizeof(user_input_buffer));
-  fgets(user_input_buffer, sizeof(user_input_buffer), stdin);
-  user_input_buffer[strlen(user_input_buffer) - 1] = '\0'; // remove the newline character (\n)
+  if (fgets(user_input_buffer, sizeof(user_input_buffer), stdin) == NULL)
+    return NULL; // Input is closed
+  user_input_buffer[strcspn(user_input_buffer, "\r\n")] = '\0'; // remove the newline character (\n)
   return user_input_buffer;
 }
 
+const char *get_user_input(const char *text) {
+  const char *input = read_user_input(text, NULL);
+  if (input == NULL) {
+    // Nobody will answer the question, the changes are in journals already
+    printf("\n");
+    exit(0);
+  }
+  return input;
+}
+
 void pause_and_exit(const char *text, int code) {
   printf("%s", text);
   system("pause");
@@ -134,23 +197,49 @@ void ask_for_auth() {
   }
 }
 
-void difficulty_1_books_add() {
-  uint64_t uid = strtoull(get_user_input("  ISBN: "), NULL, 10);
-  if (uid == 0 || books_find_by_uid(books_pool, uid) != NULL) {
+bool books_checkpoint() {
+  // Journal already has all changes, so CSV and snapshot are written on the background thread
+  struct snapshot snapshot;
+  if (!books_build_snapshot(books_pool, &snapshot))
+    return false;
+  return journal_compact(&books_journal, &snapshot, "./books.csv", "./books.bin", books_save_csv_from_snapshot);
+}
+
+bool save_books() {
+  // Explicit save reports only what reached the disk
+  return books_checkpoint() && journal_wait(&books_journal);
+}
+
+void books_changed() {
+  // Keep the journal short, so the next start doesn't replay too much
+  if (journal_entries(&books_journal) >= JOURNAL_COMPACT_THRESHOLD)
+    books_checkpoint();
+}
+
+void difficulty_1_books_add(struct menu_machine *machine) {
+  uint64_t uid;
+  // Ask again until the number is free
+  while (((uid = strtoull(menu_machine_read(machine, "  ISBN: "), NULL, 10)) == 0
+      || books_find_by_uid(books_pool, uid) != NULL) && !menu_machine_stopped(machine)) {
     printf("  ISBN,     .\n");
-    difficulty_1_books_add();
-    return;
   }
 
   book_insert_data data;
   data.uid = uid;
-  // Copy all values because user input buffer is temporary, gets changed after every call of get_user_input
-  data.book_name = copy_string(get_user_input("  : "));
-  data.authors = copy_string(get_user_input("  : "));
-  data.available_amount = strtoul(get_user_input("   : "), NULL, 10);
-  data.total_amount = strtoul(get_user_input("   : "), NULL, 10);
+  // Copy all values because user input buffer is temporary, gets changed after every call of menu_machine_read
+  data.book_name = copy_string(menu_machine_read(machine, "  : "));
+  data.authors = copy_string(menu_machine_read(machine, "  : "));
+  data.available_amount = strtoul(menu_machine_read(machine, "   : "), NULL, 10);
+  data.total_amount = strtoul(menu_machine_read(machine, "   : "), NULL, 10);
+  if (menu_machine_stopped(machine)) {
+    // Input is over before the book was described
+    SAFE_FREE(data.book_name);
+    SAFE_FREE(data.authors);
+    return;
+  }
 
-  books_insert(books_pool, data);
+  books_journal_insert(&books_journal, books_insert(books_pool, data));
+  books_changed();
 
   SAFE_FREE(data.book_name);
   SAFE_FREE(data.authors);
@@ -158,29 +247,33 @@ void difficulty_1_books_add() {
   printf(" .\n");
 }
 
-void difficulty_1_books_remove() {
-  uint64_t uid = strtoull(get_user_input("  ISBN: "), NULL, 10);
-  if (uid == 0 || books_remove_by_uid(books_pool, uid) == false) {
+void difficulty_1_books_remove(struct menu_machine *machine) {
+  uint64_t uid;
+  while ((uid = strtoull(menu_machine_read(machine, "  ISBN: "), NULL, 10)) == 0
+      || books_remove_by_uid(books_pool, uid) == false) {
+    if (menu_machine_stopped(machine))
+      return;
     printf("  ISBN,     .\n");
-    difficulty_1_books_remove();
-    return;
   }
+  books_journal_remove(&books_journal, uid);
+  books_changed();
 
   printf(" .\n");
 }
 
-void difficulty_1_books_view_by_uid() {
+void difficulty_1_books_view_by_uid(struct menu_machine *machine) {
   if (books_size(books_pool) <= 0) {
     printf(" .\n");
     return;
   }
 
-  uint64_t uid = strtoull(get_user_input("  ISBN: "), NULL, 10);
-  struct book *item = books_find_by_uid(books_pool, uid);
-  if (uid == 0 || item == NULL) {
+  uint64_t uid;
+  struct book *item;
+  while ((uid = strtoull(menu_machine_read(machine, "  ISBN: "), NULL, 10)) == 0
+      || (item = books_find_by_uid(books_pool, uid)) == NULL) {
+    if (menu_machine_stopped(machine))
+      return;
     printf("  ISBN,     .\n");
-    difficulty_1_books_view_by_uid();
-    return;
   }
 
   printf("\n ISBN: %llu\n: %s\n: %s\n: %d\n: %d\n\n",
@@ -191,13 +284,14 @@ void difficulty_1_books_view_by_uid() {
          (int)item->total_amount);
 }
 
-void difficulty_1_books_view_all() {
+void difficulty_1_books_view_all(struct menu_machine *machine) {
+  (void)machine; // Nothing to ask
   if (books_size(books_pool) <= 0) {
     printf(" .\n");
     return;
   }
   for (struct book *item = books_first(books_pool); item <= books_last(books_pool); ++item) {
-    if (item == NULL)
+    if (books_is_removed(books_pool, item))
       continue;
     printf("\n ISBN: %llu\n: %s\n: %s\n: %d\n: %d\n",
            item->uid,
@@ -209,91 +303,131 @@ void difficulty_1_books_view_all() {
   printf("\n");
 }
 
-void difficulty_1_books_save() {
-  FILE *fp = NULL;
-  fopen_s(&fp, "./books.csv", "w");
-  if (fp == NULL) {
+bool books_print_callback(struct book *item, void *context) {
+  printf("%llu %s. %s\n", item->uid, item->authors, item->book_name);
+  return true;
+}
+
+void difficulty_1_books_find_by_words(struct menu_machine *machine) {
+  // Book has to contain all of the words in its name or authors
+  const char *words = menu_machine_read(machine, "     : ");
+  if (menu_machine_stopped(machine))
+    return;
+  if (books_find_by_words(books_pool, words, books_print_callback, NULL) == 0)
+    printf("  .\n");
+  printf("\n");
+}
+
+bool books_print_ranked_callback(struct book *item, size_t distance, void *context) {
+  // Show only a screen of the closest ones
+  size_t *printed = (size_t *)context;
+  if (*printed == 0)
+    printf(" :\n");
+  printf("%llu %s. %s\n", item->uid, item->authors, item->book_name);
+  return ++*printed < 20;
+}
+
+void difficulty_1_books_find_by_substring(struct menu_machine *machine) {
+  const char *query = menu_machine_read(machine, "    : ");
+  if (menu_machine_stopped(machine))
+    return;
+  if (books_find_by_substring(books_pool, query, books_print_callback, NULL) == 0) {
+    // Query may have a typo, show the books which are a few letters away
+    size_t printed = 0;
+    printf("  .\n");
+    books_find_similar(books_pool, query, 2, books_print_ranked_callback, &printed);
+  }
+  printf("\n");
+}
+
+void difficulty_1_books_save(struct menu_machine *machine) {
+  (void)machine; // Nothing to ask
+  if (!save_books()) {
     printf("    .\n");
     return;
   }
-  books_save_csv_to_file(books_pool, fp);
   printf("  .\n");
-  fclose(fp);
-}
-
-void difficulty_1_books() {
-  printf(
-      " :\n1.  \n2.  \n3.    \n4.   \n5.  \n\n0. \n");
-  const char *input = get_user_input(" : ");
-  switch (*input) {
-  case '1':difficulty_1_books_add();
-    break;
-  case '2':difficulty_1_books_remove();
-    break;
-  case '3':difficulty_1_books_view_by_uid();
-    break;
-  case '4':difficulty_1_books_view_all();
-    break;
-  case '5':difficulty_1_books_save();
-    break;
-  case '0':
-    if (this_user->can_view_edit_students) {
-      // Go to the previous function but do not close app if there is another permission
-      return;
-    }
-    // Close app immediately if there's nothing other to do
-    exit(0);
-    break;
-  }
-  difficulty_1_books();
 }
 
-void difficulty_1_students_add() {
-  const char *input_uid = get_user_input("   : ");
-  if (students_find_by_uid(students_pool, input_uid) != NULL) {
+bool students_checkpoint() {
+  // Journal already has all changes, so CSV and snapshot are written on the background thread
+  struct snapshot snapshot;
+  if (!students_build_snapshot(students_pool, &snapshot))
+    return false;
+  return journal_compact(&students_journal, &snapshot, "./students.csv", "./students.bin", students_save_csv_from_snapshot);
+}
+
+bool save_students() {
+  // Explicit save reports only what reached the disk
+  return students_checkpoint() && journal_wait(&students_journal);
+}
+
+void students_changed() {
+  // Keep the journal short, so the next start doesn't replay too much
+  if (journal_entries(&students_journal) >= JOURNAL_COMPACT_THRESHOLD)
+    students_checkpoint();
+}
+
+void difficulty_1_students_add(struct menu_machine *machine) {
+  const char *input_uid;
+  // Ask again until the number is free
+  while (students_find_by_uid(students_pool, input_uid = menu_machine_read(machine, "   : ")) != NULL
+      && !menu_machine_stopped(machine)) {
     printf("       .\n");
-    difficulty_1_students_add();
-    return;
   }
 
   student_insert_data data;
-  // Copy all values because user input buffer is temporary, gets changed after every call of get_user_input
+  // Copy all values because user input buffer is temporary, gets changed after every call of menu_machine_read
   data.record_book_uid = copy_string(input_uid);
-  data.surname = copy_string(get_user_input("  : "));
-  data.name = copy_string(get_user_input("  : "));
-  data.patronymic = copy_string(get_user_input("  : "));
-  data.faculty = copy_string(get_user_input("  : "));
-  data.speciality = copy_string(get_user_input("  : "));
-
-  students_insert(students_pool, data);
+  data.surname = copy_string(menu_machine_read(machine, "  : "));
+  data.name = copy_string(menu_machine_read(machine, "  : "));
+  data.patronymic = copy_string(menu_machine_read(machine, "  : "));
+  data.faculty = copy_string(menu_machine_read(machine, "  : "));
+  data.speciality = copy_string(menu_machine_read(machine, "  : "));
+
+  // Input may be over before the student was described
+  if (!menu_machine_stopped(machine)) {
+    students_journal_insert(&students_journal, students_insert(students_pool, data));
+    students_changed();
+  }
 
   SAFE_FREE(data.surname);
   SAFE_FREE(data.name);
   SAFE_FREE(data.patronymic);
   SAFE_FREE(data.faculty);
   SAFE_FREE(data.speciality);
+  SAFE_FREE(data.record_book_uid);
 
-  printf(" .\n");
+  if (!menu_machine_stopped(machine))
+    printf(" .\n");
 }
 
-void difficulty_1_students_remove() {
-  if (students_remove_by_uid(students_pool, get_user_input("   : ")) == false) {
+void difficulty_1_students_remove(struct menu_machine *machine) {
+  const char *uid;
+  while (true) {
+    uid = menu_machine_read(machine, "   : ");
+    // Empty answer of the stopped machine must not remove anything
+    if (menu_machine_stopped(machine))
+      return;
+    if (students_remove_by_uid(students_pool, uid))
+      break;
     printf("       .\n");
-    difficulty_1_students_remove();
-    return;
   }
+  students_journal_remove(&students_journal, uid);
+  students_changed();
 
   printf(" .\n");
 }
 
-void difficulty_1_students_edit() {
-  struct student *item = students_find_by_uid(students_pool, get_user_input("   : "));
-  if (item == NULL) {
+void difficulty_1_students_edit(struct menu_machine *machine) {
+  struct student *item;
+  while ((item = students_find_by_uid(students_pool, menu_machine_read(machine, "   : "))) == NULL) {
+    if (menu_machine_stopped(machine))
+      return;
     printf("       .\n");
-    difficulty_1_students_edit();
-    return;
   }
-  const char *input = get_user_input(
+  const char *input = menu_machine_read(
+      machine,
       "  :\n1.\n2. \n3. \n4. \n5. \n\n0. \n\n : ");
   char selected = *input;
   if (!(selected >= '1' && selected <= '5')) {
@@ -301,42 +435,21 @@ void difficulty_1_students_edit() {
       printf("   .\n");
     return;
   }
-  const char *new_value = copy_string(get_user_input("  : "));
-  switch (selected) {
-  case '1': {
-    SAFE_FREE(item->surname);
-    item->surname = new_value;
-    break;
-  }
-  case '2': {
-    SAFE_FREE(item->name);
-    item->name = new_value;
-    break;
-  }
-  case '3': {
-    SAFE_FREE(item->patronymic);
-    item->patronymic = new_value;
-    break;
-  }
-  case '4': {
-    SAFE_FREE(item->faculty);
-    item->faculty = new_value;
-    break;
-  }
-  case '5': {
-    SAFE_FREE(item->speciality);
-    item->speciality = new_value;
-    break;
-  }
+  // Menu items go in the same order as fields after the record book number
+  enum students_field field = (enum students_field)(STUDENTS_FIELD_SURNAME + (selected - '1'));
+  const char *new_value = menu_machine_read(machine, "  : ");
+  if (!menu_machine_stopped(machine) && students_update_field(students_pool, item, field, new_value)) {
+    students_journal_update(&students_journal, item->record_book_uid, field, new_value);
+    students_changed();
   }
 }
 
-void difficulty_1_students_view_by_uid() {
-  struct student *item = students_find_by_uid(students_pool, get_user_input("   : "));
-  if (item == NULL) {
+void difficulty_1_students_view_by_uid(struct menu_machine *machine) {
+  struct student *item;
+  while ((item = students_find_by_uid(students_pool, menu_machine_read(machine, "   : "))) == NULL) {
+    if (menu_machine_stopped(machine))
+      return;
     printf("       .\n");
-    difficulty_1_students_view_by_uid();
-    return;
   }
 
   printf("\n  : %s\n: %s\n: %s\n: %s\n: %s\n: %s\n\n",
@@ -348,76 +461,202 @@ void difficulty_1_students_view_by_uid() {
          item->speciality);
 }
 
-void difficulty_1_students_save() {
-  FILE *fp = NULL;
-  fopen_s(&fp, "./students.csv", "w");
-  if (fp == NULL) {
-    printf("    .\n");
+bool students_print_ranked_callback(struct student *item, size_t distance, void *context) {
+  // Show only a screen of the closest ones
+  size_t *printed = (size_t *)context;
+  if (*printed == 0)
+    printf(" :\n");
+  printf("%s %s %s %s\n", item->record_book_uid, item->surname, item->name, item->patronymic);
+  return ++*printed < 20;
+}
+
+void difficulty_1_students_find_by_surname(struct menu_machine *machine) {
+  // The beginning of surname is enough, case doesn't matter
+  const char *prefix = menu_machine_read(machine, "  : ");
+  if (menu_machine_stopped(machine))
     return;
+  students_iterator iterator = students_find_by_surname_prefix(students_pool, prefix);
+  size_t found = 0;
+  struct student *item;
+  while ((item = students_next(&iterator)) != NULL) {
+    printf("%s %s %s %s\n", item->record_book_uid, item->surname, item->name, item->patronymic);
+    ++found;
   }
-  students_save_csv_to_file(students_pool, fp);
-  printf("  .\n");
-  fclose(fp);
-}
-
-void difficulty_1_students() {
-  printf(
-      " :\n1.  \n2.  \n3.  \n4.    \n5.  \n\n0. \n");
-  const char *input = get_user_input(" : ");
-  switch (*input) {
-  case '1':difficulty_1_students_add();
-    break;
-  case '2':difficulty_1_students_remove();
-    break;
-  case '3':difficulty_1_students_edit();
-    break;
-  case '4':difficulty_1_students_view_by_uid();
-    break;
-  case '5':difficulty_1_students_save();
-    break;
-  case '0':
-    if (this_user->can_view_edit_books) {
-      // Go to the previous function but do not close app if there is another permission
-      return;
-    }
-    // Close app immediately if there's nothing other to do
-    exit(0);
-    break;
+  if (found == 0) {
+    // Surname may have a typo, show the students with close surnames
+    size_t printed = 0;
+    printf("     .\n");
+    students_find_similar_surnames(students_pool, prefix, 2, students_print_ranked_callback, &printed);
   }
-  difficulty_1_students();
+  printf("\n");
 }
 
-void difficulty_2_actions_both() {
-  printf(" :\n1. \n2. \n\n0. \n");
-  const char *input = get_user_input(" : ");
-  switch (*input) {
-  case '1':difficulty_1_books();
-    break;
-  case '2':difficulty_1_students();
-    break;
-  case '0':exit(0);
-    break;
+void difficulty_1_students_save(struct menu_machine *machine) {
+  (void)machine; // Nothing to ask
+  if (!save_students()) {
+    printf("    .\n");
+    return;
   }
-  difficulty_2_actions_both();
+  printf("  .\n");
+}
+
+void difficulty_2_metrics(struct menu_machine *machine) {
+  (void)machine; // Nothing to ask
+  // Timings of the table functions since the start, the build must measure them
+  printf("\n");
+  metrics_dump(stdout);
+  printf("\n");
 }
 
+enum main_menu {
+  MAIN_MENU_CATEGORIES,
+  MAIN_MENU_BOOKS,
+  MAIN_MENU_STUDENTS
+};
+
+static const struct menu_item main_menu_categories_items[] = {
+    {'1', "", NULL, MAIN_MENU_BOOKS, NULL},
+    {'2', "", NULL, MAIN_MENU_STUDENTS, NULL},
+    {'9', " ", difficulty_2_metrics, MENU_STAY, metrics_enabled},
+    {'0', "", NULL, MENU_BACK, NULL},
+};
+
+static const struct menu_item main_menu_books_items[] = {
+    {'1', " ", difficulty_1_books_add, MENU_STAY, NULL},
+    {'2', " ", difficulty_1_books_remove, MENU_STAY, NULL},
+    {'3', "   ", difficulty_1_books_view_by_uid, MENU_STAY, NULL},
+    {'4', "  ", difficulty_1_books_view_all, MENU_STAY, NULL},
+    {'5', "   ", difficulty_1_books_find_by_words, MENU_STAY, NULL},
+    {'6', "      ", difficulty_1_books_find_by_substring, MENU_STAY, NULL},
+    {'7', " ", difficulty_1_books_save, MENU_STAY, NULL},
+    {'0', "", NULL, MENU_BACK, NULL},
+};
+
+static const struct menu_item main_menu_students_items[] = {
+    {'1', " ", difficulty_1_students_add, MENU_STAY, NULL},
+    {'2', " ", difficulty_1_students_remove, MENU_STAY, NULL},
+    {'3', " ", difficulty_1_students_edit, MENU_STAY, NULL},
+    {'4', "   ", difficulty_1_students_view_by_uid, MENU_STAY, NULL},
+    {'5', "   ", difficulty_1_students_find_by_surname, MENU_STAY, NULL},
+    {'6', " ", difficulty_1_students_save, MENU_STAY, NULL},
+    {'0', "", NULL, MENU_BACK, NULL},
+};
+
+// Indexed by enum main_menu, tables of a single category are the root for the user with one permission
+static const struct menu main_menus[] = {
+    {" :", main_menu_categories_items, sizeof(main_menu_categories_items) / sizeof(*main_menu_categories_items), MAIN_MENU_CATEGORIES},
+    {" :", main_menu_books_items, sizeof(main_menu_books_items) / sizeof(*main_menu_books_items), MAIN_MENU_CATEGORIES},
+    {" :", main_menu_students_items, sizeof(main_menu_students_items) / sizeof(*main_menu_students_items), MAIN_MENU_CATEGORIES},
+};
+
 void difficulty_2() {
   ask_for_auth();
+  enum main_menu root;
   if (this_user->can_view_edit_books && this_user->can_view_edit_students) {
-    difficulty_2_actions_both();
+    root = MAIN_MENU_CATEGORIES;
   } else if (this_user->can_view_edit_books) {
-    difficulty_1_books();
+    root = MAIN_MENU_BOOKS;
   } else if (this_user->can_view_edit_students) {
-    difficulty_1_students();
+    root = MAIN_MENU_STUDENTS;
   } else {
     pause_and_exit("      .   .\n", 0);
+    return;
   }
+
+  // Menus return to the loop instead of calling each other, so a long session doesn't grow the stack
+  struct menu_machine machine;
+  menu_machine_create(&machine,
+                      main_menus,
+                      sizeof(main_menus) / sizeof(*main_menus),
+                      root,
+                      " : ",
+                      read_user_input,
+                      NULL,
+                      stdout);
+  menu_machine_run(&machine);
+  menu_machine_destroy(&machine);
 }
 
-int main() {
-  books_pool = parse_books();
-  students_pool = parse_students();
-  users_pool = parse_users();
+int run_batch(const char *path) {
+  // Commands come from the file or from stdin if the path is "-"
+  FILE *input = stdin;
+  if (strcmp(path, "-") != 0 && fopen_s(&input, path, "r") != 0) {
+    printf("     %s.\n", path);
+    return 4;
+  }
+  if (books_pool == NULL || students_pool == NULL || users_pool == NULL) {
+    printf("    books.csv, students.csv  users.csv.\n");
+    return 1;
+  }
+
+  // Changes are not logged one by one, the changed tables are saved once at the end
+  struct batch_session session;
+  batch_session_create(&session, books_pool, students_pool, users_pool);
+  session.save_books = save_books;
+  session.save_students = save_students;
+  struct batch_report report;
+  bool succeeded = batch_run(&session, input, stdout, stderr, &report);
+  batch_session_destroy(&session);
+  if (input != stdin)
+    fclose(input);
+
+  printf(" : %llu,    : %llu,  %.3f  (%.0f   ).\n",
+         (unsigned long long)report.commands,
+         (unsigned long long)report.failed,
+         report.seconds,
+         report.seconds > 0 ? (double)report.commands / report.seconds : 0.0);
+  return succeeded ? 0 : 5;
+}
+
+static struct server *running_server = NULL;
+
+BOOL WINAPI stop_server(DWORD type) {
+  // Ctrl+C or closing of the console stops the loop, the journals are closed on exit
+  if (running_server != NULL)
+    server_stop(running_server);
+  return TRUE;
+}
+
+int run_server(const char *path) {
+  if (books_pool == NULL || students_pool == NULL || users_pool == NULL) {
+    printf("    books.csv, students.csv  users.csv.\n");
+    return 1;
+  }
+
+  // Each change of clients goes to the journal right away like in menus
+  struct batch_session defaults;
+  batch_session_create(&defaults, books_pool, students_pool, users_pool);
+  defaults.books_journal = &books_journal;
+  defaults.students_journal = &students_journal;
+  defaults.books_changed = books_changed;
+  defaults.students_changed = students_changed;
+  defaults.save_books = save_books;
+  defaults.save_students = save_students;
+
+  struct server server;
+  server_create(&server, &defaults, SERVER_MAX_CLIENTS);
+  if (!server_listen(&server, path)) {
+    if (server.address_in_use)
+      printf(" %s      .\n", path);
+    else
+      printf("    %s.\n", path);
+    server_destroy(&server);
+    batch_session_destroy(&defaults);
+    return 6;
+  }
+  running_server = &server;
+  SetConsoleCtrlHandler(stop_server, TRUE);
+  printf("    %s.    Ctrl+C.\n", path);
+  bool succeeded = server_run(&server);
+  running_server = NULL;
+  server_destroy(&server);
+  batch_session_destroy(&defaults);
+  printf(" .\n");
+  return succeeded ? 0 : 7;
+}
+
+int main(int argc, char **argv) {
+  parse_all();
 
   /* All I/O and this file encoding must be CP-1251,
    * otherwise we will notice encoding faults in output data and files
@@ -425,6 +664,13 @@ int main() {
   SetConsoleCP(1251);
   SetConsoleOutputCP(1251);
 
+  // dz_sem_2 --batch FILE runs the commands of file without menus, see batch.h
+  if (argc == 3 && strcmp(argv[1], "--batch") == 0)
+    return run_batch(argv[2]);
+  // dz_sem_2 --serve SOCKET serves the same commands to many clients, see server.h
+  if (argc == 3 && strcmp(argv[1], "--serve") == 0)
+    return run_server(argv[2]);
+
   if (books_pool == NULL) {
     pause_and_exit(
         "    .\n,    books.csv    .\n  .\n",
@@ -443,8 +689,6 @@ int main() {
         3);
   }
 
-  while (true)
-    difficulty_2();
-
+  difficulty_2();
   return 0;
 }
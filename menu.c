@@ -0,0 +1,104 @@
+#include "menu.h"
+
+struct menu_machine *menu_machine_create(struct menu_machine *at,
+                                         const struct menu *menus,
+                                         size_t menus_size,
+                                         size_t root,
+                                         const char *prompt,
+                                         menu_reader reader,
+                                         void *context,
+                                         FILE *out) {
+  // Allocating a buffer for structure or use existing if machine was provided as the first argument
+  struct menu_machine *machine = at == NULL ? malloc(sizeof(*machine)) : at;
+  machine->menus = menus;
+  machine->menus_size = menus_size;
+  machine->root = root;
+  machine->current = root < menus_size ? root : MENU_EXIT;
+  machine->prompt = prompt;
+  machine->reader = reader;
+  machine->context = context;
+  machine->out = out;
+  machine->self_created = machine != at;
+  return machine;
+}
+
+void menu_machine_destroy(struct menu_machine *machine) {
+  if (machine == NULL)
+    return;
+  // Menus are static tables of the caller
+  if (machine->self_created)
+    free(machine);
+}
+
+static bool menu_item_available(const struct menu_item *item) {
+  return item->available == NULL || item->available();
+}
+
+static void menu_machine_show(struct menu_machine *machine) {
+  const struct menu *menu = machine->menus + machine->current;
+  fprintf(machine->out, "%s\n", menu->title);
+  // Items which close the menu go last, after an empty line
+  for (size_t i = 0; i < menu->items_size; ++i) {
+    if (menu->items[i].key != '0' && menu_item_available(menu->items + i))
+      fprintf(machine->out, "%c. %s\n", menu->items[i].key, menu->items[i].title);
+  }
+  for (size_t i = 0; i < menu->items_size; ++i) {
+    if (menu->items[i].key == '0' && menu_item_available(menu->items + i))
+      fprintf(machine->out, "\n%c. %s\n", menu->items[i].key, menu->items[i].title);
+  }
+}
+
+bool menu_machine_dispatch(struct menu_machine *machine, char key) {
+  if (machine->current == MENU_EXIT)
+    return false;
+  const struct menu *menu = machine->menus + machine->current;
+  const struct menu_item *item = NULL;
+  for (size_t i = 0; i < menu->items_size && item == NULL; ++i) {
+    if (menu->items[i].key == key && menu_item_available(menu->items + i))
+      item = menu->items + i;
+  }
+  if (item == NULL)
+    return false;
+
+  if (item->action != NULL)
+    item->action(machine);
+  // Action returns here instead of calling the next menu, so the stack doesn't grow
+  if (machine->current == MENU_EXIT)
+    return true; // Input was over in the middle of action
+  if (item->next == MENU_BACK)
+    machine->current = machine->current == machine->root ? MENU_EXIT : menu->parent;
+  else if (item->next != MENU_STAY)
+    machine->current = item->next < machine->menus_size ? item->next : MENU_EXIT;
+  return true;
+}
+
+const char *menu_machine_read(struct menu_machine *machine, const char *prompt) {
+  if (machine->current == MENU_EXIT)
+    return "";
+  const char *input = machine->reader(prompt, machine->context);
+  if (input == NULL) {
+    machine->current = MENU_EXIT; // Nobody is left to answer
+    return "";
+  }
+  return input;
+}
+
+bool menu_machine_stopped(struct menu_machine *machine) {
+  return machine->current == MENU_EXIT;
+}
+
+bool menu_machine_step(struct menu_machine *machine) {
+  if (machine->current == MENU_EXIT)
+    return false;
+  menu_machine_show(machine);
+  const char *input = menu_machine_read(machine, machine->prompt);
+  if (machine->current == MENU_EXIT)
+    return false;
+  // Unknown choice shows the same menu again
+  menu_machine_dispatch(machine, *input);
+  return machine->current != MENU_EXIT;
+}
+
+void menu_machine_run(struct menu_machine *machine) {
+  while (menu_machine_step(machine));
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "common.h"
+
+// Transitions of menu item besides the index of the next menu
+#define MENU_STAY (SIZE_MAX - 2) // Show the same menu again
+#define MENU_BACK (SIZE_MAX - 1) // Go to the parent menu, the root one exits
+#define MENU_EXIT SIZE_MAX
+
+struct menu_machine;
+
+// Reads the answers with menu_machine_read, so the reader of machine serves them too
+typedef void (*menu_action)(struct menu_machine *machine);
+// Item is shown and chosen only if it returns true
+typedef bool (*menu_condition)();
+// Shows the prompt and returns the choice, NULL when the input is over
+typedef const char *(*menu_reader)(const char *prompt, void *context);
+
+struct menu_item {
+  char key;
+  const char *title;
+  menu_action action; // May be NULL if the item only goes to another menu
+  size_t next; // Index of menu, or one of the transitions
+  menu_condition available; // NULL if the item is always available
+};
+
+struct menu {
+  const char *title;
+  const struct menu_item *items;
+  size_t items_size;
+  size_t parent; // Menu of MENU_BACK if this one isn't the root
+};
+
+/* State machine over the table of menus.
+ * Each step shows the current menu, reads the choice and runs the item, so a session of any length
+ * takes the same stack and memory. Item with '0' key goes after an empty line.
+ */
+struct menu_machine {
+  const struct menu *menus;
+  size_t menus_size;
+  size_t root;
+  size_t current; // MENU_EXIT once the machine has stopped
+  const char *prompt;
+  menu_reader reader;
+  void *context; // Passed to the reader
+  FILE *out;
+  bool self_created;
+};
+
+struct menu_machine *menu_machine_create(struct menu_machine *at,
+                                         const struct menu *menus,
+                                         size_t menus_size,
+                                         size_t root,
+                                         const char *prompt,
+                                         menu_reader reader,
+                                         void *context,
+                                         FILE *out);
+void menu_machine_destroy(struct menu_machine *machine);
+
+// Runs the item of the current menu by key without showing the menu, returns false if there is no such item
+bool menu_machine_dispatch(struct menu_machine *machine, char key);
+// Shows the prompt and returns the answer from the reader, it's empty once the input is over and the machine has stopped
+const char *menu_machine_read(struct menu_machine *machine, const char *prompt);
+// True after an item exited or the input is over, actions check it before using what they've read
+bool menu_machine_stopped(struct menu_machine *machine);
+// Shows the current menu, reads the choice and dispatches it, returns false once the machine has stopped
+bool menu_machine_step(struct menu_machine *machine);
+// Steps until an item exits or the input is over
+void menu_machine_run(struct menu_machine *machine);
@@ -0,0 +1,151 @@
+#include "metrics.h"
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#ifdef DZ_SEM_2_METRICS
+
+struct metrics_memory metrics_memory;
+
+// Operations which were called at least once, the last one is the head
+static struct metrics_operation *volatile metrics_operations = NULL;
+static int64_t metrics_frequency = 0;
+
+int64_t metrics_now() {
+  LARGE_INTEGER counter;
+  QueryPerformanceCounter(&counter);
+  return counter.QuadPart;
+}
+
+static size_t metrics_bucket_of(int64_t ns) {
+  // Position of the highest bit, the bucket of zero is the first one
+  size_t bucket = 0;
+  while (ns > 0 && bucket < METRICS_BUCKETS - 1) {
+    ns >>= 1;
+    ++bucket;
+  }
+  return bucket;
+}
+
+void metrics_record(struct metrics_operation *operation, int64_t start) {
+  int64_t ticks = metrics_now() - start;
+  if (metrics_frequency == 0) {
+    // Frequency is fixed at boot, so threads racing here write the same value
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    metrics_frequency = frequency.QuadPart;
+  }
+  // Split the ticks not to overflow on multiplication
+  int64_t ns = ticks / metrics_frequency * 1000000000LL + ticks % metrics_frequency * 1000000000LL / metrics_frequency;
+
+  if (InterlockedCompareExchange(&operation->registered, 1, 0) == 0) {
+    // Push the operation to the list without a lock
+    struct metrics_operation *head;
+    do {
+      head = metrics_operations;
+      operation->next = head;
+    } while (InterlockedCompareExchangePointer((PVOID volatile *)&metrics_operations, operation, head) != head);
+  }
+  InterlockedIncrement64(&operation->calls);
+  InterlockedExchangeAdd64(&operation->total_ns, ns);
+  InterlockedIncrement64(&operation->buckets[metrics_bucket_of(ns)]);
+  int64_t max = operation->max_ns;
+  while (ns > max) {
+    int64_t previous = InterlockedCompareExchange64(&operation->max_ns, ns, max);
+    if (previous == max)
+      break;
+    max = previous;
+  }
+}
+
+void metrics_add(volatile int64_t *counter, int64_t value) {
+  InterlockedExchangeAdd64(counter, value);
+}
+
+bool metrics_enabled() {
+  return true;
+}
+
+static int64_t metrics_percentile(const struct metrics_operation *operation, int64_t calls, int permille) {
+  // Upper bound of the bucket where the percentile falls, it can't be more than the slowest call
+  int64_t rank = (calls * permille + 999) / 1000;
+  int64_t seen = 0;
+  for (size_t bucket = 0; bucket < METRICS_BUCKETS; ++bucket) {
+    seen += operation->buckets[bucket];
+    if (seen >= rank) {
+      int64_t bound = bucket == 0 ? 0 : (int64_t)1 << bucket;
+      return bound < operation->max_ns ? bound : operation->max_ns;
+    }
+  }
+  return operation->max_ns;
+}
+
+static int metrics_operation_compare(const void *left, const void *right) {
+  return strcmp((*(struct metrics_operation *const *)left)->name, (*(struct metrics_operation *const *)right)->name);
+}
+
+void metrics_dump(FILE *fp) {
+  // Snapshot of the list in alphabetical order, the list itself only grows at the head
+  size_t size = 0;
+  for (struct metrics_operation *operation = metrics_operations; operation != NULL; operation = operation->next)
+    ++size;
+  struct metrics_operation **operations = malloc((size == 0 ? 1 : size) * sizeof(*operations));
+  if (operations == NULL)
+    return;
+  size_t position = 0;
+  for (struct metrics_operation *operation = metrics_operations; operation != NULL && position < size; operation = operation->next)
+    operations[position++] = operation;
+  qsort(operations, position, sizeof(*operations), metrics_operation_compare);
+
+  fprintf(fp, "%-36s %10s %12s %10s %10s %10s %10s %12s\n",
+          "operation", "calls", "total_ms", "mean_ns", "p50_ns", "p90_ns", "p99_ns", "max_ns");
+  for (size_t i = 0; i < position; ++i) {
+    struct metrics_operation *operation = operations[i];
+    int64_t calls = operation->calls;
+    if (calls == 0)
+      continue; // Was reset and not called since
+    fprintf(fp, "%-36s %10lld %12.3f %10lld %10lld %10lld %10lld %12lld\n",
+            operation->name,
+            (long long)calls,
+            (double)operation->total_ns / 1e6,
+            (long long)(operation->total_ns / calls),
+            (long long)metrics_percentile(operation, calls, 500),
+            (long long)metrics_percentile(operation, calls, 900),
+            (long long)metrics_percentile(operation, calls, 990),
+            (long long)operation->max_ns);
+  }
+  free(operations);
+
+  fprintf(fp, "allocated %lld bytes, %lld reallocations, moved %lld bytes\n",
+          (long long)metrics_memory.allocated_bytes,
+          (long long)metrics_memory.reallocations,
+          (long long)metrics_memory.moved_bytes);
+}
+
+void metrics_reset() {
+  for (struct metrics_operation *operation = metrics_operations; operation != NULL; operation = operation->next) {
+    InterlockedExchange64(&operation->calls, 0);
+    InterlockedExchange64(&operation->total_ns, 0);
+    InterlockedExchange64(&operation->max_ns, 0);
+    for (size_t bucket = 0; bucket < METRICS_BUCKETS; ++bucket)
+      InterlockedExchange64(&operation->buckets[bucket], 0);
+  }
+  InterlockedExchange64(&metrics_memory.allocated_bytes, 0);
+  InterlockedExchange64(&metrics_memory.reallocations, 0);
+  InterlockedExchange64(&metrics_memory.moved_bytes, 0);
+}
+
+#else
+
+bool metrics_enabled() {
+  return false;
+}
+
+void metrics_dump(FILE *fp) {
+  fprintf(fp, "metrics are disabled, build with DZ_SEM_2_METRICS\n");
+}
+
+void metrics_reset() {
+}
+
+#endif
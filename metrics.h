@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+// Latency of a call goes to the bucket of its highest bit, so the last one takes all of calls longer than 2^(N-1) ns
+#ifndef METRICS_BUCKETS
+#define METRICS_BUCKETS 40
+#endif
+
+/* Counters and latency histogram of one operation.
+ * Each instrumented function owns a static one, it joins the list of operations on the first call.
+ * Fields are updated by interlocked operations, so tables used by several threads are counted too.
+ */
+struct metrics_operation {
+  const char *name;
+  volatile int64_t calls;
+  volatile int64_t total_ns;
+  volatile int64_t max_ns;
+  volatile int64_t buckets[METRICS_BUCKETS];
+  volatile long registered;
+  struct metrics_operation *next;
+};
+
+// Memory traffic of the dynamic arrays
+struct metrics_memory {
+  volatile int64_t allocated_bytes; // Bytes the buffers grew by
+  volatile int64_t reallocations; // Calls of realloc for the buffers
+  volatile int64_t moved_bytes; // Bytes copied by realloc, memmove and compaction
+};
+
+#ifdef DZ_SEM_2_METRICS
+
+extern struct metrics_memory metrics_memory;
+
+int64_t metrics_now();
+void metrics_record(struct metrics_operation *operation, int64_t start);
+void metrics_add(volatile int64_t *counter, int64_t value);
+
+// Starts timing the function, must be in its scope before any METRICS_END
+#define METRICS_BEGIN(operation)                                               \
+  static struct metrics_operation metrics_this_operation = {.name = #operation}; \
+  int64_t metrics_start = metrics_now()
+// Goes before each return of the function which called METRICS_BEGIN
+#define METRICS_END() metrics_record(&metrics_this_operation, metrics_start)
+
+#define METRICS_ALLOCATED(bytes) metrics_add(&metrics_memory.allocated_bytes, (int64_t)(bytes))
+#define METRICS_REALLOCATED() metrics_add(&metrics_memory.reallocations, 1)
+#define METRICS_MOVED(bytes) metrics_add(&metrics_memory.moved_bytes, (int64_t)(bytes))
+
+#else
+
+// Without DZ_SEM_2_METRICS nothing is measured and the calls cost nothing
+#define METRICS_BEGIN(operation)
+#define METRICS_END() ((void)0)
+#define METRICS_ALLOCATED(bytes) ((void)0)
+#define METRICS_REALLOCATED() ((void)0)
+#define METRICS_MOVED(bytes) ((void)0)
+
+#endif
+
+// Whether the functions are measured in this build
+bool metrics_enabled();
+// Writes a line for each called operation with its latency percentiles, then the memory counters
+void metrics_dump(FILE *fp);
+// Zeroes all of the counters, operations stay in the list
+void metrics_reset();
@@ -0,0 +1,298 @@
+#include "ordered_index.h"
+
+static bool ordered_index_ops_insert(struct table_index *index, void *item) {
+  return ordered_index_insert((struct ordered_index *)index, item);
+}
+
+static bool ordered_index_ops_remove(struct table_index *index, void *item) {
+  return ordered_index_remove((struct ordered_index *)index, item);
+}
+
+static void *ordered_index_ops_find(struct table_index *index, const void *key) {
+  return ordered_index_find((struct ordered_index *)index, (const char *)key);
+}
+
+static size_t ordered_index_ops_find_all(struct table_index *index,
+                                         const void *key,
+                                         table_index_callback callback,
+                                         void *context) {
+  return ordered_index_find_all((struct ordered_index *)index, (const char *)key, callback, context);
+}
+
+static void ordered_index_ops_rebuild(struct table_index *index) {
+  ordered_index_rebuild((struct ordered_index *)index);
+}
+
+static void ordered_index_ops_flush(struct table_index *index) {
+  ordered_index_flush((struct ordered_index *)index);
+}
+
+static const struct table_index_ops ordered_index_ops = {
+    ordered_index_ops_insert,
+    ordered_index_ops_remove,
+    ordered_index_ops_find,
+    ordered_index_ops_find_all,
+    ordered_index_ops_rebuild,
+    ordered_index_ops_flush,
+};
+
+struct ordered_index *ordered_index_create(struct ordered_index *at,
+                                           struct dynamic_array *arr,
+                                           ordered_index_key_getter key_getter,
+                                           uint32_t fields) {
+  // Allocating a buffer for structure or use existing if index was provided as the first argument
+  struct ordered_index *index = at == NULL ? malloc(sizeof(*index)) : at;
+  index->base.ops = &ordered_index_ops;
+  index->base.arr = arr;
+  index->base.fields = fields;
+  index->entries = NULL;
+  index->size = 0;
+  index->capacity = 0;
+  index->sorted_size = 0;
+  index->merge_buffer = NULL;
+  index->merge_capacity = 0;
+  index->removed_size = 0;
+  string_arena_create(&index->keys);
+  index->key_getter = key_getter;
+  index->self_created = index != at;
+  return index;
+}
+
+static void ordered_index_clear(struct ordered_index *index) {
+  SAFE_FREE(index->entries);
+  SAFE_FREE(index->merge_buffer);
+  index->size = 0;
+  index->capacity = 0;
+  index->sorted_size = 0;
+  index->merge_capacity = 0;
+  index->removed_size = 0;
+  // Keys are freed by the chunks
+  string_arena_destroy(&index->keys);
+  string_arena_create(&index->keys);
+}
+
+void ordered_index_destroy(struct ordered_index *index) {
+  if (index == NULL)
+    return;
+  ordered_index_clear(index);
+  string_arena_destroy(&index->keys);
+  if (index->self_created)
+    free(index);
+}
+
+static int ordered_index_entry_compare(const struct ordered_index_entry *left,
+                                       const struct ordered_index_entry *right) {
+  int result = text_compare_ignore_case(left->key, right->key);
+  if (result != 0)
+    return result;
+  if (left->handle.slot != right->handle.slot)
+    return left->handle.slot < right->handle.slot ? -1 : 1;
+  if (left->handle.generation != right->handle.generation)
+    return left->handle.generation < right->handle.generation ? -1 : 1;
+  return 0;
+}
+
+static int ordered_index_entry_qsort_compare(const void *left, const void *right) {
+  return ordered_index_entry_compare(left, right);
+}
+
+static void ordered_index_merge(struct ordered_index *index) {
+  // Sort the stashed entries and merge them from the end, so each sorted entry is moved once
+  size_t pending_size = index->size - index->sorted_size;
+  if (pending_size == 0)
+    return;
+  struct ordered_index_entry *pending = index->entries + index->sorted_size;
+  qsort(pending, pending_size, sizeof(*pending), ordered_index_entry_qsort_compare);
+  if (index->sorted_size == 0 || ordered_index_entry_compare(pending - 1, pending) < 0) {
+    // Stashed entries go after all of the sorted ones, it's the case of loading
+    index->sorted_size = index->size;
+    return;
+  }
+
+  // Entries are stashed after the sorted ones only with the reserved space for them
+  struct ordered_index_entry *copy = index->merge_buffer;
+  memcpy(copy, pending, pending_size * sizeof(*copy));
+  size_t sorted = index->sorted_size;
+  size_t stashed = pending_size;
+  size_t out = index->size;
+  while (stashed > 0) {
+    if (sorted > 0 && ordered_index_entry_compare(index->entries + sorted - 1, copy + stashed - 1) > 0)
+      index->entries[--out] = index->entries[--sorted];
+    else
+      index->entries[--out] = copy[--stashed];
+  }
+  index->sorted_size = index->size;
+}
+
+static size_t ordered_index_lower_bound(struct ordered_index *index, const struct ordered_index_entry *entry) {
+  // The first entry which is not less than given one
+  size_t first = 0;
+  size_t last = index->sorted_size;
+  while (first < last) {
+    size_t middle = first + (last - first) / 2;
+    if (ordered_index_entry_compare(index->entries + middle, entry) < 0)
+      first = middle + 1;
+    else
+      last = middle;
+  }
+  return first;
+}
+
+static size_t ordered_index_key_bound(struct ordered_index *index, const char *key, bool upper) {
+  // The first entry with key not less than given one, or greater than it when upper bound is asked
+  size_t first = 0;
+  size_t last = index->sorted_size;
+  while (first < last) {
+    size_t middle = first + (last - first) / 2;
+    int result = text_compare_ignore_case(index->entries[middle].key, key);
+    if (result < 0 || (upper && result == 0))
+      first = middle + 1;
+    else
+      last = middle;
+  }
+  return first;
+}
+
+static void ordered_index_drop_removed(struct ordered_index *index) {
+  // Removed entries are moved out at once, so mass removal is linear
+  size_t live_size = 0;
+  for (size_t i = 0; i < index->size; ++i) {
+    if (dynamic_array_handle_is_null(index->entries[i].handle)) {
+      string_arena_release(&index->keys, index->entries[i].key);
+      continue;
+    }
+    index->entries[live_size++] = index->entries[i];
+  }
+  index->size = live_size;
+  index->sorted_size = live_size;
+  index->removed_size = 0;
+}
+
+bool ordered_index_insert(struct ordered_index *index, void *item) {
+  struct dynamic_array_handle handle = dynamic_array_handle_of(index->base.arr, item);
+  if (dynamic_array_handle_is_null(handle))
+    return false;
+  if (index->size == index->capacity) {
+    size_t capacity = index->capacity < ORDERED_INDEX_MIN_CAPACITY ? ORDERED_INDEX_MIN_CAPACITY : index->capacity * 2;
+    struct ordered_index_entry *entries = realloc(index->entries, capacity * sizeof(*entries));
+    if (entries == NULL)
+      return false;
+    index->entries = entries;
+    index->capacity = capacity;
+  }
+  if (index->sorted_size > 0 && index->merge_capacity < index->size - index->sorted_size + 1) {
+    // Loading stashes everything before the first merge, so it needs no copy and reserves nothing
+    size_t capacity = index->merge_capacity < ORDERED_INDEX_MIN_CAPACITY ? ORDERED_INDEX_MIN_CAPACITY : index->merge_capacity * 2;
+    struct ordered_index_entry *merge_buffer = realloc(index->merge_buffer, capacity * sizeof(*merge_buffer));
+    if (merge_buffer == NULL)
+      return false;
+    index->merge_buffer = merge_buffer;
+    index->merge_capacity = capacity;
+  }
+  const char *key = string_arena_copy(&index->keys, index->key_getter(item));
+  if (key == NULL)
+    return false;
+  // Stash the entry, it's merged before the next search
+  index->entries[index->size].key = key;
+  index->entries[index->size].handle = handle;
+  ++index->size;
+  return true;
+}
+
+bool ordered_index_remove(struct ordered_index *index, void *item) {
+  struct ordered_index_entry entry;
+  entry.key = index->key_getter(item);
+  entry.handle = dynamic_array_handle_of(index->base.arr, item);
+  if (dynamic_array_handle_is_null(entry.handle))
+    return false;
+  ordered_index_merge(index);
+  size_t position = ordered_index_lower_bound(index, &entry);
+  if (position == index->sorted_size || ordered_index_entry_compare(index->entries + position, &entry) != 0)
+    return false;
+  // Zero generation sorts before any live one of the same slot, so the order is kept
+  index->entries[position].handle.generation = 0;
+  ++index->removed_size;
+  if (index->removed_size * 100 > index->size * ORDERED_INDEX_MAX_REMOVED_PERCENT)
+    ordered_index_drop_removed(index);
+  return true;
+}
+
+struct ordered_index_iterator ordered_index_equal_range(struct ordered_index *index, const char *key) {
+  ordered_index_merge(index);
+  struct ordered_index_iterator iterator;
+  iterator.index = index;
+  iterator.position = ordered_index_key_bound(index, key, false);
+  iterator.end = ordered_index_key_bound(index, key, true);
+  return iterator;
+}
+
+struct ordered_index_iterator ordered_index_prefix_range(struct ordered_index *index, const char *prefix) {
+  ordered_index_merge(index);
+  struct ordered_index_iterator iterator;
+  iterator.index = index;
+  iterator.position = ordered_index_key_bound(index, prefix, false);
+  // Keys with the prefix go one after another from the lower bound of prefix
+  size_t first = iterator.position;
+  size_t last = index->sorted_size;
+  while (first < last) {
+    size_t middle = first + (last - first) / 2;
+    if (text_starts_with_ignore_case(index->entries[middle].key, prefix))
+      first = middle + 1;
+    else
+      last = middle;
+  }
+  iterator.end = first;
+  return iterator;
+}
+
+void *ordered_index_next(struct ordered_index_iterator *iterator) {
+  while (iterator->position < iterator->end) {
+    struct ordered_index_entry *entry = iterator->index->entries + iterator->position++;
+    if (dynamic_array_handle_is_null(entry->handle))
+      continue; // Removed
+    void *item = dynamic_array_resolve(iterator->index->base.arr, entry->handle);
+    if (item != NULL)
+      return item;
+  }
+  return NULL;
+}
+
+void *ordered_index_find(struct ordered_index *index, const char *key) {
+  struct ordered_index_iterator iterator = ordered_index_equal_range(index, key);
+  return ordered_index_next(&iterator);
+}
+
+size_t ordered_index_find_all(struct ordered_index *index,
+                              const char *key,
+                              table_index_callback callback,
+                              void *context) {
+  struct ordered_index_iterator iterator = ordered_index_equal_range(index, key);
+  size_t found = 0;
+  void *item;
+  while ((item = ordered_index_next(&iterator)) != NULL) {
+    ++found;
+    // Callback may be omitted to only count the items
+    if (callback != NULL && !callback(item, context))
+      break;
+  }
+  return found;
+}
+
+void ordered_index_rebuild(struct ordered_index *index) {
+  // Drop all of the entries, stash each item of dynamic array again and sort them once
+  ordered_index_clear(index);
+  size_t size = dynamic_array_size(index->base.arr);
+  for (size_t position = 0; position < size; ++position) {
+    if (!dynamic_array_is_dead(index->base.arr, position))
+      ordered_index_insert(index, dynamic_array_get_at(index->base.arr, position));
+  }
+  ordered_index_merge(index);
+}
+
+void ordered_index_flush(struct ordered_index *index) {
+  ordered_index_merge(index);
+}
+
+size_t ordered_index_size(struct ordered_index *index) {
+  return index->size - index->removed_size;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "dynamic_array.h"
+#include "index_registry.h"
+#include "string_arena.h"
+#include "text.h"
+#include "common.h"
+
+#ifndef ORDERED_INDEX_MIN_CAPACITY
+#define ORDERED_INDEX_MIN_CAPACITY 16
+#endif
+
+// Removed entries are dropped when there are more of them than this percent of entries
+#ifndef ORDERED_INDEX_MAX_REMOVED_PERCENT
+#define ORDERED_INDEX_MAX_REMOVED_PERCENT 25
+#endif
+
+typedef const char *(*ordered_index_key_getter)(void *item);
+
+// Copy of the key is kept next to the handle, so the search doesn't resolve items
+struct ordered_index_entry {
+  const char *key;
+  struct dynamic_array_handle handle; // Removed entry keeps its place with zero generation
+};
+
+/* Index by string key ignoring case, which keeps items with equal keys next to each other.
+ * Entries are sorted by key, items with the same key are sorted by handle.
+ * Inserted entries are stashed unsorted and merged before the next search, so loading
+ * of the whole table costs one sort instead of a shift per item. After ordered_index_flush searches
+ * only read the index until the next insert, so they may run at the same time.
+ * Removed entries are only marked and dropped all at once, their keys stay in the arena until then.
+ */
+struct ordered_index {
+  struct table_index base; // Must be the first, registry passes the index by base pointer
+  struct ordered_index_entry *entries;
+  size_t size;
+  size_t capacity;
+  size_t sorted_size; // Entries after this position are not merged yet
+  // Stash is copied here to be merged with the sorted entries, insert reserves it, so the merge never fails
+  struct ordered_index_entry *merge_buffer;
+  size_t merge_capacity;
+  size_t removed_size;
+  struct string_arena keys;
+  ordered_index_key_getter key_getter;
+  bool self_created;
+};
+
+// Iterates over the range of entries, it's invalidated by the changes of index
+struct ordered_index_iterator {
+  struct ordered_index *index;
+  size_t position;
+  size_t end;
+};
+
+struct ordered_index *ordered_index_create(struct ordered_index *at,
+                                           struct dynamic_array *arr,
+                                           ordered_index_key_getter key_getter,
+                                           uint32_t fields);
+void ordered_index_destroy(struct ordered_index *index);
+
+bool ordered_index_insert(struct ordered_index *index, void *item);
+bool ordered_index_remove(struct ordered_index *index, void *item);
+void *ordered_index_find(struct ordered_index *index, const char *key);
+size_t ordered_index_find_all(struct ordered_index *index,
+                              const char *key,
+                              table_index_callback callback,
+                              void *context);
+void ordered_index_rebuild(struct ordered_index *index);
+// Merges the stashed entries, searches don't change the index after that
+void ordered_index_flush(struct ordered_index *index);
+
+// Both of them take O(log N), then each item is taken by ordered_index_next
+struct ordered_index_iterator ordered_index_equal_range(struct ordered_index *index, const char *key);
+struct ordered_index_iterator ordered_index_prefix_range(struct ordered_index *index, const char *prefix);
+// Returns the next item of range or NULL at the end
+void *ordered_index_next(struct ordered_index_iterator *iterator);
+
+// Amount of indexed items
+size_t ordered_index_size(struct ordered_index *index);
@@ -0,0 +1,96 @@
+#include "output_buffer.h"
+
+struct output_buffer *output_buffer_create(struct output_buffer *at, FILE *fp) {
+  // Allocating a buffer for structure or use existing if buffer was provided as the first argument
+  struct output_buffer *buffer = at == NULL ? malloc(sizeof(*buffer)) : at;
+  buffer->fp = fp;
+  buffer->data = malloc(OUTPUT_BUFFER_CAPACITY);
+  buffer->size = 0;
+  buffer->capacity = buffer->data == NULL ? 0 : OUTPUT_BUFFER_CAPACITY;
+  buffer->failed = buffer->data == NULL;
+  buffer->self_created = buffer != at;
+  return buffer;
+}
+
+bool output_buffer_destroy(struct output_buffer *buffer) {
+  if (buffer == NULL)
+    return false;
+  bool written = output_buffer_flush(buffer);
+  SAFE_FREE(buffer->data);
+  buffer->size = 0;
+  buffer->capacity = 0;
+  if (buffer->self_created)
+    free(buffer);
+  return written;
+}
+
+bool output_buffer_flush(struct output_buffer *buffer) {
+  if (!buffer->failed && buffer->size > 0)
+    buffer->failed = fwrite(buffer->data, sizeof(char), buffer->size, buffer->fp) != buffer->size;
+  buffer->size = 0;
+  return !buffer->failed;
+}
+
+static bool output_buffer_reserve(struct output_buffer *buffer, size_t size) {
+  if (buffer->failed)
+    return false;
+  if (buffer->capacity - buffer->size >= size)
+    return true;
+  if (!output_buffer_flush(buffer))
+    return false;
+  if (buffer->capacity >= size)
+    return true;
+  // The value doesn't fit even into the empty buffer
+  char *data = realloc(buffer->data, size);
+  if (data == NULL) {
+    buffer->failed = true;
+    return false;
+  }
+  buffer->data = data;
+  buffer->capacity = size;
+  return true;
+}
+
+void output_buffer_write(struct output_buffer *buffer, const char *data, size_t size) {
+  if (!output_buffer_reserve(buffer, size))
+    return;
+  memcpy(buffer->data + buffer->size, data, size);
+  buffer->size += size;
+}
+
+void output_buffer_write_char(struct output_buffer *buffer, char c) {
+  if (!output_buffer_reserve(buffer, 1))
+    return;
+  buffer->data[buffer->size++] = c;
+}
+
+void output_buffer_write_string(struct output_buffer *buffer, const char *str) {
+  output_buffer_write(buffer, str, strlen(str));
+}
+
+void output_buffer_write_uint(struct output_buffer *buffer, uint64_t value) {
+  // Digits are made from the end, uint64 has 20 of them at most
+  char digits[20];
+  size_t position = sizeof(digits);
+  do {
+    digits[--position] = (char)('0' + value % 10);
+    value /= 10;
+  } while (value != 0);
+  output_buffer_write(buffer, digits + position, sizeof(digits) - position);
+}
+
+void output_buffer_write_csv_field(struct output_buffer *buffer, const char *str) {
+  size_t length = strcspn(str, ";\"\r\n");
+  if (str[length] == '\0') {
+    output_buffer_write(buffer, str, length);
+    return;
+  }
+  // Quote the field and double quotes inside of it
+  output_buffer_write_char(buffer, '"');
+  for (const char *quote; (quote = strchr(str, '"')) != NULL; str = quote + 1) {
+    output_buffer_write(buffer, str, quote - str + 1);
+    output_buffer_write_char(buffer, '"');
+  }
+  output_buffer_write_string(buffer, str);
+  output_buffer_write_char(buffer, '"');
+}
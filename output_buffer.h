@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "common.h"
+
+// Data goes to the file in blocks of this size
+#ifndef OUTPUT_BUFFER_CAPACITY
+#define OUTPUT_BUFFER_CAPACITY (1024 * 1024)
+#endif
+
+/* Buffered writer for the table exports.
+ * Values are formatted right into the buffer, which is flushed with one fwrite when it's full.
+ * Value larger than the buffer makes it grow, so nothing gets truncated.
+ */
+struct output_buffer {
+  FILE *fp;
+  char *data;
+  size_t size;
+  size_t capacity;
+  bool failed; // Set when write to the file or allocation fails, all of next writes are ignored
+  bool self_created;
+};
+
+struct output_buffer *output_buffer_create(struct output_buffer *at, FILE *fp);
+// Flushes the rest of data, returns false if anything wasn't written
+bool output_buffer_destroy(struct output_buffer *buffer);
+
+bool output_buffer_flush(struct output_buffer *buffer);
+
+void output_buffer_write(struct output_buffer *buffer, const char *data, size_t size);
+void output_buffer_write_char(struct output_buffer *buffer, char c);
+void output_buffer_write_string(struct output_buffer *buffer, const char *str);
+void output_buffer_write_uint(struct output_buffer *buffer, uint64_t value);
+// Writes CSV field, quoted if it has a delimiter, quote or line break
+void output_buffer_write_csv_field(struct output_buffer *buffer, const char *str);
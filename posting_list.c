@@ -0,0 +1,133 @@
+#include "posting_list.h"
+
+void posting_list_clear(struct posting_list *list) {
+  SAFE_FREE(list->postings);
+  list->size = 0;
+  list->capacity = 0;
+  list->removed_size = 0;
+}
+
+size_t posting_list_bound(const struct posting_list *list, size_t first, uint32_t slot) {
+  size_t last = list->size;
+  while (first < last) {
+    size_t middle = first + (last - first) / 2;
+    if (list->postings[middle].slot < slot)
+      first = middle + 1;
+    else
+      last = middle;
+  }
+  return first;
+}
+
+size_t posting_list_live_size(const struct posting_list *list) {
+  return list->size - list->removed_size;
+}
+
+bool posting_list_add(struct posting_list *list, struct dynamic_array_handle handle, bool append) {
+  size_t position = list->size;
+  if (append && list->size > 0 && dynamic_array_handle_equals(list->postings[list->size - 1], handle))
+    return true; // The same word twice in a row
+  if (!append && list->size > 0 && list->postings[list->size - 1].slot >= handle.slot) {
+    position = posting_list_bound(list, 0, handle.slot);
+    if (list->postings[position].slot == handle.slot) {
+      // The same word twice in the item, or the slot of removed item which is taken again
+      if (dynamic_array_handle_is_null(list->postings[position]))
+        --list->removed_size;
+      list->postings[position] = handle;
+      return true;
+    }
+  }
+  if (list->size == list->capacity) {
+    size_t capacity = list->capacity == 0 ? 4 : list->capacity * 2;
+    struct dynamic_array_handle *postings = realloc(list->postings, capacity * sizeof(*postings));
+    if (postings == NULL)
+      return false;
+    list->postings = postings;
+    list->capacity = capacity;
+  }
+  memmove(list->postings + position + 1, list->postings + position, (list->size - position) * sizeof(*list->postings));
+  list->postings[position] = handle;
+  ++list->size;
+  return true;
+}
+
+static void posting_list_drop_removed(struct posting_list *list) {
+  size_t live_size = 0;
+  for (size_t i = 0; i < list->size; ++i) {
+    if (!dynamic_array_handle_is_null(list->postings[i]))
+      list->postings[live_size++] = list->postings[i];
+  }
+  list->size = live_size;
+  list->removed_size = 0;
+}
+
+void posting_list_remove(struct posting_list *list, struct dynamic_array_handle handle) {
+  size_t position = posting_list_bound(list, 0, handle.slot);
+  if (position == list->size || !dynamic_array_handle_equals(list->postings[position], handle))
+    return; // The same word twice in the item, it's removed already
+  // Mark the posting instead of moving the rest of list, zero generation keeps the place of slot
+  list->postings[position].generation = 0;
+  ++list->removed_size;
+  if (list->removed_size * 100 > list->size * POSTING_LIST_MAX_REMOVED_PERCENT)
+    posting_list_drop_removed(list);
+}
+
+static int posting_list_compare(const void *left, const void *right) {
+  const struct dynamic_array_handle *left_handle = (const struct dynamic_array_handle *)left;
+  const struct dynamic_array_handle *right_handle = (const struct dynamic_array_handle *)right;
+  if (left_handle->slot != right_handle->slot)
+    return left_handle->slot < right_handle->slot ? -1 : 1;
+  return 0;
+}
+
+void posting_list_sort(struct posting_list *list) {
+  if (list->size == 0)
+    return;
+  qsort(list->postings, list->size, sizeof(*list->postings), posting_list_compare);
+  // Item with the same word twice got two postings
+  size_t unique = 1;
+  for (size_t i = 1; i < list->size; ++i) {
+    if (list->postings[i].slot != list->postings[unique - 1].slot)
+      list->postings[unique++] = list->postings[i];
+  }
+  list->size = unique;
+}
+
+size_t posting_list_intersect(struct posting_list **lists, size_t lists_size, struct dynamic_array_handle **result) {
+  *result = NULL;
+  if (lists_size == 0)
+    return 0;
+  size_t shortest = 0;
+  for (size_t list = 1; list < lists_size; ++list) {
+    if (posting_list_live_size(lists[list]) < posting_list_live_size(lists[shortest]))
+      shortest = list;
+  }
+  if (posting_list_live_size(lists[shortest]) == 0)
+    return 0;
+
+  size_t candidates_size = 0;
+  struct dynamic_array_handle *candidates = malloc(posting_list_live_size(lists[shortest]) * sizeof(*candidates));
+  if (candidates == NULL)
+    return 0;
+  for (size_t i = 0; i < lists[shortest]->size; ++i) {
+    if (!dynamic_array_handle_is_null(lists[shortest]->postings[i]))
+      candidates[candidates_size++] = lists[shortest]->postings[i];
+  }
+  // Candidates are sorted by slot too, so each list is searched from the position of the previous candidate
+  for (size_t list = 0; list < lists_size && candidates_size > 0; ++list) {
+    if (list == shortest)
+      continue;
+    size_t matched = 0;
+    size_t position = 0;
+    for (size_t i = 0; i < candidates_size; ++i) {
+      position = posting_list_bound(lists[list], position, candidates[i].slot);
+      if (position == lists[list]->size)
+        break;
+      if (dynamic_array_handle_equals(lists[list]->postings[position], candidates[i]))
+        candidates[matched++] = candidates[i];
+    }
+    candidates_size = matched;
+  }
+  *result = candidates;
+  return candidates_size;
+}
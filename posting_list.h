@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "dynamic_array.h"
+#include "common.h"
+
+// Removed postings are dropped when there are more of them than this percent of list
+#ifndef POSTING_LIST_MAX_REMOVED_PERCENT
+#define POSTING_LIST_MAX_REMOVED_PERCENT 25
+#endif
+
+/* Handles of items which have some word or trigram, sorted by slot.
+ * Removed posting keeps its place with zero generation, the item which gets the slot next reuses it.
+ * Zeroed structure is an empty list.
+ */
+struct posting_list {
+  struct dynamic_array_handle *postings;
+  size_t size;
+  size_t capacity;
+  size_t removed_size;
+};
+
+void posting_list_clear(struct posting_list *list);
+
+// Appending doesn't look for the place of slot, list must be sorted by posting_list_sort after that
+bool posting_list_add(struct posting_list *list, struct dynamic_array_handle handle, bool append);
+void posting_list_remove(struct posting_list *list, struct dynamic_array_handle handle);
+void posting_list_sort(struct posting_list *list);
+
+// The first posting in [first, size) with slot not less than the provided one
+size_t posting_list_bound(const struct posting_list *list, size_t first, uint32_t slot);
+size_t posting_list_live_size(const struct posting_list *list);
+
+/* Handles which are in each of lists, sorted by slot.
+ * Candidates of the shortest list are checked by the rest of lists, so it takes O(k log N) for k candidates.
+ * Returns the amount of handles, the array must be freed by caller.
+ */
+size_t posting_list_intersect(struct posting_list **lists, size_t lists_size, struct dynamic_array_handle **result);
@@ -0,0 +1,327 @@
+#include <winsock2.h>
+#include <afunix.h>
+#include <windows.h>
+
+#include "server.h"
+
+struct server_client {
+  SOCKET socket;
+  struct batch_session session;
+  char input[BATCH_MAX_LINE + 2]; // Received part of the next commands
+  size_t input_size;
+  bool skipping; // Rest of the long line is dropped
+  char *output; // Responses which weren't sent yet
+  size_t output_sent;
+  size_t output_size;
+  size_t output_capacity;
+  bool finished; // Client won't send more, it's closed once the responses are sent
+};
+
+struct server *server_create(struct server *at, const struct batch_session *defaults, size_t max_clients) {
+  // Allocating a buffer for structure or use existing if server was provided as the first argument
+  struct server *server = at == NULL ? malloc(sizeof(*server)) : at;
+  server->listener = (uintptr_t)INVALID_SOCKET;
+  server->path[0] = '\0';
+  server->defaults = *defaults;
+  server->defaults.user_name[0] = '\0';
+  server->defaults.logged_in = false;
+  server->defaults.can_view_edit_books = false;
+  server->defaults.can_view_edit_students = false;
+  server->defaults.self_created = false;
+  server->clients = NULL;
+  server->clients_size = 0;
+  server->max_clients = max_clients == 0 ? SERVER_MAX_CLIENTS : max_clients;
+  server->poll_fds = NULL;
+  server->stopping = false;
+  server->listening = false;
+  server->address_in_use = false;
+  server->self_created = server != at;
+  return server;
+}
+
+static void server_client_close(struct server *server, size_t position) {
+  struct server_client *client = server->clients + position;
+  closesocket(client->socket);
+  batch_session_destroy(&client->session);
+  SAFE_FREE(client->output);
+  // Order of clients doesn't matter, the last one takes the place
+  if (position != --server->clients_size)
+    *client = server->clients[server->clients_size];
+}
+
+void server_destroy(struct server *server) {
+  if (server == NULL)
+    return;
+  while (server->clients_size > 0)
+    server_client_close(server, server->clients_size - 1);
+  if ((SOCKET)server->listener != INVALID_SOCKET)
+    closesocket((SOCKET)server->listener);
+  if (server->listening) {
+    DeleteFileA(server->path);
+    WSACleanup();
+  }
+  SAFE_FREE(server->clients);
+  SAFE_FREE(server->poll_fds);
+  if (server->self_created)
+    free(server);
+}
+
+static bool server_is_stale_socket(const SOCKADDR_UN *address) {
+  // Socket files are reparse points with their own tag, any other file at the path is not ours to remove
+  WIN32_FIND_DATAA data;
+  HANDLE find = FindFirstFileA(address->sun_path, &data);
+  if (find == INVALID_HANDLE_VALUE)
+    return false;
+  FindClose(find);
+  if ((data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) == 0 || data.dwReserved0 != IO_REPARSE_TAG_AF_UNIX)
+    return false;
+  // Socket of the running server accepts connections, the one left by a crash doesn't
+  SOCKET probe = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (probe == INVALID_SOCKET)
+    return false;
+  bool alive = connect(probe, (const struct sockaddr *)address, sizeof(*address)) != SOCKET_ERROR;
+  closesocket(probe);
+  return !alive;
+}
+
+bool server_listen(struct server *server, const char *path) {
+  SOCKADDR_UN address;
+  if (server->listening || strlen(path) >= sizeof(address.sun_path) || strlen(path) >= sizeof(server->path))
+    return false;
+  WSADATA data;
+  if (WSAStartup(MAKEWORD(2, 2), &data) != 0)
+    return false;
+
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strcpy_s(address.sun_path, sizeof(address.sun_path), path);
+  // Socket file of the previous run is left if it wasn't stopped properly, bind fails on anything else
+  if (server_is_stale_socket(&address))
+    DeleteFileA(path);
+
+  SOCKET listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  u_long non_blocking = 1;
+  if (listener == INVALID_SOCKET
+      || bind(listener, (struct sockaddr *)&address, sizeof(address)) == SOCKET_ERROR
+      || listen(listener, SOMAXCONN) == SOCKET_ERROR
+      || ioctlsocket(listener, FIONBIO, &non_blocking) == SOCKET_ERROR) {
+    server->address_in_use = WSAGetLastError() == WSAEADDRINUSE;
+    if (listener != INVALID_SOCKET)
+      closesocket(listener);
+    WSACleanup();
+    return false;
+  }
+  server->listener = (uintptr_t)listener;
+  strcpy_s(server->path, sizeof(server->path), path);
+  server->listening = true;
+  return true;
+}
+
+static bool server_client_respond(struct server_client *client, const char *response) {
+  size_t length = strlen(response);
+  if (client->output_size + length + 1 > client->output_capacity) {
+    if (client->output_sent > 0) {
+      // Sent part is dropped before the buffer grows
+      memmove(client->output, client->output + client->output_sent, client->output_size - client->output_sent);
+      client->output_size -= client->output_sent;
+      client->output_sent = 0;
+    }
+    if (client->output_size + length + 1 > client->output_capacity) {
+      size_t capacity = client->output_capacity == 0 ? BATCH_MAX_RESPONSE : client->output_capacity;
+      while (client->output_size + length + 1 > capacity)
+        capacity *= 2;
+      char *output = realloc(client->output, capacity);
+      if (output == NULL)
+        return false;
+      client->output = output;
+      client->output_capacity = capacity;
+    }
+  }
+  memcpy(client->output + client->output_size, response, length);
+  client->output_size += length;
+  client->output[client->output_size++] = '\n';
+  return true;
+}
+
+static size_t server_client_pending(struct server_client *client) {
+  return client->output_size - client->output_sent;
+}
+
+static bool server_client_has_line(struct server_client *client) {
+  return memchr(client->input, '\n', client->input_size) != NULL;
+}
+
+static bool server_client_wants_input(struct server_client *client) {
+  // Client which doesn't take its responses isn't read until it does
+  return !client->finished
+      && client->input_size < sizeof(client->input) - 1
+      && server_client_pending(client) < SERVER_MAX_PENDING_OUTPUT;
+}
+
+static bool server_client_execute(struct server_client *client) {
+  // Buffer is shared by all clients, they are served one by one
+  static char response[BATCH_MAX_RESPONSE];
+  size_t processed = 0;
+  bool succeeded = true;
+  while (succeeded && server_client_pending(client) < SERVER_MAX_PENDING_OUTPUT) {
+    char *line = client->input + processed;
+    char *end = memchr(line, '\n', client->input_size - processed);
+    if (end == NULL)
+      break;
+    processed = end - client->input + 1;
+    *end = '\0';
+    if (end > line && end[-1] == '\r')
+      end[-1] = '\0';
+    if (client->skipping) {
+      client->skipping = false; // Error was sent when the line didn't fit
+      continue;
+    }
+    if (*line == '\0' || *line == '#')
+      continue; // Empty lines and comments
+    batch_execute(&client->session, line, response, sizeof(response));
+    succeeded = server_client_respond(client, response);
+  }
+  memmove(client->input, client->input + processed, client->input_size - processed);
+  client->input_size -= processed;
+
+  if (succeeded && client->input_size == sizeof(client->input) - 1 && !server_client_has_line(client)) {
+    // Line doesn't fit, the rest of it will be dropped as it comes
+    client->input_size = 0;
+    client->skipping = true;
+    succeeded = server_client_respond(client, "ERR;line is too long");
+  }
+  return succeeded;
+}
+
+static bool server_client_receive(struct server_client *client) {
+  int received = recv(client->socket,
+                      client->input + client->input_size,
+                      (int)(sizeof(client->input) - 1 - client->input_size),
+                      0);
+  if (received == 0) {
+    // The last command may have no line break, buffer always has a byte for it
+    if (client->input_size > 0 && client->input[client->input_size - 1] != '\n')
+      client->input[client->input_size++] = '\n';
+    client->finished = true;
+    return true;
+  }
+  if (received == SOCKET_ERROR)
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+  client->input_size += (size_t)received;
+  return true;
+}
+
+static bool server_client_send(struct server_client *client) {
+  while (server_client_pending(client) > 0) {
+    int sent = send(client->socket, client->output + client->output_sent, (int)server_client_pending(client), 0);
+    if (sent == SOCKET_ERROR)
+      return WSAGetLastError() == WSAEWOULDBLOCK;
+    client->output_sent += (size_t)sent;
+  }
+  client->output_sent = 0;
+  client->output_size = 0;
+  return true;
+}
+
+static void server_accept(struct server *server) {
+  // Listener is level-triggered, so everyone waiting is taken at once
+  while (true) {
+    SOCKET socket = accept((SOCKET)server->listener, NULL, NULL);
+    if (socket == INVALID_SOCKET)
+      return;
+    u_long non_blocking = 1;
+    if (server->clients_size == server->max_clients || ioctlsocket(socket, FIONBIO, &non_blocking) == SOCKET_ERROR) {
+      static const char refusal[] = "ERR;too many clients\n";
+      send(socket, refusal, sizeof(refusal) - 1, 0);
+      closesocket(socket);
+      continue;
+    }
+
+    if (server->clients_size % 16 == 0) {
+      // Poll needs a slot for the listener
+      size_t capacity = server->clients_size + 16;
+      struct server_client *clients = realloc(server->clients, capacity * sizeof(*clients));
+      if (clients != NULL)
+        server->clients = clients;
+      WSAPOLLFD *poll_fds = realloc(server->poll_fds, (capacity + 1) * sizeof(*poll_fds));
+      if (poll_fds != NULL)
+        server->poll_fds = poll_fds;
+      if (clients == NULL || poll_fds == NULL) {
+        closesocket(socket);
+        continue;
+      }
+    }
+    struct server_client *client = server->clients + server->clients_size++;
+    client->socket = socket;
+    client->session = server->defaults;
+    client->input_size = 0;
+    client->skipping = false;
+    client->output = NULL;
+    client->output_sent = 0;
+    client->output_size = 0;
+    client->output_capacity = 0;
+    client->finished = false;
+  }
+}
+
+bool server_poll(struct server *server, int timeout_ms) {
+  if (!server->listening)
+    return false;
+  if (server->poll_fds == NULL && (server->poll_fds = malloc(sizeof(WSAPOLLFD))) == NULL)
+    return false;
+
+  WSAPOLLFD *poll_fds = server->poll_fds;
+  poll_fds[0].fd = (SOCKET)server->listener;
+  poll_fds[0].events = POLLIN;
+  poll_fds[0].revents = 0;
+  for (size_t i = 0; i < server->clients_size; ++i) {
+    struct server_client *client = server->clients + i;
+    poll_fds[i + 1].fd = client->socket;
+    poll_fds[i + 1].events = 0;
+    if (server_client_wants_input(client))
+      poll_fds[i + 1].events |= POLLIN;
+    if (server_client_pending(client) > 0)
+      poll_fds[i + 1].events |= POLLOUT;
+    poll_fds[i + 1].revents = 0;
+  }
+  if (WSAPoll(poll_fds, (unsigned long)(server->clients_size + 1), timeout_ms) == SOCKET_ERROR)
+    return WSAGetLastError() == WSAEINTR;
+
+  // Backwards, so the last client moved to the place of closed one is already served
+  for (size_t i = server->clients_size; i-- > 0;) {
+    struct server_client *client = server->clients + i;
+    short events = poll_fds[i + 1].revents;
+    bool alive = (events & POLLNVAL) == 0;
+    // Hang up is reported even if the input wasn't asked for, the rest of input is read when there is room
+    if (alive && (events & (POLLIN | POLLHUP | POLLERR)) != 0 && server_client_wants_input(client))
+      alive = server_client_receive(client);
+    // Lines left by the full output are run as soon as it's sent
+    while (alive) {
+      alive = server_client_execute(client) && server_client_send(client);
+      if (server_client_pending(client) > 0 || !server_client_has_line(client))
+        break;
+    }
+    // Finished client is closed once each of its commands got the response
+    if (!alive || (client->finished && server_client_pending(client) == 0 && !server_client_has_line(client)))
+      server_client_close(server, i);
+  }
+  if ((poll_fds[0].revents & POLLIN) != 0)
+    server_accept(server);
+  return true;
+}
+
+bool server_run(struct server *server) {
+  while (!server->stopping) {
+    if (!server_poll(server, SERVER_POLL_TIMEOUT_MS))
+      return false;
+  }
+  return true;
+}
+
+void server_stop(struct server *server) {
+  server->stopping = true;
+}
+
+size_t server_clients(struct server *server) {
+  return server->clients_size;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "batch.h"
+#include "common.h"
+
+#ifndef SERVER_MAX_CLIENTS
+#define SERVER_MAX_CLIENTS 1024
+#endif
+
+// Client which doesn't read its responses isn't read either until it takes this much of them
+#ifndef SERVER_MAX_PENDING_OUTPUT
+#define SERVER_MAX_PENDING_OUTPUT (256 * 1024)
+#endif
+
+// Longest wait for events, the stop request is checked between the waits
+#ifndef SERVER_POLL_TIMEOUT_MS
+#define SERVER_POLL_TIMEOUT_MS 500
+#endif
+
+struct server_client;
+
+/* Serves the commands of batch.h to many clients over a Unix domain socket.
+ * Each line of client is a command and gets one line of response, each connection has its own login.
+ * All clients are served by one thread with a poll loop, so commands never run at the same time
+ * and the locks of tables are never contended.
+ */
+struct server {
+  uintptr_t listener; // SOCKET
+  char path[108]; // Socket file, it's removed on destroy
+  struct batch_session defaults; // Tables, journals and callbacks of every new session
+  struct server_client *clients;
+  size_t clients_size;
+  size_t max_clients;
+  void *poll_fds; // WSAPOLLFD for the listener and each client
+  volatile bool stopping;
+  bool listening;
+  bool address_in_use; // Listen failed because the path is taken by a file or a running server
+  bool self_created;
+};
+
+struct server *server_create(struct server *at, const struct batch_session *defaults, size_t max_clients);
+// Closes all connections and the socket
+void server_destroy(struct server *server);
+
+// Creates the socket file at path and starts to accept clients, only the socket left by a crashed server is replaced
+bool server_listen(struct server *server, const char *path);
+// Waits for events up to timeout and serves them, returns false if the wait failed
+bool server_poll(struct server *server, int timeout_ms);
+// Polls until server_stop, returns false if the wait failed
+bool server_run(struct server *server);
+// Safe to call from another thread or the console handler
+void server_stop(struct server *server);
+
+size_t server_clients(struct server *server);
@@ -0,0 +1,207 @@
+#include "snapshot.h"
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+bool snapshot_stamp_of(const char *path, struct snapshot_stamp *stamp) {
+  WIN32_FILE_ATTRIBUTE_DATA attributes;
+  if (!GetFileAttributesExA(path, GetFileExInfoStandard, &attributes))
+    return false; // File doesn't exist
+  stamp->size = ((uint64_t)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow;
+  stamp->time = ((uint64_t)attributes.ftLastWriteTime.dwHighDateTime << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+  return true;
+}
+
+void snapshot_init(struct snapshot *snapshot) {
+  snapshot->buffer = NULL;
+  snapshot->size = 0;
+  snapshot->records = NULL;
+  snapshot->records_count = 0;
+  snapshot->heap = NULL;
+  snapshot->heap_size = 0;
+}
+
+static bool snapshot_open_image(struct snapshot *snapshot,
+                                char *buffer,
+                                size_t size,
+                                uint32_t table,
+                                uint32_t record_size,
+                                const struct snapshot_stamp *stamp) {
+  if (buffer == NULL || size < sizeof(struct snapshot_header))
+    return false;
+
+  struct snapshot_header header;
+  memcpy(&header, buffer, sizeof(header));
+  // Snapshot is used only if it belongs to the same table layout and the same version of CSV
+  if (header.magic != SNAPSHOT_MAGIC
+      || header.version != SNAPSHOT_VERSION
+      || header.table != table
+      || header.record_size != record_size
+      || (stamp != NULL && (header.stamp.size != stamp->size || header.stamp.time != stamp->time))
+      || header.records_count > (size - sizeof(header)) / record_size
+      || sizeof(header) + header.records_count * record_size + header.heap_size != size
+      || (header.heap_size > 0 && buffer[size - 1] != '\0'))
+    return false;
+
+  snapshot->buffer = buffer;
+  snapshot->size = size;
+  snapshot->records = buffer + sizeof(header);
+  snapshot->records_count = (size_t)header.records_count;
+  snapshot->heap = buffer + sizeof(header) + header.records_count * record_size;
+  snapshot->heap_size = (size_t)header.heap_size;
+  return true;
+}
+
+bool snapshot_load(struct snapshot *snapshot,
+                   const char *path,
+                   uint32_t table,
+                   uint32_t record_size,
+                   const struct snapshot_stamp *stamp) {
+  snapshot_init(snapshot);
+
+  FILE *fp = NULL;
+  fopen_s(&fp, path, "rb");
+  if (fp == NULL)
+    return false; // There is no snapshot
+
+  // Read the whole file at once
+  fseek(fp, 0L, SEEK_END);
+  long file_size = ftell(fp);
+  fseek(fp, 0L, SEEK_SET);
+  if (file_size <= 0) {
+    fclose(fp);
+    return false;
+  }
+  char *buffer = malloc((size_t)file_size);
+  size_t read_size = buffer != NULL ? fread(buffer, sizeof(char), (size_t)file_size, fp) : 0;
+  fclose(fp);
+
+  if (read_size != (size_t)file_size
+      || !snapshot_open_image(snapshot, buffer, (size_t)file_size, table, record_size, stamp)) {
+    SAFE_FREE(buffer);
+    return false;
+  }
+  return true;
+}
+
+bool snapshot_write(struct snapshot *snapshot, const char *path, const struct snapshot_stamp *stamp) {
+  if (snapshot->buffer == NULL)
+    return false;
+  // Mark the snapshot with the version of CSV it was made from
+  ((struct snapshot_header *)snapshot->buffer)->stamp = *stamp;
+
+  // Write to temporary file and replace the snapshot, so it never gets partially written
+  char temp_path[MAX_PATH];
+  sprintf_s(temp_path, sizeof(temp_path), "%s.tmp", path);
+  FILE *fp = NULL;
+  fopen_s(&fp, temp_path, "wb");
+  if (fp == NULL)
+    return false;
+  bool written = fwrite(snapshot->buffer, sizeof(char), snapshot->size, fp) == snapshot->size;
+  written = fclose(fp) == 0 && written;
+  if (!written || !MoveFileExA(temp_path, path, MOVEFILE_REPLACE_EXISTING)) {
+    DeleteFileA(temp_path);
+    return false;
+  }
+  return true;
+}
+
+void snapshot_release(struct snapshot *snapshot) {
+  SAFE_FREE(snapshot->buffer);
+  snapshot_init(snapshot);
+}
+
+bool snapshot_owns(const struct snapshot *snapshot, const void *ptr) {
+  // Strings of the heap must not be released one by one
+  return snapshot->heap != NULL && (const char *)ptr >= snapshot->heap
+      && (const char *)ptr < snapshot->heap + snapshot->heap_size;
+}
+
+const char *snapshot_string(const struct snapshot *snapshot, uint64_t offset) {
+  // Heap ends with zero, so any offset in bounds gives a zero-terminated string
+  if (offset >= snapshot->heap_size)
+    return NULL;
+  return snapshot->heap + offset;
+}
+
+void snapshot_builder_init(struct snapshot_builder *builder, size_t record_size, size_t records_count) {
+  builder->record_size = record_size;
+  builder->records_count = 0;
+  builder->records_capacity = records_count;
+  builder->records = calloc(records_count > 0 ? records_count : 1, record_size);
+  builder->heap = NULL;
+  builder->heap_size = 0;
+  builder->heap_capacity = 0;
+}
+
+void *snapshot_builder_add_record(struct snapshot_builder *builder) {
+  if (builder->records_count == builder->records_capacity) {
+    size_t capacity = builder->records_capacity < 16 ? 16 : builder->records_capacity * 2;
+    char *records = realloc(builder->records, capacity * builder->record_size);
+    if (records == NULL)
+      return NULL;
+    memset(records + builder->records_capacity * builder->record_size,
+           0,
+           (capacity - builder->records_capacity) * builder->record_size);
+    builder->records = records;
+    builder->records_capacity = capacity;
+  }
+  return builder->records + builder->records_count++ * builder->record_size;
+}
+
+uint64_t snapshot_builder_add_string(struct snapshot_builder *builder, const char *str) {
+  size_t length = strlen(str) + 1;
+  if (builder->heap_size + length > builder->heap_capacity) {
+    size_t capacity = builder->heap_capacity < 4096 ? 4096 : builder->heap_capacity;
+    while (capacity < builder->heap_size + length)
+      capacity *= 2;
+    char *heap = realloc(builder->heap, capacity);
+    if (heap == NULL)
+      return 0;
+    builder->heap = heap;
+    builder->heap_capacity = capacity;
+  }
+  uint64_t offset = builder->heap_size;
+  memcpy(builder->heap + builder->heap_size, str, length);
+  builder->heap_size += length;
+  return offset;
+}
+
+bool snapshot_builder_finish(struct snapshot_builder *builder, struct snapshot *snapshot, uint32_t table) {
+  snapshot_init(snapshot);
+
+  // Put header, records and heap to one buffer, the same as they are stored in file
+  struct snapshot_header header;
+  memset(&header, 0, sizeof(header));
+  header.magic = SNAPSHOT_MAGIC;
+  header.version = SNAPSHOT_VERSION;
+  header.table = table;
+  header.record_size = (uint32_t)builder->record_size;
+  header.records_count = builder->records_count;
+  header.heap_size = builder->heap_size;
+
+  size_t records_size = builder->records_count * builder->record_size;
+  size_t size = sizeof(header) + records_size + builder->heap_size;
+  char *buffer = malloc(size);
+  if (buffer == NULL)
+    return false;
+  memcpy(buffer, &header, sizeof(header));
+  memcpy(buffer + sizeof(header), builder->records, records_size);
+  if (builder->heap_size > 0)
+    memcpy(buffer + sizeof(header) + records_size, builder->heap, builder->heap_size);
+
+  if (!snapshot_open_image(snapshot, buffer, size, table, header.record_size, NULL)) {
+    SAFE_FREE(buffer);
+    return false;
+  }
+  return true;
+}
+
+void snapshot_builder_release(struct snapshot_builder *builder) {
+  SAFE_FREE(builder->records);
+  SAFE_FREE(builder->heap);
+  builder->records_count = 0;
+  builder->records_capacity = 0;
+  builder->heap_size = 0;
+  builder->heap_capacity = 0;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "common.h"
+
+#define SNAPSHOT_MAGIC 0x53535A44u // "DZSS"
+#define SNAPSHOT_VERSION 1u
+
+#define SNAPSHOT_TABLE_BOOKS 1u
+#define SNAPSHOT_TABLE_STUDENTS 2u
+#define SNAPSHOT_TABLE_USERS 3u
+
+// Size and last write time of the source CSV, snapshot is stale if they differ
+struct snapshot_stamp {
+  uint64_t size;
+  uint64_t time;
+};
+
+struct snapshot_header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t table;
+  uint32_t record_size;
+  uint64_t records_count;
+  uint64_t heap_size;
+  struct snapshot_stamp stamp;
+};
+
+/* Loaded snapshot: header, fixed width records and the heap of zero-terminated strings in one buffer.
+ * Records keep offsets of strings in the heap, so items of tables may point to the heap directly.
+ */
+struct snapshot {
+  char *buffer;
+  size_t size;
+  const void *records;
+  size_t records_count;
+  const char *heap;
+  size_t heap_size;
+};
+
+// Collects records and strings of a table before writing them to file
+struct snapshot_builder {
+  char *records;
+  size_t record_size;
+  size_t records_count;
+  size_t records_capacity;
+  char *heap;
+  size_t heap_size;
+  size_t heap_capacity;
+};
+
+bool snapshot_stamp_of(const char *path, struct snapshot_stamp *stamp);
+
+void snapshot_init(struct snapshot *snapshot);
+bool snapshot_load(struct snapshot *snapshot,
+                   const char *path,
+                   uint32_t table,
+                   uint32_t record_size,
+                   const struct snapshot_stamp *stamp);
+bool snapshot_write(struct snapshot *snapshot, const char *path, const struct snapshot_stamp *stamp);
+void snapshot_release(struct snapshot *snapshot);
+bool snapshot_owns(const struct snapshot *snapshot, const void *ptr);
+const char *snapshot_string(const struct snapshot *snapshot, uint64_t offset);
+
+void snapshot_builder_init(struct snapshot_builder *builder, size_t record_size, size_t records_count);
+void *snapshot_builder_add_record(struct snapshot_builder *builder);
+uint64_t snapshot_builder_add_string(struct snapshot_builder *builder, const char *str);
+bool snapshot_builder_finish(struct snapshot_builder *builder, struct snapshot *snapshot, uint32_t table);
+void snapshot_builder_release(struct snapshot_builder *builder);
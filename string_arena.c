@@ -0,0 +1,108 @@
+#include "string_arena.h"
+
+struct string_arena *string_arena_create(struct string_arena *at) {
+  // Allocating a buffer for structure or use existing if arena was provided as the first argument
+  struct string_arena *arena = at == NULL ? malloc(sizeof(*arena)) : at;
+  arena->chunks = NULL;
+  arena->position = NULL;
+  arena->end = NULL;
+  memset(arena->free_lists, 0, sizeof(arena->free_lists));
+  arena->self_created = arena != at;
+  return arena;
+}
+
+void string_arena_destroy(struct string_arena *arena) {
+  if (arena == NULL)
+    return;
+  while (arena->chunks != NULL) {
+    struct string_arena_chunk *next = arena->chunks->next;
+    free(arena->chunks);
+    arena->chunks = next;
+  }
+  arena->position = NULL;
+  arena->end = NULL;
+  memset(arena->free_lists, 0, sizeof(arena->free_lists));
+  if (arena->self_created)
+    free(arena);
+}
+
+static struct string_arena_chunk *string_arena_add_chunk(struct string_arena *arena, size_t size) {
+  struct string_arena_chunk *chunk = malloc(sizeof(*chunk) + size);
+  if (chunk == NULL)
+    return NULL;
+  chunk->prev = NULL;
+  chunk->next = arena->chunks;
+  if (arena->chunks != NULL)
+    arena->chunks->prev = chunk;
+  arena->chunks = chunk;
+  return chunk;
+}
+
+static size_t string_arena_class_of(size_t size) {
+  return (size - 1) / STRING_ARENA_GRANULARITY;
+}
+
+static char *string_arena_allocate(struct string_arena *arena, size_t size) {
+  if (size > STRING_ARENA_MAX_SMALL) {
+    struct string_arena_chunk *chunk = string_arena_add_chunk(arena, size);
+    return chunk == NULL ? NULL : (char *)(chunk + 1);
+  }
+
+  // Reuse the block released by the string of the same size class
+  size_t size_class = string_arena_class_of(size);
+  void **free_block = (void **)arena->free_lists[size_class];
+  if (free_block != NULL) {
+    arena->free_lists[size_class] = *free_block;
+    return (char *)free_block;
+  }
+
+  size = (size_class + 1) * STRING_ARENA_GRANULARITY;
+  if ((size_t)(arena->end - arena->position) < size) {
+    // The rest of current chunk is dropped, it is smaller than the largest of small strings
+    struct string_arena_chunk *chunk = string_arena_add_chunk(arena, STRING_ARENA_CHUNK_SIZE);
+    if (chunk == NULL)
+      return NULL;
+    arena->position = (char *)(chunk + 1);
+    arena->end = arena->position + STRING_ARENA_CHUNK_SIZE;
+  }
+  char *block = arena->position;
+  arena->position += size;
+  return block;
+}
+
+const char *string_arena_copy(struct string_arena *arena, const char *str) {
+  return string_arena_copy_n(arena, str, strlen(str));
+}
+
+const char *string_arena_copy_n(struct string_arena *arena, const char *str, size_t length) {
+  char *new_str = string_arena_allocate(arena, length + 1);
+  if (new_str == NULL)
+    return NULL;
+  memcpy(new_str, str, length);
+  new_str[length] = '\0';
+  return new_str;
+}
+
+void string_arena_release(struct string_arena *arena, const char *str) {
+  if (str == NULL)
+    return;
+  size_t size = strlen(str) + 1;
+  if (size > STRING_ARENA_MAX_SMALL) {
+    // Large string is the only one in its chunk
+    struct string_arena_chunk *chunk = (struct string_arena_chunk *)str - 1;
+    if (chunk->prev != NULL)
+      chunk->prev->next = chunk->next;
+    else
+      arena->chunks = chunk->next;
+    if (chunk->next != NULL)
+      chunk->next->prev = chunk->prev;
+    free(chunk);
+    return;
+  }
+
+  // Link the block into the free list of its size class
+  size_t size_class = string_arena_class_of(size);
+  void **free_block = (void **)str;
+  *free_block = arena->free_lists[size_class];
+  arena->free_lists[size_class] = free_block;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "common.h"
+
+// Size of the chunk small strings are cut from
+#ifndef STRING_ARENA_CHUNK_SIZE
+#define STRING_ARENA_CHUNK_SIZE (64 * 1024)
+#endif
+
+// Small strings take a multiple of this size, freed blocks are reused by strings of the same size class
+#ifndef STRING_ARENA_GRANULARITY
+#define STRING_ARENA_GRANULARITY 16
+#endif
+
+// Strings larger than this get a chunk of their own, which is freed as soon as the string is released
+#ifndef STRING_ARENA_MAX_SMALL
+#define STRING_ARENA_MAX_SMALL 256
+#endif
+
+#define STRING_ARENA_CLASSES (STRING_ARENA_MAX_SMALL / STRING_ARENA_GRANULARITY)
+
+struct string_arena_chunk {
+  struct string_arena_chunk *prev;
+  struct string_arena_chunk *next;
+};
+
+/* Storage for strings of table items.
+ * Strings are cut from large chunks one after another, so loading a table makes only a few allocations
+ * and destroying the arena frees all of strings by the chunks.
+ * Released small strings go to the free list of their size class, size is known by the string itself.
+ */
+struct string_arena {
+  struct string_arena_chunk *chunks;
+  char *position; // Free space of the last small chunk
+  char *end;
+  void *free_lists[STRING_ARENA_CLASSES];
+  bool self_created;
+};
+
+struct string_arena *string_arena_create(struct string_arena *at);
+void string_arena_destroy(struct string_arena *arena);
+
+const char *string_arena_copy(struct string_arena *arena, const char *str);
+const char *string_arena_copy_n(struct string_arena *arena, const char *str, size_t length);
+// String must be allocated by this arena and not changed after that
+void string_arena_release(struct string_arena *arena, const char *str);
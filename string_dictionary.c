@@ -0,0 +1,94 @@
+#include "string_dictionary.h"
+
+struct string_dictionary *string_dictionary_create(struct string_dictionary *at) {
+  // Allocating a buffer for structure or use existing if dictionary was provided as the first argument
+  struct string_dictionary *dictionary = at == NULL ? malloc(sizeof(*dictionary)) : at;
+  string_arena_create(&dictionary->strings);
+  dictionary->values = NULL;
+  dictionary->size = 0;
+  dictionary->values_capacity = 0;
+  dictionary->slots = NULL;
+  dictionary->capacity = 0;
+  dictionary->self_created = dictionary != at;
+  return dictionary;
+}
+
+void string_dictionary_destroy(struct string_dictionary *dictionary) {
+  if (dictionary == NULL)
+    return;
+  string_arena_destroy(&dictionary->strings);
+  SAFE_FREE(dictionary->values);
+  SAFE_FREE(dictionary->slots);
+  dictionary->size = 0;
+  dictionary->values_capacity = 0;
+  dictionary->capacity = 0;
+  if (dictionary->self_created)
+    free(dictionary);
+}
+
+static size_t string_dictionary_slot_of(struct string_dictionary *dictionary, const char *str) {
+  // Slot of the value or the empty slot where it should be placed
+  size_t mask = dictionary->capacity - 1;
+  for (size_t slot = hash_string(str) & mask;; slot = (slot + 1) & mask) {
+    uint32_t code = dictionary->slots[slot];
+    if (code == 0 || strcmp(dictionary->values[code - 1], str) == 0)
+      return slot;
+  }
+}
+
+static bool string_dictionary_rehash(struct string_dictionary *dictionary, size_t capacity) {
+  uint32_t *slots = calloc(capacity, sizeof(*slots));
+  if (slots == NULL)
+    return false;
+  SAFE_FREE(dictionary->slots);
+  dictionary->slots = slots;
+  dictionary->capacity = capacity;
+  for (size_t code = 0; code < dictionary->size; ++code) {
+    dictionary->slots[string_dictionary_slot_of(dictionary, dictionary->values[code])] = (uint32_t)(code + 1);
+  }
+  return true;
+}
+
+uint32_t string_dictionary_intern(struct string_dictionary *dictionary, const char *str) {
+  uint32_t code = string_dictionary_find(dictionary, str);
+  if (code != STRING_DICTIONARY_NOT_FOUND)
+    return code;
+
+  // Keep the load factor not greater than 1/2
+  if ((dictionary->size + 1) * 2 > dictionary->capacity) {
+    size_t capacity = dictionary->capacity == 0 ? STRING_DICTIONARY_MIN_CAPACITY : dictionary->capacity * 2;
+    if (!string_dictionary_rehash(dictionary, capacity))
+      return STRING_DICTIONARY_NOT_FOUND;
+  }
+  if (dictionary->size == dictionary->values_capacity) {
+    size_t values_capacity = dictionary->capacity / 2;
+    const char **values = realloc((void *)dictionary->values, values_capacity * sizeof(*values));
+    if (values == NULL)
+      return STRING_DICTIONARY_NOT_FOUND;
+    dictionary->values = values;
+    dictionary->values_capacity = values_capacity;
+  }
+
+  const char *value = string_arena_copy(&dictionary->strings, str);
+  if (value == NULL)
+    return STRING_DICTIONARY_NOT_FOUND;
+  code = (uint32_t)dictionary->size++;
+  dictionary->values[code] = value;
+  dictionary->slots[string_dictionary_slot_of(dictionary, value)] = code + 1;
+  return code;
+}
+
+uint32_t string_dictionary_find(struct string_dictionary *dictionary, const char *str) {
+  if (dictionary->capacity == 0)
+    return STRING_DICTIONARY_NOT_FOUND;
+  uint32_t code = dictionary->slots[string_dictionary_slot_of(dictionary, str)];
+  return code == 0 ? STRING_DICTIONARY_NOT_FOUND : code - 1;
+}
+
+const char *string_dictionary_value(struct string_dictionary *dictionary, uint32_t code) {
+  return code < dictionary->size ? dictionary->values[code] : NULL;
+}
+
+size_t string_dictionary_size(struct string_dictionary *dictionary) {
+  return dictionary->size;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "hash_index.h"
+#include "string_arena.h"
+#include "common.h"
+
+#ifndef STRING_DICTIONARY_MIN_CAPACITY
+#define STRING_DICTIONARY_MIN_CAPACITY 16
+#endif
+
+#define STRING_DICTIONARY_NOT_FOUND UINT32_MAX
+
+/* Stores each distinct string once and gives it a code, codes go in order of the first appearance.
+ * Items of the table keep the shared copy, so equal values are equal pointers and equal codes.
+ * Values are never removed, the dictionary is meant for the columns with a few distinct values.
+ */
+struct string_dictionary {
+  struct string_arena strings;
+  const char **values; // value by code
+  size_t size;
+  size_t values_capacity;
+  uint32_t *slots; // code + 1, zero means an empty slot
+  size_t capacity;
+  bool self_created;
+};
+
+struct string_dictionary *string_dictionary_create(struct string_dictionary *at);
+void string_dictionary_destroy(struct string_dictionary *dictionary);
+
+// Returns the code of value, adds the value if it's met for the first time
+uint32_t string_dictionary_intern(struct string_dictionary *dictionary, const char *str);
+// Returns STRING_DICTIONARY_NOT_FOUND if there is no such value
+uint32_t string_dictionary_find(struct string_dictionary *dictionary, const char *str);
+const char *string_dictionary_value(struct string_dictionary *dictionary, uint32_t code);
+
+size_t string_dictionary_size(struct string_dictionary *dictionary);
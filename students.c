@@ -1,73 +1,340 @@
 #include "students.h"
 
 struct students *students_create(struct students *pool) {
+  METRICS_BEGIN(students_create);
   // Allocating a buffer for structure or use existing if pool was provided as argument
   struct students *buffer = pool == NULL ? malloc(sizeof(struct students)) : pool;
   // Construct a dynamic array
   dynamic_array_create(&buffer->arr, sizeof(struct student), students_item_constructor, students_item_destructor, NULL);
+  // Items are referenced by handles, which survive moves of items
+  dynamic_array_enable_handles(&buffer->arr);
+  // Removed students keep their slots until compaction, so removal doesn't move the rest of items
+  dynamic_array_enable_tombstones(&buffer->arr);
+  // Construct indexes by record book uid, faculty and surname, array keeps them up to date
+  hash_index_create(&buffer->uid_index,
+                    &buffer->arr,
+                    students_item_record_book_uid,
+                    STUDENTS_FIELD_BIT(STUDENTS_FIELD_RECORD_BOOK_UID),
+                    true);
+  dynamic_array_add_index(&buffer->arr, &buffer->uid_index.base);
+  dynamic_array_set_primary_index(&buffer->arr, &buffer->uid_index.base);
+  hash_index_create(&buffer->faculty_index,
+                    &buffer->arr,
+                    students_item_faculty,
+                    STUDENTS_FIELD_BIT(STUDENTS_FIELD_FACULTY),
+                    false);
+  dynamic_array_add_index(&buffer->arr, &buffer->faculty_index.base);
+  ordered_index_create(&buffer->surname_index,
+                       &buffer->arr,
+                       students_item_surname,
+                       STUDENTS_FIELD_BIT(STUDENTS_FIELD_SURNAME));
+  dynamic_array_add_index(&buffer->arr, &buffer->surname_index.base);
+  bk_tree_create(&buffer->surname_tree, &buffer->arr, students_item_surname, STUDENTS_FIELD_BIT(STUDENTS_FIELD_SURNAME));
+  dynamic_array_add_index(&buffer->arr, &buffer->surname_tree.base);
+  snapshot_init(&buffer->snapshot);
+  string_arena_create(&buffer->strings);
+  string_dictionary_create(&buffer->faculties);
+  string_dictionary_create(&buffer->specialities);
   // Do not release if we didn't allocate by ourselves
   buffer->self_created = pool == buffer;
+  METRICS_END();
   return buffer;
 }
 
 void students_destroy(struct students *pool) {
   if (pool == NULL)
     return;
+  METRICS_BEGIN(students_destroy);
+  hash_index_destroy(&pool->uid_index);
+  hash_index_destroy(&pool->faculty_index);
+  ordered_index_destroy(&pool->surname_index);
+  bk_tree_destroy(&pool->surname_tree);
+  // Items own nothing but strings, so they are released all at once by chunks instead of one by one
+  pool->arr.item_destructor = NULL;
   dynamic_array_destroy(&pool->arr);
+  snapshot_release(&pool->snapshot);
+  string_arena_destroy(&pool->strings);
+  string_dictionary_destroy(&pool->faculties);
+  string_dictionary_destroy(&pool->specialities);
   // Do not release if we didn't allocate by ourselves
-  if (!pool->self_created)
+  if (!pool->self_created) {
+    METRICS_END();
     return;
+  }
   free(pool);
+  METRICS_END();
 }
 
 struct student *students_insert(struct students *pool, student_insert_data data) {
+  METRICS_BEGIN(students_insert);
   // Find for item in structure
   struct student *found = students_find_by_uid(pool, data.record_book_uid);
-  if (found)
+  if (found) {
+    METRICS_END();
     return found;
-  // Insert if we didn't find it and return a pointer
-  return (struct student *)dynamic_array_insert(&pool->arr, &data, NULL);
+  }
+  // Insert if we didn't find it and return a pointer, array updates the indexes
+  struct student *item = (struct student *)dynamic_array_insert(&pool->arr, &data, NULL);
+  METRICS_END();
+  return item;
 }
 
 bool students_remove(struct students *pool, struct student *at) {
-  if (at == NULL)
+  METRICS_BEGIN(students_remove);
+  if (at == NULL) {
+    METRICS_END();
+    return false;
+  }
+  if (!dynamic_array_remove(&pool->arr, (void *)at)) {
+    METRICS_END();
     return false;
-  return dynamic_array_remove(&pool->arr, (void *)at);
+  }
+  // Move the rest of items over the dead ones when there are too many of them
+  if (dynamic_array_needs_compaction(&pool->arr))
+    students_compact(pool);
+  METRICS_END();
+  return true;
+}
+
+size_t students_remove_if(struct students *pool, students_filter_callback predicate, void *context) {
+  METRICS_BEGIN(students_remove_if);
+  // Mark all of matching items and compact once, so the whole purge is linear
+  size_t removed = 0;
+  for (size_t i = 0; i < dynamic_array_size(&pool->arr); ++i) {
+    struct student *item = students_first(pool) + i;
+    if (!dynamic_array_is_dead(&pool->arr, i) && predicate(item, context) && dynamic_array_remove(&pool->arr, item))
+      ++removed;
+  }
+  students_compact(pool);
+  METRICS_END();
+  return removed;
+}
+
+void students_compact(struct students *pool) {
+  METRICS_BEGIN(students_compact);
+  // Indexes keep handles, so they don't care about new positions
+  dynamic_array_compact(&pool->arr);
+  METRICS_END();
+}
+
+bool students_is_removed(struct students *pool, struct student *item) {
+  return dynamic_array_is_dead(&pool->arr, item - students_first(pool));
 }
 
 bool students_remove_by_uid(struct students *pool, const char *uid) {
+  METRICS_BEGIN(students_remove_by_uid);
   // Find for item in structure by uid
   struct student *item = students_find_by_uid(pool, uid);
-  if (item == NULL)
+  if (item == NULL) {
+    METRICS_END();
     return false;
+  }
   // Remove if found
-  return dynamic_array_remove(&pool->arr, (void *)item);
+  bool removed = students_remove(pool, item);
+  METRICS_END();
+  return removed;
 }
 
-struct student *students_find_by_uid(struct students *pool, const char *uid) {
-  // If there are some students
-  if (students_size(pool) > 0) {
-    for (struct student *item = students_first(pool); item <= students_last(pool); ++item) {
-      // If student pointer is not null and record books equals
-      if (item != NULL && strcmp(item->record_book_uid, uid) == 0) {
-        return item;
-      }
-    }
+static bool students_set_field(struct students *pool, struct student *item, enum students_field field, const char *value) {
+  const char **position = NULL;
+  switch (field) {
+  case STUDENTS_FIELD_FACULTY: {
+    // Dictionary values are shared, so nothing gets released. The old code stays if the new one can't be added
+    uint32_t code = string_dictionary_intern(&pool->faculties, value);
+    if (code == STRING_DICTIONARY_NOT_FOUND)
+      return false;
+    item->faculty_code = code;
+    item->faculty = string_dictionary_value(&pool->faculties, code);
+    return true;
   }
-  return NULL;
+  case STUDENTS_FIELD_SPECIALITY: {
+    uint32_t code = string_dictionary_intern(&pool->specialities, value);
+    if (code == STRING_DICTIONARY_NOT_FOUND)
+      return false;
+    item->speciality_code = code;
+    item->speciality = string_dictionary_value(&pool->specialities, code);
+    return true;
+  }
+  case STUDENTS_FIELD_SURNAME:position = &item->surname;
+    break;
+  case STUDENTS_FIELD_NAME:position = &item->name;
+    break;
+  case STUDENTS_FIELD_PATRONYMIC:position = &item->patronymic;
+    break;
+  default:
+    return false;
+  }
+  // Copy the value because it may be located in temporary buffer, space of the old one is reused by next strings
+  const char *new_value = string_arena_copy(&pool->strings, value);
+  students_release_string(pool, position);
+  *position = new_value;
+  return true;
+}
+
+bool students_update_field(struct students *pool, struct student *item, enum students_field field, const char *value) {
+  METRICS_BEGIN(students_update_field);
+  if (field == STUDENTS_FIELD_RECORD_BOOK_UID) {
+    METRICS_END();
+    return false; // Record book uid is the key of table, the student should be removed and inserted again
+  }
+  // Indexes by the field forget the old value and get the new one
+  dynamic_array_update_begin(&pool->arr, item, STUDENTS_FIELD_BIT(field));
+  bool updated = students_set_field(pool, item, field, value);
+  dynamic_array_update_end(&pool->arr, item, STUDENTS_FIELD_BIT(field));
+  METRICS_END();
+  return updated;
+}
+
+struct student *students_find_by_uid(struct students *pool, const char *uid) {
+  METRICS_BEGIN(students_find_by_uid);
+  // Lookup in the index by record book uid
+  struct student *item = (struct student *)hash_index_find(&pool->uid_index, uid);
+  METRICS_END();
+  return item;
 }
 
 struct student *students_find_by_surname(struct students *pool, const char *surname) {
-  // If there are some students
-  for (struct student *item = students_first(pool); item <= students_last(pool); ++item) {
-    // If student pointer is not null and surnames equals
-    if (item != NULL && strcmp(item->surname, surname) == 0) {
+  METRICS_BEGIN(students_find_by_surname);
+  // Index ignores case, so the exact surname is looked for among the found ones
+  students_iterator iterator = ordered_index_equal_range(&pool->surname_index, surname);
+  struct student *item;
+  while ((item = students_next(&iterator)) != NULL) {
+    if (strcmp(item->surname, surname) == 0) {
+      METRICS_END();
       return item;
     }
   }
+  METRICS_END();
   return NULL;
 }
 
+students_iterator students_find_all_by_surname(struct students *pool, const char *surname) {
+  METRICS_BEGIN(students_find_all_by_surname);
+  students_iterator iterator = ordered_index_equal_range(&pool->surname_index, surname);
+  METRICS_END();
+  return iterator;
+}
+
+students_iterator students_find_by_surname_prefix(struct students *pool, const char *prefix) {
+  METRICS_BEGIN(students_find_by_surname_prefix);
+  students_iterator iterator = ordered_index_prefix_range(&pool->surname_index, prefix);
+  METRICS_END();
+  return iterator;
+}
+
+struct student *students_next(students_iterator *iterator) {
+  return (struct student *)ordered_index_next(iterator);
+}
+
+struct students_ranked_context {
+  students_ranked_callback callback;
+  void *context;
+};
+
+static bool students_ranked_index_callback(void *item, size_t distance, void *context) {
+  struct students_ranked_context *ranked = (struct students_ranked_context *)context;
+  return ranked->callback((struct student *)item, distance, ranked->context);
+}
+
+size_t students_find_similar_surnames(struct students *pool,
+                                      const char *surname,
+                                      size_t max_distance,
+                                      students_ranked_callback callback,
+                                      void *context) {
+  METRICS_BEGIN(students_find_similar_surnames);
+  struct students_ranked_context ranked = {callback, context};
+  size_t found = bk_tree_find_similar(&pool->surname_tree,
+                                      surname,
+                                      max_distance,
+                                      callback == NULL ? NULL : students_ranked_index_callback,
+                                      &ranked);
+  METRICS_END();
+  return found;
+}
+
+static size_t students_filter_by_code(struct students *pool,
+                                      size_t code_offset,
+                                      uint32_t code,
+                                      students_filter_callback callback,
+                                      void *context) {
+  size_t count = 0;
+  if (code == STRING_DICTIONARY_NOT_FOUND)
+    return count; // Nobody has such value
+  for (size_t i = 0; i < dynamic_array_size(&pool->arr); ++i) {
+    struct student *item = students_first(pool) + i;
+    // Compare codes instead of strings
+    if (dynamic_array_is_dead(&pool->arr, i) || *(uint32_t *)((uintptr_t)item + code_offset) != code)
+      continue;
+    ++count;
+    if (callback != NULL && !callback(item, context))
+      break; // Callback asked to stop
+  }
+  return count;
+}
+
+struct students_filter_context {
+  students_filter_callback callback;
+  void *context;
+};
+
+static bool students_filter_index_callback(void *item, void *context) {
+  struct students_filter_context *filter = (struct students_filter_context *)context;
+  return filter->callback((struct student *)item, filter->context);
+}
+
+size_t students_filter_by_faculty(struct students *pool,
+                                  const char *faculty,
+                                  students_filter_callback callback,
+                                  void *context) {
+  METRICS_BEGIN(students_filter_by_faculty);
+  // Students of the faculty are listed by the index
+  struct students_filter_context filter = {callback, context};
+  size_t found = hash_index_find_all(&pool->faculty_index,
+                                     faculty,
+                                     callback == NULL ? NULL : students_filter_index_callback,
+                                     &filter);
+  METRICS_END();
+  return found;
+}
+
+size_t students_filter_by_speciality(struct students *pool,
+                                     const char *speciality,
+                                     students_filter_callback callback,
+                                     void *context) {
+  METRICS_BEGIN(students_filter_by_speciality);
+  uint32_t code = string_dictionary_find(&pool->specialities, speciality);
+  size_t found = students_filter_by_code(pool, offsetof(struct student, speciality_code), code, callback, context);
+  METRICS_END();
+  return found;
+}
+
+void students_count_by_faculty(struct students *pool, size_t *counts) {
+  METRICS_BEGIN(students_count_by_faculty);
+  memset(counts, 0, students_faculties_size(pool) * sizeof(*counts));
+  for (size_t i = 0; i < dynamic_array_size(&pool->arr); ++i) {
+    if (!dynamic_array_is_dead(&pool->arr, i))
+      ++counts[(students_first(pool) + i)->faculty_code];
+  }
+  METRICS_END();
+}
+
+size_t students_faculties_size(struct students *pool) {
+  return string_dictionary_size(&pool->faculties);
+}
+
+const char *students_faculty_by_code(struct students *pool, uint32_t code) {
+  return string_dictionary_value(&pool->faculties, code);
+}
+
+struct dynamic_array_handle students_handle_of(struct students *pool, struct student *item) {
+  return dynamic_array_handle_of(&pool->arr, item);
+}
+
+struct student *students_resolve(struct students *pool, struct dynamic_array_handle handle) {
+  // NULL if the item was removed
+  return (struct student *)dynamic_array_resolve(&pool->arr, handle);
+}
+
 struct student *students_first(struct students *students) {
   // Return pointer to first item
   return (struct student *)dynamic_array_first(&students->arr);
@@ -83,70 +350,335 @@ struct student *students_end(struct students *pool) {
   return (struct student *)dynamic_array_end(&pool->arr);
 }
 
+void students_lock_shared(struct students *pool) {
+  dynamic_array_lock_shared(&pool->arr);
+}
+
+void students_unlock_shared(struct students *pool) {
+  dynamic_array_unlock_shared(&pool->arr);
+}
+
+void students_lock_exclusive(struct students *pool) {
+  dynamic_array_lock_exclusive(&pool->arr);
+}
+
+void students_unlock_exclusive(struct students *pool) {
+  dynamic_array_unlock_exclusive(&pool->arr);
+}
+
 size_t students_size(struct students *pool) {
-  // Count of students
-  return dynamic_array_size(&pool->arr);
+  // Count of students, removed ones are not counted
+  return dynamic_array_live_size(&pool->arr);
+}
+
+static bool students_intern_columns(struct students *pool,
+                                    struct student *item,
+                                    const char *faculty,
+                                    const char *speciality) {
+  // Both codes are taken before the item gets any of them, it's left as it was if a dictionary can't grow
+  uint32_t faculty_code = string_dictionary_intern(&pool->faculties, faculty);
+  uint32_t speciality_code = string_dictionary_intern(&pool->specialities, speciality);
+  if (faculty_code == STRING_DICTIONARY_NOT_FOUND || speciality_code == STRING_DICTIONARY_NOT_FOUND)
+    return false;
+  item->faculty_code = faculty_code;
+  item->faculty = string_dictionary_value(&pool->faculties, faculty_code);
+  item->speciality_code = speciality_code;
+  item->speciality = string_dictionary_value(&pool->specialities, speciality_code);
+  return true;
 }
 
-void students_item_constructor(struct dynamic_array *arr, void *item, void *data) {
+void *students_item_constructor(struct dynamic_array *arr, void *item, void *data) {
   // Students constructor, gets clalled by dynamic_array_insert
 
   student_insert_data *insert_data = (student_insert_data *)data;
   struct student *position = (struct student *)item;
 
+  struct students *pool = (struct students *)arr; // Dynamic array is the first member of pool
+
+  // Student without the codes of faculty and speciality isn't inserted, nothing has been copied yet
+  if (!students_intern_columns(pool, position, insert_data->faculty, insert_data->speciality))
+    return NULL;
   // Copy each of values because the provided data will locate to temporary buffer
-  position->record_book_uid = copy_string(insert_data->record_book_uid);
-  position->surname = copy_string(insert_data->surname);
-  position->name = copy_string(insert_data->name);
-  position->patronymic = copy_string(insert_data->patronymic);
-  position->faculty = copy_string(insert_data->faculty);
-  position->speciality = copy_string(insert_data->speciality);
+  position->record_book_uid = string_arena_copy(&pool->strings, insert_data->record_book_uid);
+  position->surname = string_arena_copy(&pool->strings, insert_data->surname);
+  position->name = string_arena_copy(&pool->strings, insert_data->name);
+  position->patronymic = string_arena_copy(&pool->strings, insert_data->patronymic);
+  return position;
 }
 
 void students_item_destructor(struct dynamic_array *arr, void *item) {
   struct student *this_item = (struct student *)item;
+  struct students *pool = (struct students *)arr; // Dynamic array is the first member of pool
   // Safe release of each item in structure
-  SAFE_FREE(this_item->surname);
-  SAFE_FREE(this_item->name);
-  SAFE_FREE(this_item->patronymic);
-  SAFE_FREE(this_item->faculty);
-  SAFE_FREE(this_item->speciality);
+  students_release_string(pool, &this_item->record_book_uid);
+  students_release_string(pool, &this_item->surname);
+  students_release_string(pool, &this_item->name);
+  students_release_string(pool, &this_item->patronymic);
+  // Faculty and speciality belong to dictionaries
+  this_item->faculty = NULL;
+  this_item->speciality = NULL;
+}
+
+void students_release_string(struct students *pool, const char **str) {
+  // Strings of snapshot get released all at once with the snapshot
+  if (snapshot_owns(&pool->snapshot, *str)) {
+    *str = NULL;
+    return;
+  }
+  string_arena_release(&pool->strings, *str);
+  *str = NULL;
+}
+
+const char *students_item_record_book_uid(void *item) {
+  // Key of the index by record book uid
+  return ((struct student *)item)->record_book_uid;
+}
+
+const char *students_item_surname(void *item) {
+  return ((struct student *)item)->surname;
+}
+
+const char *students_item_faculty(void *item) {
+  // Key of the index by faculty
+  return ((struct student *)item)->faculty;
 }
 
-struct students *students_create_from_csv(struct students *pool, struct csv_data *csv) {
+struct students *students_create_from_csv(struct students *pool, struct csv_reader *reader) {
+  METRICS_BEGIN(students_create_from_csv);
   struct students *buffer = students_create(pool);
-  for (struct csv_row *row = csv_data_first(csv); row <= csv_data_last(csv); ++row) {
-    if (row == NULL || csv_row_size(row) < 6)
+  // Reserve the space for all rows at once instead of growing the buffer for every item
+  dynamic_array_reserve(&buffer->arr, csv_reader_count_lines(reader));
+  struct csv_record record;
+  while (csv_reader_next(reader, &record)) {
+    if (record.size < 6)
+      continue;
+    // Values are zero-terminated copies of fields, valid until the next row
+    if (!csv_reader_copy_values(reader, &record))
       continue;
     student_insert_data data;
-    // Get each of values, but do not copy values because the data is temporary
-    data.record_book_uid = *csv_row_get_at(row, 0);
-    data.surname = *csv_row_get_at(row, 1);
-    data.name = *csv_row_get_at(row, 2);
-    data.patronymic = *csv_row_get_at(row, 3);
-    data.faculty = *csv_row_get_at(row, 4);
-    data.speciality = *csv_row_get_at(row, 5);
+    // Do not copy values, item constructor copies them
+    data.record_book_uid = record.values[0];
+    data.surname = record.values[1];
+    data.name = record.values[2];
+    data.patronymic = record.values[3];
+    data.faculty = record.values[4];
+    data.speciality = record.values[5];
     // Insert item
     students_insert(buffer, data);
   }
+  METRICS_END();
   return buffer;
 }
 
-void students_save_csv_to_file(struct students *pool, FILE *fp) {
-  static char buffer[512 + 1];
-  for (struct student *entry = students_first(pool); entry <= students_last(pool); ++entry) {
-    if (entry == NULL)
-      continue;
-    memset(buffer, 0, sizeof(buffer));
-    sprintf_s(buffer,
-              sizeof(buffer),
-              "%s;%s;%s;%s;%s;%s\n",
-              entry->record_book_uid,
-              entry->surname,
-              entry->name,
-              entry->patronymic,
-              entry->faculty,
-              entry->speciality);
-    fwrite(buffer, sizeof(char), strlen(buffer), fp);
+static void students_write_csv_row(const struct student *entry, struct output_buffer *out) {
+  const char *fields[] = {entry->record_book_uid, entry->surname, entry->name, entry->patronymic, entry->faculty,
+                          entry->speciality};
+  for (size_t i = 0; i < sizeof(fields) / sizeof(*fields); ++i) {
+    if (i != 0)
+      output_buffer_write_char(out, ';');
+    output_buffer_write_csv_field(out, fields[i]);
+  }
+  output_buffer_write_char(out, '\n');
+}
+
+bool students_save_csv_to_file(struct students *pool, FILE *fp) {
+  METRICS_BEGIN(students_save_csv_to_file);
+  // Removed items are dropped on save
+  students_compact(pool);
+  struct output_buffer out;
+  output_buffer_create(&out, fp);
+  for (size_t i = 0; i < students_size(pool); ++i) {
+    students_write_csv_row(students_first(pool) + i, &out);
+  }
+  bool written = output_buffer_destroy(&out);
+  METRICS_END();
+  return written;
+}
+
+struct students_snapshot_record {
+  uint64_t record_book_uid;
+  uint64_t surname;
+  uint64_t name;
+  uint64_t patronymic;
+  uint64_t faculty;
+  uint64_t speciality;
+};
+
+static bool students_item_from_record(const struct snapshot *snapshot, size_t position, struct student *item) {
+  const struct students_snapshot_record *record = (const struct students_snapshot_record *)snapshot->records + position;
+  item->record_book_uid = snapshot_string(snapshot, record->record_book_uid);
+  item->surname = snapshot_string(snapshot, record->surname);
+  item->name = snapshot_string(snapshot, record->name);
+  item->patronymic = snapshot_string(snapshot, record->patronymic);
+  item->faculty = snapshot_string(snapshot, record->faculty);
+  item->speciality = snapshot_string(snapshot, record->speciality);
+  // Do not trust the broken snapshot, strings must be in heap
+  return item->record_book_uid != NULL && item->surname != NULL && item->name != NULL && item->patronymic != NULL
+      && item->faculty != NULL && item->speciality != NULL;
+}
+
+struct students *students_create_from_snapshot(struct students *pool, const char *path, const struct snapshot_stamp *stamp) {
+  METRICS_BEGIN(students_create_from_snapshot);
+  struct snapshot snapshot;
+  if (!snapshot_load(&snapshot, path, SNAPSHOT_TABLE_STUDENTS, sizeof(struct students_snapshot_record), stamp)) {
+    METRICS_END();
+    return NULL;
+  }
+
+  struct students *buffer = students_create(pool);
+  // The pool owns the snapshot, items point to its strings
+  buffer->snapshot = snapshot;
+  dynamic_array_reserve(&buffer->arr, snapshot.records_count);
+  for (size_t i = 0; i < snapshot.records_count; ++i) {
+    struct student item;
+    // Snapshot has a copy of value for each student, items keep the dictionary one
+    if (!students_item_from_record(&snapshot, i, &item)
+        || !students_intern_columns(buffer, &item, item.faculty, item.speciality)) {
+      // The caller falls back to CSV
+      students_destroy(buffer);
+      METRICS_END();
+      return NULL;
+    }
+    // Array indexes the item
+    dynamic_array_append_raw(&buffer->arr, &item, 1);
   }
+  METRICS_END();
+  return buffer;
+}
+
+bool students_build_snapshot(struct students *pool, struct snapshot *snapshot) {
+  METRICS_BEGIN(students_build_snapshot);
+  // Copy all items to the snapshot, it doesn't depend on the pool anymore
+  students_compact(pool);
+  struct snapshot_builder builder;
+  snapshot_builder_init(&builder, sizeof(struct students_snapshot_record), students_size(pool));
+  // Each of dictionary values is written once, records share its offset
+  size_t faculties_size = string_dictionary_size(&pool->faculties);
+  size_t specialities_size = string_dictionary_size(&pool->specialities);
+  uint64_t *offsets = malloc((faculties_size + specialities_size + 1) * sizeof(*offsets));
+  if (offsets == NULL) {
+    snapshot_builder_release(&builder);
+    METRICS_END();
+    return false;
+  }
+  for (size_t i = 0; i < faculties_size; ++i) {
+    offsets[i] = snapshot_builder_add_string(&builder, string_dictionary_value(&pool->faculties, (uint32_t)i));
+  }
+  for (size_t i = 0; i < specialities_size; ++i) {
+    offsets[faculties_size + i] =
+        snapshot_builder_add_string(&builder, string_dictionary_value(&pool->specialities, (uint32_t)i));
+  }
+  for (size_t i = 0; i < students_size(pool); ++i) {
+    struct student *entry = students_first(pool) + i;
+    struct students_snapshot_record *record = (struct students_snapshot_record *)snapshot_builder_add_record(&builder);
+    record->record_book_uid = snapshot_builder_add_string(&builder, entry->record_book_uid);
+    record->surname = snapshot_builder_add_string(&builder, entry->surname);
+    record->name = snapshot_builder_add_string(&builder, entry->name);
+    record->patronymic = snapshot_builder_add_string(&builder, entry->patronymic);
+    record->faculty = offsets[entry->faculty_code];
+    record->speciality = offsets[faculties_size + entry->speciality_code];
+  }
+  SAFE_FREE(offsets);
+  bool built = snapshot_builder_finish(&builder, snapshot, SNAPSHOT_TABLE_STUDENTS);
+  snapshot_builder_release(&builder);
+  METRICS_END();
+  return built;
+}
+
+bool students_save_snapshot(struct students *pool, const char *path, const struct snapshot_stamp *stamp) {
+  METRICS_BEGIN(students_save_snapshot);
+  struct snapshot snapshot;
+  if (!students_build_snapshot(pool, &snapshot)) {
+    METRICS_END();
+    return false;
+  }
+  bool written = snapshot_write(&snapshot, path, stamp);
+  snapshot_release(&snapshot);
+  METRICS_END();
+  return written;
+}
+
+bool students_save_csv_from_snapshot(const struct snapshot *snapshot, FILE *fp) {
+  METRICS_BEGIN(students_save_csv_from_snapshot);
+  // The same as students_save_csv_to_file, but for the copy of pool
+  struct output_buffer out;
+  output_buffer_create(&out, fp);
+  for (size_t i = 0; i < snapshot->records_count; ++i) {
+    struct student item;
+    if (!students_item_from_record(snapshot, i, &item)) {
+      output_buffer_destroy(&out);
+      METRICS_END();
+      return false;
+    }
+    students_write_csv_row(&item, &out);
+  }
+  bool written = output_buffer_destroy(&out);
+  METRICS_END();
+  return written;
+}
+
+void students_journal_apply(void *context, uint8_t op, const char **fields, size_t count) {
+  METRICS_BEGIN(students_journal_apply);
+  struct students *pool = (struct students *)context;
+  switch (op) {
+  case JOURNAL_OP_INSERT: {
+    if (count < 6)
+      break;
+    student_insert_data data;
+    data.record_book_uid = fields[0];
+    data.surname = fields[1];
+    data.name = fields[2];
+    data.patronymic = fields[3];
+    data.faculty = fields[4];
+    data.speciality = fields[5];
+    students_insert(pool, data);
+    break;
+  }
+  case JOURNAL_OP_REMOVE: {
+    if (count < 1)
+      break;
+    students_remove_by_uid(pool, fields[0]);
+    break;
+  }
+  case JOURNAL_OP_UPDATE: {
+    if (count < 3)
+      break;
+    struct student *item = students_find_by_uid(pool, fields[0]);
+    if (item != NULL)
+      students_update_field(pool, item, (enum students_field)strtoul(fields[1], NULL, 10), fields[2]);
+    break;
+  }
+  }
+  METRICS_END();
+}
+
+bool students_journal_insert(struct journal *journal, const struct student *item) {
+  METRICS_BEGIN(students_journal_insert);
+  if (item == NULL) {
+    METRICS_END();
+    return false;
+  }
+  const char *fields[] = {item->record_book_uid, item->surname, item->name, item->patronymic, item->faculty,
+                          item->speciality};
+  bool appended = journal_append(journal, JOURNAL_OP_INSERT, fields, sizeof(fields) / sizeof(*fields));
+  METRICS_END();
+  return appended;
+}
+
+bool students_journal_remove(struct journal *journal, const char *uid) {
+  METRICS_BEGIN(students_journal_remove);
+  const char *fields[] = {uid};
+  bool appended = journal_append(journal, JOURNAL_OP_REMOVE, fields, sizeof(fields) / sizeof(*fields));
+  METRICS_END();
+  return appended;
+}
+
+bool students_journal_update(struct journal *journal, const char *uid, enum students_field field, const char *value) {
+  METRICS_BEGIN(students_journal_update);
+  char field_buffer[16];
+  sprintf_s(field_buffer, sizeof(field_buffer), "%d", (int)field);
+  const char *fields[] = {uid, field_buffer, value};
+  bool appended = journal_append(journal, JOURNAL_OP_UPDATE, fields, sizeof(fields) / sizeof(*fields));
+  METRICS_END();
+  return appended;
 }
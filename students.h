@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdbool.h>
@@ -7,8 +8,15 @@
 #include <string.h>
 
 #include "dynamic_array.h"
-#include "csv/csv_parser.h"
-#include "csv/csv_row.h"
+#include "hash_index.h"
+#include "ordered_index.h"
+#include "bk_tree.h"
+#include "snapshot.h"
+#include "string_arena.h"
+#include "string_dictionary.h"
+#include "output_buffer.h"
+#include "journal.h"
+#include "csv/csv_reader.h"
 #include "common.h"
 
 struct student {
@@ -16,14 +24,44 @@ struct student {
   const char *surname;
   const char *name;
   const char *patronymic;
-  const char *faculty;
-  const char *speciality;
+  const char *faculty; // Shared with all students of the faculty
+  const char *speciality; // Shared with all students of the speciality
+  uint32_t faculty_code; // Code of faculty in dictionary, set by pool
+  uint32_t speciality_code; // Code of speciality in dictionary, set by pool
 };
 
 typedef struct student student_insert_data;
 
+// Gets called for each item found, returns false to stop the iteration
+typedef bool (*students_filter_callback)(struct student *item, void *context);
+// Gets called for similar items from the closest one, returns false to stop the iteration
+typedef bool (*students_ranked_callback)(struct student *item, size_t distance, void *context);
+
+enum students_field {
+  STUDENTS_FIELD_RECORD_BOOK_UID,
+  STUDENTS_FIELD_SURNAME,
+  STUDENTS_FIELD_NAME,
+  STUDENTS_FIELD_PATRONYMIC,
+  STUDENTS_FIELD_FACULTY,
+  STUDENTS_FIELD_SPECIALITY,
+};
+
+// Bit of the field in masks of indexes and dynamic_array_update_begin
+#define STUDENTS_FIELD_BIT(field) (1u << (field))
+
+// Iterates over the students found, it's invalidated by the changes of table
+typedef struct ordered_index_iterator students_iterator;
+
 struct students {
-  struct dynamic_array arr;
+  struct dynamic_array arr; // Must be the first, item destructor gets the pool by array pointer
+  struct hash_index uid_index;
+  struct hash_index faculty_index;
+  struct ordered_index surname_index; // Namesakes go one after another, so all of them are found at once
+  struct bk_tree surname_tree; // Surnames with typos
+  struct snapshot snapshot; // Owns the strings of items loaded from snapshot
+  struct string_arena strings; // Owns the strings of items inserted after that
+  struct string_dictionary faculties; // A few dozens of values repeated by all of students
+  struct string_dictionary specialities;
   bool self_created;
 };
 
@@ -32,19 +70,70 @@ void students_destroy(struct students *pool);
 struct student *students_insert(struct students *pool, student_insert_data data);
 bool students_remove(struct students *pool, struct student *at);
 bool students_remove_by_uid(struct students *pool, const char *uid);
+// Removes all items the predicate returns true for
+size_t students_remove_if(struct students *pool, students_filter_callback predicate, void *context);
+void students_compact(struct students *pool);
+bool students_is_removed(struct students *pool, struct student *item);
+bool students_update_field(struct students *pool, struct student *item, enum students_field field, const char *value);
 
 struct student *students_find_by_uid(struct students *pool, const char *uid);
 struct student *students_find_by_surname(struct students *pool, const char *surname);
+// Both of them ignore case, students are taken by students_next in the order of surnames
+students_iterator students_find_all_by_surname(struct students *pool, const char *surname);
+students_iterator students_find_by_surname_prefix(struct students *pool, const char *prefix);
+struct student *students_next(students_iterator *iterator);
+// Visits students which surnames are within max_distance typos ignoring case, ordered by the distance
+size_t students_find_similar_surnames(struct students *pool,
+                                      const char *surname,
+                                      size_t max_distance,
+                                      students_ranked_callback callback,
+                                      void *context);
+size_t students_filter_by_faculty(struct students *pool,
+                                  const char *faculty,
+                                  students_filter_callback callback,
+                                  void *context);
+size_t students_filter_by_speciality(struct students *pool,
+                                     const char *speciality,
+                                     students_filter_callback callback,
+                                     void *context);
+// Counts students of each faculty, counts are indexed by faculty code and must have students_faculties_size items
+void students_count_by_faculty(struct students *pool, size_t *counts);
+size_t students_faculties_size(struct students *pool);
+const char *students_faculty_by_code(struct students *pool, uint32_t code);
+
+// Handle stays valid until the item is removed, unlike the pointer to item
+struct dynamic_array_handle students_handle_of(struct students *pool, struct student *item);
+struct student *students_resolve(struct students *pool, struct dynamic_array_handle handle);
 
 struct student *students_first(struct students *pool);
 struct student *students_last(struct students *pool);
 struct student *students_end(struct students *pool);
 
+// Readers share the table and the writer has it alone, the pointers to items are valid only under the lock
+void students_lock_shared(struct students *pool);
+void students_unlock_shared(struct students *pool);
+void students_lock_exclusive(struct students *pool);
+void students_unlock_exclusive(struct students *pool);
+
 size_t students_size(struct students *pool);
 
 // Helpers
-void students_item_constructor(struct dynamic_array *arr, void *item, void *data);
+void *students_item_constructor(struct dynamic_array *arr, void *item, void *data);
 void students_item_destructor(struct dynamic_array *arr, void *item);
+void students_release_string(struct students *pool, const char **str);
+const char *students_item_record_book_uid(void *item);
+const char *students_item_surname(void *item);
+const char *students_item_faculty(void *item);
+
+struct students *students_create_from_csv(struct students *pool, struct csv_reader *reader);
+bool students_save_csv_to_file(struct students *pool, FILE *fp);
+
+struct students *students_create_from_snapshot(struct students *pool, const char *path, const struct snapshot_stamp *stamp);
+bool students_build_snapshot(struct students *pool, struct snapshot *snapshot);
+bool students_save_snapshot(struct students *pool, const char *path, const struct snapshot_stamp *stamp);
+bool students_save_csv_from_snapshot(const struct snapshot *snapshot, FILE *fp);
 
-struct students *students_create_from_csv(struct students *pool, struct csv_data *csv);
-void students_save_csv_to_file(struct students *pool, FILE *fp);
+void students_journal_apply(void *context, uint8_t op, const char **fields, size_t count);
+bool students_journal_insert(struct journal *journal, const struct student *item);
+bool students_journal_remove(struct journal *journal, const char *uid);
+bool students_journal_update(struct journal *journal, const char *uid, enum students_field field, const char *value);
@@ -0,0 +1,160 @@
+#include "text.h"
+
+unsigned char text_to_lower(unsigned char c) {
+  if (c >= 'A' && c <= 'Z')
+    return (unsigned char)(c + ('a' - 'A'));
+  // .. go right before ..
+  if (c >= 0xC0 && c <= 0xDF)
+    return (unsigned char)(c + 0x20);
+  switch (c) {
+  case 0xA8: return 0xB8; // 
+  case 0xAA: return 0xBA; // 
+  case 0xAF: return 0xBF; // 
+  case 0xB2: return 0xB3; // 
+  case 0xA5: return 0xB4; // 
+  case 0xA1: return 0xA2; // 
+  default: return c;
+  }
+}
+
+int text_compare_ignore_case(const char *left, const char *right) {
+  const unsigned char *l = (const unsigned char *)left;
+  const unsigned char *r = (const unsigned char *)right;
+  while (*l != '\0' && text_to_lower(*l) == text_to_lower(*r)) {
+    ++l;
+    ++r;
+  }
+  return (int)text_to_lower(*l) - (int)text_to_lower(*r);
+}
+
+bool text_starts_with_ignore_case(const char *str, const char *prefix) {
+  const unsigned char *s = (const unsigned char *)str;
+  for (const unsigned char *p = (const unsigned char *)prefix; *p != '\0'; ++p, ++s) {
+    if (*s == '\0' || text_to_lower(*s) != text_to_lower(*p))
+      return false;
+  }
+  return true;
+}
+
+bool text_is_word_char(unsigned char c) {
+  if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c >= 0xC0)
+    return true;
+  if (text_to_lower(c) != c)
+    return true; // Capital letters out of the main block
+  switch (c) {
+  case 0xB8: // 
+  case 0xBA: // 
+  case 0xBF: // 
+  case 0xB3: // 
+  case 0xB4: // 
+  case 0xA2: // 
+    return true;
+  default: return false;
+  }
+}
+
+bool text_next_token(const char **cursor, char token[TEXT_MAX_TOKEN]) {
+  const unsigned char *c = (const unsigned char *)*cursor;
+  while (*c != '\0' && !text_is_word_char(*c))
+    ++c;
+  if (*c == '\0') {
+    *cursor = (const char *)c;
+    return false;
+  }
+  size_t length = 0;
+  for (; *c != '\0' && text_is_word_char(*c); ++c) {
+    if (length < TEXT_MAX_TOKEN - 1)
+      token[length++] = (char)text_to_lower(*c);
+  }
+  token[length] = '\0';
+  *cursor = (const char *)c;
+  return true;
+}
+
+// Transliteration of .., hard and soft signs are dropped
+static const char *const text_translit_table[32] = {
+    "a", "b", "v", "g", "d", "e", "zh", "z", "i", "i", "k", "l", "m", "n", "o", "p",
+    "r", "s", "t", "u", "f", "h", "ts", "ch", "sh", "sch", "", "i", "", "e", "iu", "ia",
+};
+
+static const char *text_translit(unsigned char c) {
+  if (c >= 0xE0)
+    return text_translit_table[c - 0xE0];
+  switch (c) {
+  case 0xB8: // 
+  case 0xBA: // 
+    return "e";
+  case 0xBF: // 
+  case 0xB3: // 
+    return "i";
+  case 0xB4: return "g"; // 
+  case 0xA2: return "u"; // 
+  default: return NULL;
+  }
+}
+
+static void text_put(char *buffer, size_t capacity, size_t *length, char c) {
+  if (c == 'y' || c == 'j')
+    c = 'i';
+  if (c == 'h' && *length > 0 && buffer[*length - 1] == 'k') {
+    buffer[*length - 1] = 'h'; // kh and h are the same 
+    return;
+  }
+  if (*length + 1 < capacity)
+    buffer[(*length)++] = c;
+}
+
+size_t text_normalize(const char *str, char *buffer, size_t capacity) {
+  size_t length = 0;
+  bool space = false;
+  for (const unsigned char *c = (const unsigned char *)str; *c != '\0' && length + 1 < capacity; ++c) {
+    if (!text_is_word_char(*c)) {
+      space = length > 0;
+      continue;
+    }
+    // Separator is written only before the next word, so the result is trimmed
+    if (space)
+      text_put(buffer, capacity, &length, ' ');
+    space = false;
+    unsigned char lower = text_to_lower(*c);
+    const char *translit = text_translit(lower);
+    if (translit == NULL) {
+      text_put(buffer, capacity, &length, (char)lower);
+      continue;
+    }
+    for (; *translit != '\0'; ++translit)
+      text_put(buffer, capacity, &length, *translit);
+  }
+  if (capacity > 0)
+    buffer[length] = '\0';
+  return length;
+}
+
+size_t text_distance(const char *left, const char *right) {
+  // Only one row of the matrix is kept, the short strings of tables fit the stack buffer
+  size_t row_buffer[TEXT_MAX_TOKEN + 1];
+  size_t right_length = strlen(right);
+  size_t *row = right_length < TEXT_MAX_TOKEN ? row_buffer : malloc((right_length + 1) * sizeof(*row));
+  if (row == NULL)
+    return SIZE_MAX;
+  for (size_t j = 0; j <= right_length; ++j)
+    row[j] = j;
+  for (const char *l = left; *l != '\0'; ++l) {
+    size_t diagonal = row[0];
+    ++row[0];
+    for (size_t j = 1; j <= right_length; ++j) {
+      size_t above = row[j];
+      size_t distance = diagonal + (*l != right[j - 1]);
+      if (above + 1 < distance)
+        distance = above + 1;
+      if (row[j - 1] + 1 < distance)
+        distance = row[j - 1] + 1;
+      row[j] = distance;
+      diagonal = above;
+    }
+  }
+  size_t distance = row[right_length];
+  if (row != row_buffer)
+    SAFE_FREE(row);
+  return distance;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "common.h"
+
+// Longer words are cut to this size with the terminator, the same way for indexed text and queries
+#ifndef TEXT_MAX_TOKEN
+#define TEXT_MAX_TOKEN 64
+#endif
+
+// Text of tables is single-byte CP-1251, so Cyrillic letters are folded by the code page table
+
+unsigned char text_to_lower(unsigned char c);
+// Compares strings ignoring case, like strcmp
+int text_compare_ignore_case(const char *left, const char *right);
+// Returns true if the string starts with the prefix ignoring case
+bool text_starts_with_ignore_case(const char *str, const char *prefix);
+// Letters and digits of both alphabets, everything else separates words
+bool text_is_word_char(unsigned char c);
+/* Copies the next word in lower case to the token and moves the cursor past it.
+ * Returns false when there are no more words.
+ */
+bool text_next_token(const char **cursor, char token[TEXT_MAX_TOKEN]);
+/* Writes the search form of string: Cyrillic is transliterated to Latin, letters are folded to lower case,
+ * letters which are spelled differently by transliteration variants are folded too (y and j to i, kh to h),
+ * and any run of other characters becomes a single space. Cut to fit the buffer, returns the length.
+ */
+size_t text_normalize(const char *str, char *buffer, size_t capacity);
+// Levenshtein distance of two strings, byte by byte
+size_t text_distance(const char *left, const char *right);
@@ -0,0 +1,379 @@
+#include "trigram_index.h"
+
+static bool trigram_index_ops_insert(struct table_index *index, void *item) {
+  return trigram_index_insert((struct trigram_index *)index, item);
+}
+
+static bool trigram_index_ops_remove(struct table_index *index, void *item) {
+  return trigram_index_remove((struct trigram_index *)index, item);
+}
+
+static void *trigram_index_ops_find(struct table_index *index, const void *key) {
+  return trigram_index_find((struct trigram_index *)index, (const char *)key);
+}
+
+static size_t trigram_index_ops_find_all(struct table_index *index,
+                                         const void *key,
+                                         table_index_callback callback,
+                                         void *context) {
+  return trigram_index_find_all((struct trigram_index *)index, (const char *)key, callback, context);
+}
+
+static void trigram_index_ops_rebuild(struct table_index *index) {
+  trigram_index_rebuild((struct trigram_index *)index);
+}
+
+static const struct table_index_ops trigram_index_ops = {
+    trigram_index_ops_insert,
+    trigram_index_ops_remove,
+    trigram_index_ops_find,
+    trigram_index_ops_find_all,
+    trigram_index_ops_rebuild,
+    NULL,
+};
+
+struct trigram_index *trigram_index_create(struct trigram_index *at,
+                                           struct dynamic_array *arr,
+                                           const trigram_index_key_getter *key_getters,
+                                           size_t key_getters_size,
+                                           uint32_t fields) {
+  // Allocating a buffer for structure or use existing if index was provided as the first argument
+  struct trigram_index *index = at == NULL ? malloc(sizeof(*index)) : at;
+  index->base.ops = &trigram_index_ops;
+  index->base.arr = arr;
+  index->base.fields = fields;
+  index->lists = NULL;
+  index->key_getters = key_getters;
+  index->key_getters_size = key_getters_size;
+  index->self_created = index != at;
+  return index;
+}
+
+static void trigram_index_clear(struct trigram_index *index) {
+  if (index->lists == NULL)
+    return;
+  for (size_t code = 0; code < TRIGRAM_INDEX_CODES; ++code) {
+    posting_list_clear(index->lists + code);
+  }
+  SAFE_FREE(index->lists);
+}
+
+void trigram_index_destroy(struct trigram_index *index) {
+  if (index == NULL)
+    return;
+  trigram_index_clear(index);
+  if (index->self_created)
+    free(index);
+}
+
+static size_t trigram_index_char_code(char c) {
+  if (c >= 'a' && c <= 'z')
+    return (size_t)(c - 'a') + 1;
+  if (c >= '0' && c <= '9')
+    return (size_t)(c - '0') + 27;
+  return 0; // Space
+}
+
+static size_t trigram_index_code(const char *trigram) {
+  return (trigram_index_char_code(trigram[0]) * TRIGRAM_INDEX_ALPHABET + trigram_index_char_code(trigram[1]))
+      * TRIGRAM_INDEX_ALPHABET + trigram_index_char_code(trigram[2]);
+}
+
+static size_t trigram_index_field(struct trigram_index *index, void *item, size_t field, char *buffer) {
+  const char *value = index->key_getters[field](item);
+  if (value == NULL) {
+    buffer[0] = '\0';
+    return 0;
+  }
+  return text_normalize(value, buffer, TRIGRAM_INDEX_MAX_TEXT);
+}
+
+static bool trigram_index_add_item(struct trigram_index *index, void *item, bool append) {
+  struct dynamic_array_handle handle = dynamic_array_handle_of(index->base.arr, item);
+  if (dynamic_array_handle_is_null(handle))
+    return false;
+  if (index->lists == NULL) {
+    index->lists = calloc(TRIGRAM_INDEX_CODES, sizeof(*index->lists));
+    if (index->lists == NULL)
+      return false;
+  }
+  bool added = true;
+  char buffer[TRIGRAM_INDEX_MAX_TEXT];
+  for (size_t field = 0; field < index->key_getters_size; ++field) {
+    size_t length = trigram_index_field(index, item, field, buffer);
+    for (size_t i = 0; i + 3 <= length; ++i) {
+      if (!posting_list_add(index->lists + trigram_index_code(buffer + i), handle, append))
+        added = false;
+    }
+  }
+  return added;
+}
+
+bool trigram_index_insert(struct trigram_index *index, void *item) {
+  return trigram_index_add_item(index, item, false);
+}
+
+bool trigram_index_remove(struct trigram_index *index, void *item) {
+  struct dynamic_array_handle handle = dynamic_array_handle_of(index->base.arr, item);
+  if (dynamic_array_handle_is_null(handle) || index->lists == NULL)
+    return false;
+  char buffer[TRIGRAM_INDEX_MAX_TEXT];
+  for (size_t field = 0; field < index->key_getters_size; ++field) {
+    size_t length = trigram_index_field(index, item, field, buffer);
+    for (size_t i = 0; i + 3 <= length; ++i) {
+      posting_list_remove(index->lists + trigram_index_code(buffer + i), handle);
+    }
+  }
+  return true;
+}
+
+static int trigram_index_code_compare(const void *left, const void *right) {
+  size_t left_code = *(const size_t *)left;
+  size_t right_code = *(const size_t *)right;
+  return left_code < right_code ? -1 : left_code > right_code;
+}
+
+static size_t trigram_index_query_codes(const char *query, size_t length, size_t *codes) {
+  // Distinct trigrams of query, repeated ones would only slow the intersection down
+  if (length < 3)
+    return 0;
+  size_t size = 0;
+  for (size_t i = 0; i + 3 <= length; ++i) {
+    codes[size++] = trigram_index_code(query + i);
+  }
+  qsort(codes, size, sizeof(*codes), trigram_index_code_compare);
+  size_t unique = 1;
+  for (size_t i = 1; i < size; ++i) {
+    if (codes[i] != codes[unique - 1])
+      codes[unique++] = codes[i];
+  }
+  return unique;
+}
+
+static bool trigram_index_verify(struct trigram_index *index, void *item, const char *query) {
+  char buffer[TRIGRAM_INDEX_MAX_TEXT];
+  for (size_t field = 0; field < index->key_getters_size; ++field) {
+    trigram_index_field(index, item, field, buffer);
+    if (strstr(buffer, query) != NULL)
+      return true;
+  }
+  return false;
+}
+
+size_t trigram_index_find_all(struct trigram_index *index,
+                              const char *query,
+                              table_index_callback callback,
+                              void *context) {
+  char normalized[TRIGRAM_INDEX_MAX_TEXT];
+  size_t length = text_normalize(query, normalized, sizeof(normalized));
+  size_t found = 0;
+
+  if (length < 3) {
+    // Query has no trigrams, so each item is a candidate
+    size_t size = dynamic_array_size(index->base.arr);
+    for (size_t position = 0; position < size; ++position) {
+      void *item = dynamic_array_get_at(index->base.arr, position);
+      if (dynamic_array_is_dead(index->base.arr, position) || !trigram_index_verify(index, item, normalized))
+        continue;
+      ++found;
+      if (callback != NULL && !callback(item, context))
+        break; // Callback asked to stop
+    }
+    return found;
+  }
+  if (index->lists == NULL)
+    return 0;
+
+  size_t codes[TRIGRAM_INDEX_MAX_TEXT];
+  struct posting_list *lists[TRIGRAM_INDEX_MAX_TEXT];
+  size_t codes_size = trigram_index_query_codes(normalized, length, codes);
+  for (size_t i = 0; i < codes_size; ++i) {
+    lists[i] = index->lists + codes[i];
+  }
+  struct dynamic_array_handle *candidates;
+  size_t candidates_size = posting_list_intersect(lists, codes_size, &candidates);
+  for (size_t i = 0; i < candidates_size; ++i) {
+    void *item = dynamic_array_resolve(index->base.arr, candidates[i]);
+    // Trigrams of candidate may be scattered over the field, so the substring is checked
+    if (item == NULL || !trigram_index_verify(index, item, normalized))
+      continue;
+    ++found;
+    if (callback != NULL && !callback(item, context))
+      break; // Callback asked to stop
+  }
+  SAFE_FREE(candidates);
+  return found;
+}
+
+static bool trigram_index_find_callback(void *item, void *context) {
+  *(void **)context = item;
+  return false;
+}
+
+void *trigram_index_find(struct trigram_index *index, const char *query) {
+  void *found = NULL;
+  trigram_index_find_all(index, query, trigram_index_find_callback, &found);
+  return found;
+}
+
+static size_t trigram_index_substring_distance(const char *pattern, size_t pattern_length, const char *text, size_t *row) {
+  // Levenshtein distance from the pattern to the closest substring of text, substring may start anywhere for free
+  for (size_t i = 0; i <= pattern_length; ++i)
+    row[i] = i;
+  size_t best = row[pattern_length];
+  for (const char *c = text; *c != '\0'; ++c) {
+    size_t diagonal = row[0];
+    row[0] = 0;
+    for (size_t i = 1; i <= pattern_length; ++i) {
+      size_t above = row[i];
+      size_t distance = diagonal + (pattern[i - 1] != *c);
+      if (above + 1 < distance)
+        distance = above + 1;
+      if (row[i - 1] + 1 < distance)
+        distance = row[i - 1] + 1;
+      row[i] = distance;
+      diagonal = above;
+    }
+    if (row[pattern_length] < best)
+      best = row[pattern_length];
+  }
+  return best;
+}
+
+struct trigram_index_match {
+  struct dynamic_array_handle handle;
+  size_t distance;
+};
+
+static int trigram_index_match_compare(const void *left, const void *right) {
+  const struct trigram_index_match *left_match = (const struct trigram_index_match *)left;
+  const struct trigram_index_match *right_match = (const struct trigram_index_match *)right;
+  // Closest first, items of the same distance keep the order of slots
+  if (left_match->distance != right_match->distance)
+    return left_match->distance < right_match->distance ? -1 : 1;
+  if (left_match->handle.slot != right_match->handle.slot)
+    return left_match->handle.slot < right_match->handle.slot ? -1 : 1;
+  return 0;
+}
+
+static size_t trigram_index_similar_candidates(struct trigram_index *index,
+                                               const char *query,
+                                               size_t length,
+                                               size_t max_distance,
+                                               struct dynamic_array_handle **result) {
+  // Each edit breaks up to 3 trigrams of query, so a close substring keeps the rest of them
+  size_t codes[TRIGRAM_INDEX_MAX_TEXT];
+  size_t codes_size = trigram_index_query_codes(query, length, codes);
+  size_t size = 0;
+  *result = NULL;
+  if (codes_size <= max_distance * 3) {
+    // Nothing is left to filter by, so each item is a candidate
+    *result = malloc((dynamic_array_live_size(index->base.arr) + 1) * sizeof(**result));
+    if (*result == NULL)
+      return 0;
+    for (size_t position = 0; position < dynamic_array_size(index->base.arr); ++position) {
+      if (!dynamic_array_is_dead(index->base.arr, position))
+        (*result)[size++] = dynamic_array_handle_of(index->base.arr, dynamic_array_get_at(index->base.arr, position));
+    }
+    return size;
+  }
+  if (index->lists == NULL)
+    return 0;
+
+  // Count the trigrams of query each item has, counters are indexed by slot
+  size_t min_count = codes_size - max_distance * 3;
+  uint16_t *counts = calloc(index->base.arr->slots_size, sizeof(*counts));
+  size_t capacity = 16;
+  *result = malloc(capacity * sizeof(**result));
+  if (counts == NULL || *result == NULL) {
+    SAFE_FREE(counts);
+    SAFE_FREE(*result);
+    return 0;
+  }
+  for (size_t i = 0; i < codes_size; ++i) {
+    struct posting_list *list = index->lists + codes[i];
+    for (size_t posting = 0; posting < list->size; ++posting) {
+      struct dynamic_array_handle handle = list->postings[posting];
+      if (dynamic_array_handle_is_null(handle) || ++counts[handle.slot] != min_count)
+        continue;
+      // Item has just got enough trigrams
+      if (size == capacity) {
+        capacity *= 2;
+        struct dynamic_array_handle *handles = realloc(*result, capacity * sizeof(*handles));
+        if (handles == NULL)
+          break;
+        *result = handles;
+      }
+      (*result)[size++] = handle;
+    }
+  }
+  SAFE_FREE(counts);
+  return size;
+}
+
+size_t trigram_index_find_similar(struct trigram_index *index,
+                                  const char *query,
+                                  size_t max_distance,
+                                  trigram_index_ranked_callback callback,
+                                  void *context) {
+  char normalized[TRIGRAM_INDEX_MAX_TEXT];
+  size_t length = text_normalize(query, normalized, sizeof(normalized));
+  if (length == 0)
+    return 0;
+
+  struct dynamic_array_handle *candidates;
+  size_t candidates_size = trigram_index_similar_candidates(index, normalized, length, max_distance, &candidates);
+  struct trigram_index_match *matches = malloc((candidates_size + 1) * sizeof(*matches));
+  if (matches == NULL) {
+    SAFE_FREE(candidates);
+    return 0;
+  }
+
+  // Each candidate gets the distance of its closest field
+  size_t matches_size = 0;
+  char buffer[TRIGRAM_INDEX_MAX_TEXT];
+  size_t row[TRIGRAM_INDEX_MAX_TEXT];
+  for (size_t i = 0; i < candidates_size; ++i) {
+    void *item = dynamic_array_resolve(index->base.arr, candidates[i]);
+    if (item == NULL)
+      continue;
+    size_t best = max_distance + 1;
+    for (size_t field = 0; field < index->key_getters_size && best > 0; ++field) {
+      trigram_index_field(index, item, field, buffer);
+      size_t distance = trigram_index_substring_distance(normalized, length, buffer, row);
+      if (distance < best)
+        best = distance;
+    }
+    if (best <= max_distance) {
+      matches[matches_size].handle = candidates[i];
+      matches[matches_size].distance = best;
+      ++matches_size;
+    }
+  }
+  SAFE_FREE(candidates);
+
+  qsort(matches, matches_size, sizeof(*matches), trigram_index_match_compare);
+  size_t found = 0;
+  for (size_t i = 0; i < matches_size; ++i) {
+    ++found;
+    if (callback != NULL && !callback(dynamic_array_resolve(index->base.arr, matches[i].handle), matches[i].distance, context))
+      break; // Callback asked to stop
+  }
+  SAFE_FREE(matches);
+  return found;
+}
+
+void trigram_index_rebuild(struct trigram_index *index) {
+  // Drop all of the postings, postings of each item are appended and every list is sorted once
+  trigram_index_clear(index);
+  size_t size = dynamic_array_size(index->base.arr);
+  for (size_t position = 0; position < size; ++position) {
+    if (!dynamic_array_is_dead(index->base.arr, position))
+      trigram_index_add_item(index, dynamic_array_get_at(index->base.arr, position), true);
+  }
+  if (index->lists == NULL)
+    return;
+  for (size_t code = 0; code < TRIGRAM_INDEX_CODES; ++code) {
+    posting_list_sort(index->lists + code);
+  }
+}
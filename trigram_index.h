@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "dynamic_array.h"
+#include "index_registry.h"
+#include "posting_list.h"
+#include "text.h"
+#include "common.h"
+
+// Normalized text has a space, 26 letters and 10 digits, so each trigram has its own posting list
+#define TRIGRAM_INDEX_ALPHABET 37
+#define TRIGRAM_INDEX_CODES (TRIGRAM_INDEX_ALPHABET * TRIGRAM_INDEX_ALPHABET * TRIGRAM_INDEX_ALPHABET)
+
+// Normalized fields and queries are cut to this size with the terminator
+#ifndef TRIGRAM_INDEX_MAX_TEXT
+#define TRIGRAM_INDEX_MAX_TEXT 512
+#endif
+
+typedef const char *(*trigram_index_key_getter)(void *item);
+// Gets called for similar items from the closest one, returns false to stop the iteration
+typedef bool (*trigram_index_ranked_callback)(void *item, size_t distance, void *context);
+
+/* Substring index over several string fields of items.
+ * Fields and queries are compared in the form of text_normalize, so case and transliteration don't matter.
+ * Items which have all of the trigrams of query are the candidates, then each of them is verified,
+ * because trigrams may come from different places of the field.
+ */
+struct trigram_index {
+  struct table_index base; // Must be the first, registry passes the index by base pointer
+  struct posting_list *lists; // TRIGRAM_INDEX_CODES lists, allocated by the first item
+  const trigram_index_key_getter *key_getters; // Fields to be indexed, the array must live as long as the index
+  size_t key_getters_size;
+  bool self_created;
+};
+
+struct trigram_index *trigram_index_create(struct trigram_index *at,
+                                           struct dynamic_array *arr,
+                                           const trigram_index_key_getter *key_getters,
+                                           size_t key_getters_size,
+                                           uint32_t fields);
+void trigram_index_destroy(struct trigram_index *index);
+
+bool trigram_index_insert(struct trigram_index *index, void *item);
+bool trigram_index_remove(struct trigram_index *index, void *item);
+// Returns any item which has the query as a substring of some field
+void *trigram_index_find(struct trigram_index *index, const char *query);
+// Visits items which have the query as a substring of some field, queries shorter than trigram scan all items
+size_t trigram_index_find_all(struct trigram_index *index,
+                              const char *query,
+                              table_index_callback callback,
+                              void *context);
+/* Visits items which have a substring within max_distance edits (Levenshtein) from the query,
+ * ordered by the distance. Candidates should share enough trigrams with the query to be that close.
+ */
+size_t trigram_index_find_similar(struct trigram_index *index,
+                                  const char *query,
+                                  size_t max_distance,
+                                  trigram_index_ranked_callback callback,
+                                  void *context);
+void trigram_index_rebuild(struct trigram_index *index);
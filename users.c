@@ -1,58 +1,98 @@
 #include "users.h"
 
 struct users *users_create(struct users *pool) {
+  METRICS_BEGIN(users_create);
   // Allocating a buffer for structure or use existing if pool was provided as argument
   struct users *buffer = pool == NULL ? malloc(sizeof(struct users)) : pool;
   // Construct a dynamic array
   dynamic_array_create(&buffer->arr, sizeof(struct user), users_item_constructor, users_item_destructor, NULL);
+  // Items are referenced by handles, which survive moves of items
+  dynamic_array_enable_handles(&buffer->arr);
+  // Construct an index by name
+  hash_index_create(&buffer->name_index, &buffer->arr, users_item_name, TABLE_INDEX_ALL_FIELDS, true);
+  dynamic_array_add_index(&buffer->arr, &buffer->name_index.base);
+  dynamic_array_set_primary_index(&buffer->arr, &buffer->name_index.base);
+  snapshot_init(&buffer->snapshot);
+  string_arena_create(&buffer->strings);
   // Do not release if we didn't allocate by ourselves
   buffer->self_created = pool == buffer;
+  METRICS_END();
   return buffer;
 }
 
 void users_destroy(struct users *pool) {
   if (pool == NULL)
     return;
+  METRICS_BEGIN(users_destroy);
+  hash_index_destroy(&pool->name_index);
+  // Items own nothing but strings, so they are released all at once by chunks instead of one by one
+  pool->arr.item_destructor = NULL;
   dynamic_array_destroy(&pool->arr);
+  snapshot_release(&pool->snapshot);
+  string_arena_destroy(&pool->strings);
   // Do not release if we didn't allocate by ourselves
-  if (!pool->self_created)
+  if (!pool->self_created) {
+    METRICS_END();
     return;
+  }
   free(pool);
+  METRICS_END();
 }
 
 struct user *users_insert(struct users *pool, user_insert_data data) {
+  METRICS_BEGIN(users_insert);
   // Find for item in structure
   struct user *found = users_find_by_name(pool, data.name);
-  if (found)
+  if (found) {
+    METRICS_END();
     return found;
-  // Insert if we didn't find it and return a pointer
-  return (struct user *)dynamic_array_insert(&pool->arr, &data, NULL);
+  }
+  // Insert if we didn't find it and return a pointer, array updates the indexes
+  struct user *item = (struct user *)dynamic_array_insert(&pool->arr, &data, NULL);
+  METRICS_END();
+  return item;
 }
 
 bool users_remove(struct users *pool, struct user *at) {
-  return dynamic_array_remove(&pool->arr, (void *)at);
+  METRICS_BEGIN(users_remove);
+  if (at == NULL) {
+    METRICS_END();
+    return false;
+  }
+  bool removed = dynamic_array_remove(&pool->arr, (void *)at);
+  METRICS_END();
+  return removed;
 }
 
 bool users_remove_by_name(struct users *pool, const char *name) {
+  METRICS_BEGIN(users_remove_by_name);
   // Find for item in structure by name
   struct user *item = users_find_by_name(pool, name);
-  if (item == NULL)
+  if (item == NULL) {
+    METRICS_END();
     return false;
+  }
   // Remove if found
-  return dynamic_array_remove(&pool->arr, (void *)item);
+  bool removed = users_remove(pool, item);
+  METRICS_END();
+  return removed;
 }
 
 struct user *users_find_by_name(struct users *pool, const char *name) {
-  // If there are some items
-  if (users_size(pool) > 0) {
-    for (struct user *item = users_first(pool); item <= users_last(pool); ++item) {
-      // If pointer is not null and names equals
-      if (item != NULL && strcmp(item->name, name) == 0) {
-        return item;
-      }
-    }
-  }
-  return NULL;
+  METRICS_BEGIN(users_find_by_name);
+  // Lookup in the index by name
+  struct user *item = (struct user *)hash_index_find(&pool->name_index, name);
+  METRICS_END();
+  return item;
+}
+
+struct dynamic_array_handle users_handle_of(struct users *pool, struct user *item) {
+  return dynamic_array_handle_of(&pool->arr, item);
+}
+
+struct user *users_resolve(struct users *pool, struct dynamic_array_handle handle) {
+  // NULL if the item was removed
+  return (struct user *)dynamic_array_resolve(&pool->arr, handle);
 }
 
 struct user *users_first(struct users *users) {
@@ -70,63 +110,184 @@ struct user *users_end(struct users *pool) {
   return (struct user *)dynamic_array_end(&pool->arr);
 }
 
+void users_lock_shared(struct users *pool) {
+  dynamic_array_lock_shared(&pool->arr);
+}
+
+void users_unlock_shared(struct users *pool) {
+  dynamic_array_unlock_shared(&pool->arr);
+}
+
+void users_lock_exclusive(struct users *pool) {
+  dynamic_array_lock_exclusive(&pool->arr);
+}
+
+void users_unlock_exclusive(struct users *pool) {
+  dynamic_array_unlock_exclusive(&pool->arr);
+}
+
 size_t users_size(struct users *pool) {
   // Count of users
   return dynamic_array_size(&pool->arr);
 }
 
-void users_item_constructor(struct dynamic_array *arr, void *item, void *data) {
+void *users_item_constructor(struct dynamic_array *arr, void *item, void *data) {
   // Users constructor, gets clalled by dynamic_array_insert
 
   user_insert_data *insert_data = (user_insert_data *)data;
   struct user *position = (struct user *)item;
 
   // Copy each of values because the provided data will locate to temporary buffer
-  position->name = copy_string(insert_data->name);
-  position->password = copy_string(insert_data->password);
+  struct users *pool = (struct users *)arr; // Dynamic array is the first member of pool
+  position->name = string_arena_copy(&pool->strings, insert_data->name);
+  position->password = string_arena_copy(&pool->strings, insert_data->password);
   position->can_view_edit_students = insert_data->can_view_edit_students;
   position->can_view_edit_books = insert_data->can_view_edit_books;
+  return position;
 }
 
 void users_item_destructor(struct dynamic_array *arr, void *item) {
   // Books destructor, gets called by dynamic_array_remove
 
   struct user *this_item = (struct user *)item;
+  struct users *pool = (struct users *)arr; // Dynamic array is the first member of pool
   // Safe release of each item in structure
-  SAFE_FREE(this_item->name);
-  SAFE_FREE(this_item->password);
+  users_release_string(pool, &this_item->name);
+  users_release_string(pool, &this_item->password);
+}
+
+void users_release_string(struct users *pool, const char **str) {
+  // Strings of snapshot get released all at once with the snapshot
+  if (snapshot_owns(&pool->snapshot, *str)) {
+    *str = NULL;
+    return;
+  }
+  string_arena_release(&pool->strings, *str);
+  *str = NULL;
 }
 
-struct users *users_create_from_csv(struct users *pool, struct csv_data *csv) {
+const char *users_item_name(void *item) {
+  // Key of the index by name
+  return ((struct user *)item)->name;
+}
+
+struct users *users_create_from_csv(struct users *pool, struct csv_reader *reader) {
+  METRICS_BEGIN(users_create_from_csv);
   struct users *buffer = users_create(pool);
-  for (struct csv_row *row = csv_data_first(csv); row <= csv_data_last(csv); ++row) {
-    if (row == NULL || csv_row_size(row) < 3)
+  // Reserve the space for all rows at once instead of growing the buffer for every item
+  dynamic_array_reserve(&buffer->arr, csv_reader_count_lines(reader));
+  struct csv_record record;
+  while (csv_reader_next(reader, &record)) {
+    if (record.size < 4)
+      continue;
+    // Values are zero-terminated copies of fields, valid until the next row
+    if (!csv_reader_copy_values(reader, &record))
       continue;
     user_insert_data data;
-    // Get each of values, but do not copy values because the data is temporary
-    data.name = *csv_row_get_at(row, 0);
-    data.password = *csv_row_get_at(row, 1);
-    data.can_view_edit_students = **csv_row_get_at(row, 2) == '1';
-    data.can_view_edit_books = **csv_row_get_at(row, 3) == '1';
+    // Do not copy values, item constructor copies them
+    data.name = record.values[0];
+    data.password = record.values[1];
+    data.can_view_edit_students = *record.values[2] == '1';
+    data.can_view_edit_books = *record.values[3] == '1';
     // Insert item
     users_insert(buffer, data);
   }
+  METRICS_END();
   return buffer;
 }
 
-void users_save_csv_to_file(struct users *pool, FILE *fp) {
-  static char buffer[512 + 1];
-  for (struct user *entry = users_first(pool); entry <= users_last(pool); ++entry) {
-    if (entry == NULL)
-      continue;
-    memset(buffer, 0, sizeof(buffer));
-    sprintf_s(buffer,
-              sizeof(buffer),
-              "%s;%s;%d;%d\n",
-              entry->name,
-              entry->password,
-              entry->can_view_edit_students ? 1 : 0,
-              entry->can_view_edit_books ? 1 : 0);
-    fwrite(buffer, sizeof(char), strlen(buffer), fp);
+bool users_save_csv_to_file(struct users *pool, FILE *fp) {
+  METRICS_BEGIN(users_save_csv_to_file);
+  struct output_buffer out;
+  output_buffer_create(&out, fp);
+  for (size_t i = 0; i < users_size(pool); ++i) {
+    const struct user *entry = users_first(pool) + i;
+    output_buffer_write_csv_field(&out, entry->name);
+    output_buffer_write_char(&out, ';');
+    output_buffer_write_csv_field(&out, entry->password);
+    output_buffer_write_char(&out, ';');
+    output_buffer_write_char(&out, entry->can_view_edit_students ? '1' : '0');
+    output_buffer_write_char(&out, ';');
+    output_buffer_write_char(&out, entry->can_view_edit_books ? '1' : '0');
+    output_buffer_write_char(&out, '\n');
+  }
+  bool written = output_buffer_destroy(&out);
+  METRICS_END();
+  return written;
+}
+
+struct users_snapshot_record {
+  uint64_t name;
+  uint64_t password;
+  uint8_t can_view_edit_books;
+  uint8_t can_view_edit_students;
+};
+
+static bool users_item_from_record(const struct snapshot *snapshot, size_t position, struct user *item) {
+  const struct users_snapshot_record *record = (const struct users_snapshot_record *)snapshot->records + position;
+  item->name = snapshot_string(snapshot, record->name);
+  item->password = snapshot_string(snapshot, record->password);
+  item->can_view_edit_books = record->can_view_edit_books != 0;
+  item->can_view_edit_students = record->can_view_edit_students != 0;
+  // Do not trust the broken snapshot, strings must be in heap
+  return item->name != NULL && item->password != NULL;
+}
+
+struct users *users_create_from_snapshot(struct users *pool, const char *path, const struct snapshot_stamp *stamp) {
+  METRICS_BEGIN(users_create_from_snapshot);
+  struct snapshot snapshot;
+  if (!snapshot_load(&snapshot, path, SNAPSHOT_TABLE_USERS, sizeof(struct users_snapshot_record), stamp)) {
+    METRICS_END();
+    return NULL;
+  }
+
+  struct users *buffer = users_create(pool);
+  // The pool owns the snapshot, items point to its strings
+  buffer->snapshot = snapshot;
+  dynamic_array_reserve(&buffer->arr, snapshot.records_count);
+  for (size_t i = 0; i < snapshot.records_count; ++i) {
+    struct user item;
+    if (!users_item_from_record(&snapshot, i, &item)) {
+      // The caller falls back to CSV
+      users_destroy(buffer);
+      METRICS_END();
+      return NULL;
+    }
+    // Array indexes the item
+    dynamic_array_append_raw(&buffer->arr, &item, 1);
+  }
+  METRICS_END();
+  return buffer;
+}
+
+bool users_build_snapshot(struct users *pool, struct snapshot *snapshot) {
+  METRICS_BEGIN(users_build_snapshot);
+  // Copy all items to the snapshot, it doesn't depend on the pool anymore
+  struct snapshot_builder builder;
+  snapshot_builder_init(&builder, sizeof(struct users_snapshot_record), users_size(pool));
+  for (size_t i = 0; i < users_size(pool); ++i) {
+    struct user *entry = users_first(pool) + i;
+    struct users_snapshot_record *record = (struct users_snapshot_record *)snapshot_builder_add_record(&builder);
+    record->name = snapshot_builder_add_string(&builder, entry->name);
+    record->password = snapshot_builder_add_string(&builder, entry->password);
+    record->can_view_edit_books = entry->can_view_edit_books ? 1 : 0;
+    record->can_view_edit_students = entry->can_view_edit_students ? 1 : 0;
+  }
+  bool built = snapshot_builder_finish(&builder, snapshot, SNAPSHOT_TABLE_USERS);
+  snapshot_builder_release(&builder);
+  METRICS_END();
+  return built;
+}
+
+bool users_save_snapshot(struct users *pool, const char *path, const struct snapshot_stamp *stamp) {
+  METRICS_BEGIN(users_save_snapshot);
+  struct snapshot snapshot;
+  if (!users_build_snapshot(pool, &snapshot)) {
+    METRICS_END();
+    return false;
   }
+  bool written = snapshot_write(&snapshot, path, stamp);
+  snapshot_release(&snapshot);
+  METRICS_END();
+  return written;
 }
@@ -7,8 +7,11 @@
 #include <string.h>
 
 #include "dynamic_array.h"
-#include "csv/csv_parser.h"
-#include "csv/csv_row.h"
+#include "hash_index.h"
+#include "snapshot.h"
+#include "string_arena.h"
+#include "output_buffer.h"
+#include "csv/csv_reader.h"
 #include "common.h"
 
 struct user {
@@ -21,7 +24,10 @@ struct user {
 typedef struct user user_insert_data;
 
 struct users {
-  struct dynamic_array arr;
+  struct dynamic_array arr; // Must be the first, item destructor gets the pool by array pointer
+  struct hash_index name_index;
+  struct snapshot snapshot; // Owns the strings of items loaded from snapshot
+  struct string_arena strings; // Owns the strings of items inserted after that
   bool self_created;
 };
 
@@ -33,15 +39,31 @@ bool users_remove_by_name(struct users *pool, const char *name);
 
 struct user *users_find_by_name(struct users *pool, const char *name);
 
+// Handle stays valid until the item is removed, unlike the pointer to item
+struct dynamic_array_handle users_handle_of(struct users *pool, struct user *item);
+struct user *users_resolve(struct users *pool, struct dynamic_array_handle handle);
+
 struct user *users_first(struct users *pool);
 struct user *users_last(struct users *pool);
 struct user *users_end(struct users *pool);
 
+// Readers share the table and the writer has it alone, the pointers to items are valid only under the lock
+void users_lock_shared(struct users *pool);
+void users_unlock_shared(struct users *pool);
+void users_lock_exclusive(struct users *pool);
+void users_unlock_exclusive(struct users *pool);
+
 size_t users_size(struct users *pool);
 
 // Helpers
-void users_item_constructor(struct dynamic_array *arr, void *item, void *data);
+void *users_item_constructor(struct dynamic_array *arr, void *item, void *data);
 void users_item_destructor(struct dynamic_array *arr, void *item);
+void users_release_string(struct users *pool, const char **str);
+const char *users_item_name(void *item);
+
+struct users *users_create_from_csv(struct users *pool, struct csv_reader *reader);
+bool users_save_csv_to_file(struct users *pool, FILE *fp);
 
-struct users *users_create_from_csv(struct users *pool, struct csv_data *csv);
-void users_save_csv_to_file(struct users *pool, FILE *fp);
+struct users *users_create_from_snapshot(struct users *pool, const char *path, const struct snapshot_stamp *stamp);
+bool users_build_snapshot(struct users *pool, struct snapshot *snapshot);
+bool users_save_snapshot(struct users *pool, const char *path, const struct snapshot_stamp *stamp);